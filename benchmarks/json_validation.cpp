@@ -0,0 +1,141 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <mofka/Metadata.hpp>
+#include <spdlog/spdlog.h>
+#include <tclap/CmdLine.h>
+#include <spdlog/fmt/fmt.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Measures the structural validation of metadata strings, performed by
+ * Metadata::isValidJson (hence by the default Validator and by the
+ * Metadata(str, true) constructor), against the previous character-by-
+ * character implementation, reproduced below. Metadata are records of
+ * roughly 200 B, 1 KB, and 8 KB with nested objects, arrays, numbers,
+ * and strings containing escaped quotes. */
+
+static size_t      g_num_events = 10000;
+static size_t      g_iterations = 10;
+static std::string g_log_level = "error";
+
+static void parse_command_line(int argc, char** argv);
+
+/* previous implementation of the structural validation */
+static bool ValidateIsJsonPrevious(std::string_view json) {
+    std::stack<char> brackets;
+    bool insideString = false;
+    bool escaped = false;
+    for (char c : json) {
+        if (!escaped) {
+            if (c == '"') {
+                insideString = !insideString;
+            } else if (!insideString) {
+                if (c == '{' || c == '[') {
+                    brackets.push(c);
+                } else if (c == '}' || c == ']') {
+                    if (brackets.empty()) return false;
+                    char top = brackets.top();
+                    brackets.pop();
+                    if ((c == '}' && top != '{') || (c == ']' && top != '['))
+                        return false;
+                }
+            }
+        }
+        if (c == '\\') escaped = !escaped;
+        else escaped = false;
+    }
+    return brackets.empty();
+}
+
+static std::string make_event(size_t i, size_t target_size) {
+    auto result = fmt::format(
+        R"({{"time":{}.{},"host":"node{:04}","rank":{},"status":"running",)"
+        R"("message":"step \"{}\" completed","samples":[)",
+        1700000000 + i, i % 1000, i % 512, i % 4096, i);
+    size_t j = 0;
+    while(result.size() + 2 < target_size) {
+        if(j) result += ",";
+        result += fmt::format(
+            R"({{"sensor":"s{}","value":{}.{},"unit":"C","path":"C:\\data\\{}"}})",
+            j, (i + j) % 100, j % 10, j);
+        j += 1;
+    }
+    result += "]}";
+    return result;
+}
+
+int main(int argc, char** argv) {
+    parse_command_line(argc, argv);
+    spdlog::set_level(spdlog::level::from_str(g_log_level));
+
+    try {
+        std::printf("%10s %20s %20s %10s\n",
+                    "size (B)", "previous (GB/s)", "current (GB/s)", "speedup");
+        for(size_t target_size : {200, 1024, 8192}) {
+            std::vector<std::string> events;
+            size_t total_bytes = 0;
+            for(size_t i = 0; i < g_num_events; ++i) {
+                events.push_back(make_event(i, target_size));
+                total_bytes += events.back().size();
+            }
+            double previous_time = 0, current_time = 0;
+            size_t valid = 0;
+            for(size_t it = 0; it < g_iterations; ++it) {
+                auto t0 = std::chrono::steady_clock::now();
+                for(const auto& e : events)
+                    valid += ValidateIsJsonPrevious(e);
+                auto t1 = std::chrono::steady_clock::now();
+                /* new Metadata objects, so that the result is not cached */
+                std::vector<mofka::Metadata> metadata(events.begin(), events.end());
+                auto t2 = std::chrono::steady_clock::now();
+                for(const auto& md : metadata)
+                    valid += md.isValidJson();
+                auto t3 = std::chrono::steady_clock::now();
+                previous_time += std::chrono::duration<double>(t1 - t0).count();
+                current_time  += std::chrono::duration<double>(t3 - t2).count();
+            }
+            if(valid != 2*g_iterations*g_num_events)
+                std::cerr << "unexpected invalid metadata" << std::endl;
+            auto bytes = double(total_bytes*g_iterations);
+            std::printf("%10.0f %20.2f %20.2f %10.1f\n",
+                        double(total_bytes)/g_num_events,
+                        bytes/previous_time/1e9, bytes/current_time/1e9,
+                        previous_time/current_time);
+        }
+    } catch(const mofka::Exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+void parse_command_line(int argc, char** argv) {
+    try {
+        TCLAP::CmdLine cmd("Mofka JSON structural validation benchmark", ' ', "0.1");
+        TCLAP::ValueArg<size_t> numEventsArg(
+            "n", "num-events", "Number of metadata of each size", false, 10000, "int");
+        TCLAP::ValueArg<size_t> iterationsArg(
+            "i", "iterations", "Number of iterations", false, 10, "int");
+        TCLAP::ValueArg<std::string> logLevel(
+            "v", "verbose", "Log level (trace, debug, info, warning, error, critical, off)", false, "error", "string");
+        cmd.add(numEventsArg);
+        cmd.add(iterationsArg);
+        cmd.add(logLevel);
+        cmd.parse(argc, argv);
+        g_num_events = numEventsArg.getValue();
+        g_iterations = iterationsArg.getValue();
+        g_log_level = logLevel.getValue();
+    } catch(TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        exit(-1);
+    }
+}
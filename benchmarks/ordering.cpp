@@ -0,0 +1,134 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <bedrock/Server.hpp>
+#include <mofka/Client.hpp>
+#include <mofka/TopicHandle.hpp>
+#include <spdlog/spdlog.h>
+#include <tclap/CmdLine.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+/* Measures the throughput of Producer::push with Ordering::Strict and
+ * Ordering::Loose when an increasing number of push ULTs run concurrently
+ * (one per thread of the producer's ThreadPool). The server runs in the
+ * same process. */
+
+static const char* g_config = R"(
+{
+    "libraries" : {
+        "mofka" : "libmofka-bedrock-module.so"
+    },
+    "providers" : [
+        {
+            "name" : "my_mofka_provider",
+            "type" : "mofka",
+            "provider_id" : 0
+        }
+    ],
+    "ssg" : [
+        {
+            "name" : "mofka_group",
+            "method" : "init",
+            "group_file" : "mofka-benchmark.ssg",
+            "swim" : {
+                "period_length_ms" : 100
+            }
+        }
+    ]
+}
+)";
+
+static std::string g_protocol = "na+sm";
+static size_t      g_num_events = 100000;
+static size_t      g_batch_size = 128;
+static size_t      g_max_concurrency = 64;
+static std::string g_log_level = "error";
+
+static void parse_command_line(int argc, char** argv);
+
+static double run(mofka::TopicHandle& topic, mofka::Ordering ordering, size_t concurrency) {
+    auto producer = topic.producer(
+        mofka::BatchSize{g_batch_size},
+        mofka::ThreadPool{mofka::ThreadCount{concurrency}},
+        ordering);
+    std::vector<mofka::Future<mofka::EventID>> futures;
+    futures.reserve(g_num_events);
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < g_num_events; ++i) {
+        futures.push_back(producer.push(mofka::Metadata{"{\"x\":42}"}));
+    }
+    producer.flush();
+    for(auto& future : futures) future.wait();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    parse_command_line(argc, argv);
+    spdlog::set_level(spdlog::level::from_str(g_log_level));
+
+    auto server = bedrock::Server(g_protocol, g_config);
+    auto gid = server.getSSGManager().getGroup("mofka_group")->getHandle<uint64_t>();
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    try {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+
+        std::printf("%12s %16s %16s\n", "concurrency", "strict (ev/s)", "loose (ev/s)");
+        for(size_t c = 1; c <= g_max_concurrency; c *= 2) {
+            auto strict_topic = sh.createTopic(
+                "strict-" + std::to_string(c), mofka::TopicBackendConfig{});
+            auto loose_topic = sh.createTopic(
+                "loose-" + std::to_string(c), mofka::TopicBackendConfig{});
+            auto t_strict = run(strict_topic, mofka::Ordering::Strict, c);
+            auto t_loose  = run(loose_topic, mofka::Ordering::Loose, c);
+            std::printf("%12zu %16.0f %16.0f\n", c,
+                        g_num_events/t_strict, g_num_events/t_loose);
+        }
+    } catch(const mofka::Exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        server.finalize();
+        std::remove("mofka-benchmark.ssg");
+        return -1;
+    }
+
+    server.finalize();
+    std::remove("mofka-benchmark.ssg");
+    return 0;
+}
+
+void parse_command_line(int argc, char** argv) {
+    try {
+        TCLAP::CmdLine cmd("Mofka producer ordering benchmark", ' ', "0.1");
+        TCLAP::ValueArg<std::string> protocolArg(
+            "p", "protocol", "Protocol", false, "na+sm", "string");
+        TCLAP::ValueArg<size_t> numEventsArg(
+            "n", "num-events", "Number of events pushed per run", false, 100000, "int");
+        TCLAP::ValueArg<size_t> batchSizeArg(
+            "b", "batch-size", "Batch size of the producer", false, 128, "int");
+        TCLAP::ValueArg<size_t> concurrencyArg(
+            "c", "max-concurrency", "Maximum number of concurrent push ULTs", false, 64, "int");
+        TCLAP::ValueArg<std::string> logLevel(
+            "v", "verbose", "Log level (trace, debug, info, warning, error, critical, off)", false, "error", "string");
+        cmd.add(protocolArg);
+        cmd.add(numEventsArg);
+        cmd.add(batchSizeArg);
+        cmd.add(concurrencyArg);
+        cmd.add(logLevel);
+        cmd.parse(argc, argv);
+        g_protocol = protocolArg.getValue();
+        g_num_events = numEventsArg.getValue();
+        g_batch_size = batchSizeArg.getValue();
+        g_max_concurrency = concurrencyArg.getValue();
+        g_log_level = logLevel.getValue();
+    } catch(TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        exit(-1);
+    }
+}
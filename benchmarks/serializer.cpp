@@ -0,0 +1,140 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <mofka/Serializer.hpp>
+#include <mofka/Metadata.hpp>
+#include <mofka/BufferWrapperArchive.hpp>
+#include <spdlog/spdlog.h>
+#include <tclap/CmdLine.h>
+#include <spdlog/fmt/fmt.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+/* Compares the default Serializer, which transfers the JSON text of the
+ * metadata and lets consumers parse it, with the schema Serializer, which
+ * encodes the fields of a fixed schema in binary and decodes them directly
+ * into a rapidjson Document. Events are telemetry records that follow the
+ * schema. Serialization starts from a parsed Metadata, as for a producer
+ * that builds its metadata as a Document; deserialization includes the
+ * access to the Document, as for a consumer reading the fields. */
+
+static size_t      g_num_events = 100000;
+static size_t      g_iterations = 10;
+static std::string g_log_level = "error";
+
+static void parse_command_line(int argc, char** argv);
+
+static const char* g_schema = R"(
+{"__type__":"schema",
+ "fields":[{"name":"time","type":"double"},
+           {"name":"host","type":"string"},
+           {"name":"rank","type":"uint64"},
+           {"name":"step","type":"uint64"},
+           {"name":"cpu","type":"object",
+            "fields":[{"name":"load","type":"double"},
+                      {"name":"temperature","type":"double"}]},
+           {"name":"memory_used","type":"uint64"},
+           {"name":"status","type":"string"}]})";
+
+static std::vector<mofka::Metadata> make_events() {
+    std::vector<mofka::Metadata> events;
+    events.reserve(g_num_events);
+    for(size_t i = 0; i < g_num_events; ++i) {
+        mofka::Metadata metadata{fmt::format(
+            R"({{"time":{}.{},"host":"node{:04}","rank":{},"step":{},)"
+            R"("cpu":{{"load":0.{},"temperature":{}.5}},"memory_used":{},"status":"running"}})",
+            1700000000 + i, i % 1000, i % 512, i % 4096, i / 16,
+            i % 97, 40 + i % 30, 1024*1024*(i % 1000))};
+        metadata.json(); /* parse it, as if the producer had built a Document */
+        events.push_back(std::move(metadata));
+    }
+    return events;
+}
+
+struct Measurement {
+    double serialize_time   = 0;
+    double deserialize_time = 0;
+    size_t size             = 0;
+};
+
+static Measurement run(const mofka::Serializer& serializer,
+                       const std::vector<mofka::Metadata>& events) {
+    Measurement m;
+    std::vector<char> buffer;
+    for(size_t it = 0; it < g_iterations; ++it) {
+        buffer.clear();
+        auto t0 = std::chrono::steady_clock::now();
+        mofka::BufferWrapperOutputArchive output{buffer};
+        for(const auto& metadata : events)
+            serializer.serialize(output, metadata);
+        auto t1 = std::chrono::steady_clock::now();
+        mofka::BufferWrapperInputArchive input{std::string_view{buffer.data(), buffer.size()}};
+        size_t checksum = 0;
+        for(size_t i = 0; i < events.size(); ++i) {
+            mofka::Metadata metadata;
+            serializer.deserialize(input, metadata);
+            const auto& doc = static_cast<const mofka::Metadata&>(metadata).json();
+            checksum += doc["rank"].GetUint64();
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        if(checksum == 0) std::cerr << "unexpected checksum" << std::endl;
+        m.serialize_time   += std::chrono::duration<double>(t1 - t0).count();
+        m.deserialize_time += std::chrono::duration<double>(t2 - t1).count();
+        m.size = buffer.size();
+    }
+    return m;
+}
+
+int main(int argc, char** argv) {
+    parse_command_line(argc, argv);
+    spdlog::set_level(spdlog::level::from_str(g_log_level));
+
+    try {
+        auto events = make_events();
+        auto default_serializer = mofka::Serializer{};
+        auto schema_serializer = mofka::Serializer::FromMetadata(mofka::Metadata{g_schema});
+        auto d = run(default_serializer, events);
+        auto s = run(schema_serializer, events);
+        auto per_event_ns = [](double t) { return 1e9*t/(g_iterations*g_num_events); };
+        std::printf("%10s %16s %20s %22s\n",
+                    "serializer", "bytes/event", "serialize (ns/ev)", "deserialize (ns/ev)");
+        std::printf("%10s %16.1f %20.1f %22.1f\n", "default",
+                    double(d.size)/g_num_events,
+                    per_event_ns(d.serialize_time), per_event_ns(d.deserialize_time));
+        std::printf("%10s %16.1f %20.1f %22.1f\n", "schema",
+                    double(s.size)/g_num_events,
+                    per_event_ns(s.serialize_time), per_event_ns(s.deserialize_time));
+    } catch(const mofka::Exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+void parse_command_line(int argc, char** argv) {
+    try {
+        TCLAP::CmdLine cmd("Mofka metadata serializer benchmark", ' ', "0.1");
+        TCLAP::ValueArg<size_t> numEventsArg(
+            "n", "num-events", "Number of events serialized per iteration", false, 100000, "int");
+        TCLAP::ValueArg<size_t> iterationsArg(
+            "i", "iterations", "Number of iterations", false, 10, "int");
+        TCLAP::ValueArg<std::string> logLevel(
+            "v", "verbose", "Log level (trace, debug, info, warning, error, critical, off)", false, "error", "string");
+        cmd.add(numEventsArg);
+        cmd.add(iterationsArg);
+        cmd.add(logLevel);
+        cmd.parse(argc, argv);
+        g_num_events = numEventsArg.getValue();
+        g_iterations = iterationsArg.getValue();
+        g_log_level = logLevel.getValue();
+    } catch(TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        exit(-1);
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <thallium.hpp>
+#include <spdlog/spdlog.h>
+#include <tclap/CmdLine.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+/* Compares the two ways a Producer can expose the data of a batch made of
+ * many segments of the same size: registering every segment in a bulk
+ * handle created for the batch (zero-copy), or copying the segments into
+ * a contiguous buffer registered once (staging). Each iteration includes
+ * the preparation of the batch and the RDMA pull of its content, done in
+ * the same process. The segment size at which zero-copy starts winning is
+ * the crossover point to use as the StagingThreshold of a Producer. */
+
+static std::string g_protocol = "na+sm";
+static size_t      g_num_segments = 1024;
+static size_t      g_min_segment_size = 16;
+static size_t      g_max_segment_size = 1024*1024;
+static size_t      g_iterations = 100;
+static std::string g_log_level = "error";
+
+static void parse_command_line(int argc, char** argv);
+
+using Segments = std::vector<std::vector<char>>;
+
+static double run_zero_copy(thallium::engine& engine, Segments& segments,
+                            thallium::bulk& destination) {
+    auto self = engine.self();
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < g_iterations; ++i) {
+        std::vector<std::pair<void*, size_t>> exposed;
+        exposed.reserve(segments.size());
+        for(auto& seg : segments)
+            exposed.emplace_back(seg.data(), seg.size());
+        auto bulk = engine.expose(exposed, thallium::bulk_mode::read_only);
+        destination << bulk.on(self);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static double run_staging(thallium::engine& engine, Segments& segments,
+                          thallium::bulk& destination) {
+    auto self = engine.self();
+    std::vector<char> staging(segments.size()*segments[0].size());
+    auto bulk = engine.expose(
+        {{staging.data(), staging.size()}}, thallium::bulk_mode::read_only);
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < g_iterations; ++i) {
+        auto ptr = staging.data();
+        for(auto& seg : segments) {
+            std::memcpy(ptr, seg.data(), seg.size());
+            ptr += seg.size();
+        }
+        destination << bulk.on(self);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    parse_command_line(argc, argv);
+    spdlog::set_level(spdlog::level::from_str(g_log_level));
+
+    thallium::engine engine{g_protocol, THALLIUM_SERVER_MODE};
+
+    try {
+        std::printf("%14s %18s %18s %10s\n",
+                    "segment size", "zero-copy (us)", "staging (us)", "faster");
+        for(size_t size = g_min_segment_size; size <= g_max_segment_size; size *= 2) {
+            Segments segments(g_num_segments, std::vector<char>(size, 'a'));
+            std::vector<char> received(g_num_segments*size);
+            auto destination = engine.expose(
+                {{received.data(), received.size()}}, thallium::bulk_mode::write_only);
+            auto t_zero_copy = run_zero_copy(engine, segments, destination);
+            auto t_staging   = run_staging(engine, segments, destination);
+            std::printf("%14zu %18.1f %18.1f %10s\n", size,
+                        1e6*t_zero_copy/g_iterations, 1e6*t_staging/g_iterations,
+                        t_staging <= t_zero_copy ? "staging" : "zero-copy");
+        }
+    } catch(const thallium::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        engine.finalize();
+        return -1;
+    }
+
+    engine.finalize();
+    return 0;
+}
+
+void parse_command_line(int argc, char** argv) {
+    try {
+        TCLAP::CmdLine cmd("Mofka producer data staging benchmark", ' ', "0.1");
+        TCLAP::ValueArg<std::string> protocolArg(
+            "p", "protocol", "Protocol", false, "na+sm", "string");
+        TCLAP::ValueArg<size_t> numSegmentsArg(
+            "n", "num-segments", "Number of data segments per batch", false, 1024, "int");
+        TCLAP::ValueArg<size_t> minSizeArg(
+            "s", "min-size", "Smallest segment size", false, 16, "int");
+        TCLAP::ValueArg<size_t> maxSizeArg(
+            "S", "max-size", "Largest segment size", false, 1024*1024, "int");
+        TCLAP::ValueArg<size_t> iterationsArg(
+            "i", "iterations", "Number of batches transferred per measurement", false, 100, "int");
+        TCLAP::ValueArg<std::string> logLevel(
+            "v", "verbose", "Log level (trace, debug, info, warning, error, critical, off)", false, "error", "string");
+        cmd.add(protocolArg);
+        cmd.add(numSegmentsArg);
+        cmd.add(minSizeArg);
+        cmd.add(maxSizeArg);
+        cmd.add(iterationsArg);
+        cmd.add(logLevel);
+        cmd.parse(argc, argv);
+        g_protocol = protocolArg.getValue();
+        g_num_segments = numSegmentsArg.getValue();
+        g_min_segment_size = minSizeArg.getValue();
+        g_max_segment_size = maxSizeArg.getValue();
+        g_iterations = iterationsArg.getValue();
+        g_log_level = logLevel.getValue();
+    } catch(TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        exit(-1);
+    }
+}
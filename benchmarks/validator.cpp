@@ -0,0 +1,148 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <mofka/Validator.hpp>
+#include <mofka/Metadata.hpp>
+#include <mofka/Data.hpp>
+#include <spdlog/spdlog.h>
+#include <tclap/CmdLine.h>
+#include <spdlog/fmt/fmt.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Measures the throughput of Validators on a single core, in events/s,
+ * as seen by a producer: the metadata of each event is a freshly built
+ * string that has not been parsed yet. Compares the default Validator,
+ * which only checks that the string looks like JSON, with the json_schema
+ * Validator in "sax" mode (compiled schema, checked while parsing) and in
+ * "dom" mode (metadata parsed into a Document and validated by valijson).
+ * One event in every "invalid-every" violates the schema. */
+
+static size_t      g_num_events = 100000;
+static size_t      g_iterations = 10;
+static size_t      g_invalid_every = 0;
+static std::string g_log_level = "error";
+
+static void parse_command_line(int argc, char** argv);
+
+static const char* g_schema = R"(
+{"type":"object",
+ "properties":{"time":{"type":"number"},
+               "host":{"type":"string","maxLength":64},
+               "rank":{"type":"integer","minimum":0},
+               "step":{"type":"integer","minimum":0},
+               "cpu":{"type":"object",
+                      "properties":{"load":{"type":"number","minimum":0,"maximum":1},
+                                    "temperature":{"type":"number"}},
+                      "required":["load"]},
+               "memory_used":{"type":"integer"},
+               "status":{"enum":["running","stopped","failed"]}},
+ "required":["time","host","rank","step","status"],
+ "additionalProperties":false})";
+
+static std::vector<std::string> make_events() {
+    std::vector<std::string> events;
+    events.reserve(g_num_events);
+    for(size_t i = 0; i < g_num_events; ++i) {
+        bool invalid = g_invalid_every && (i % g_invalid_every == 0);
+        events.push_back(fmt::format(
+            R"({{"time":{}.{},"host":"node{:04}","rank":{},"step":{},)"
+            R"("cpu":{{"load":0.{},"temperature":{}.5}},"memory_used":{},"status":"{}"}})",
+            1700000000 + i, i % 1000, i % 512, i % 4096, i / 16,
+            i % 97, 40 + i % 30, 1024*1024*(i % 1000),
+            invalid ? "unknown" : "running"));
+    }
+    return events;
+}
+
+struct Measurement {
+    double time     = 0;
+    size_t rejected = 0;
+};
+
+static Measurement run(const mofka::Validator& validator,
+                       const std::vector<std::string>& events) {
+    Measurement m;
+    auto data = mofka::Data{};
+    for(size_t it = 0; it < g_iterations; ++it) {
+        /* new Metadata objects at each iteration, so that no parsing is cached */
+        std::vector<mofka::Metadata> metadata;
+        metadata.reserve(events.size());
+        for(const auto& e : events) metadata.emplace_back(e);
+        size_t rejected = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for(const auto& md : metadata) {
+            try {
+                validator.validate(md, data);
+            } catch(const mofka::InvalidMetadata&) {
+                rejected += 1;
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        m.time += std::chrono::duration<double>(t1 - t0).count();
+        m.rejected = rejected;
+    }
+    return m;
+}
+
+int main(int argc, char** argv) {
+    parse_command_line(argc, argv);
+    spdlog::set_level(spdlog::level::from_str(g_log_level));
+
+    try {
+        auto events = make_events();
+        auto make_validator = [](const char* mode) {
+            return mofka::Validator::FromMetadata(mofka::Metadata{fmt::format(
+                R"({{"__type__":"json_schema","mode":"{}","schema":{}}})", mode, g_schema)});
+        };
+        std::vector<std::pair<const char*, mofka::Validator>> validators = {
+            {"default", mofka::Validator{}},
+            {"sax", make_validator("sax")},
+            {"dom", make_validator("dom")}
+        };
+        std::printf("%10s %20s %16s %12s\n",
+                    "validator", "events/s per core", "ns/event", "rejected");
+        for(auto& [name, validator] : validators) {
+            auto m = run(validator, events);
+            auto total = double(g_iterations*g_num_events);
+            std::printf("%10s %20.0f %16.1f %12zu\n", name,
+                        total/m.time, 1e9*m.time/total, m.rejected);
+        }
+    } catch(const mofka::Exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+void parse_command_line(int argc, char** argv) {
+    try {
+        TCLAP::CmdLine cmd("Mofka metadata validator benchmark", ' ', "0.1");
+        TCLAP::ValueArg<size_t> numEventsArg(
+            "n", "num-events", "Number of events validated per iteration", false, 100000, "int");
+        TCLAP::ValueArg<size_t> iterationsArg(
+            "i", "iterations", "Number of iterations", false, 10, "int");
+        TCLAP::ValueArg<size_t> invalidEveryArg(
+            "x", "invalid-every", "Make one event in every N invalid (0 for none)", false, 0, "int");
+        TCLAP::ValueArg<std::string> logLevel(
+            "v", "verbose", "Log level (trace, debug, info, warning, error, critical, off)", false, "error", "string");
+        cmd.add(numEventsArg);
+        cmd.add(iterationsArg);
+        cmd.add(invalidEveryArg);
+        cmd.add(logLevel);
+        cmd.parse(argc, argv);
+        g_num_events = numEventsArg.getValue();
+        g_iterations = iterationsArg.getValue();
+        g_invalid_every = invalidEveryArg.getValue();
+        g_log_level = logLevel.getValue();
+    } catch(TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        exit(-1);
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_BACKPRESSURE_POLICY_HPP
+#define MOFKA_BACKPRESSURE_POLICY_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief What Producer::push does when accepting an event would make
+ * the Producer exceed its MaxPendingEvents or MaxPendingBytes.
+ *
+ * - Block: push blocks until enough pending events have completed.
+ *   Partially filled batches are sent right away so that they can.
+ * - Throw: push throws a BackpressureException.
+ * - Reject: push returns a future that has already completed and
+ *   whose wait() function throws a BackpressureException.
+ */
+enum class BackpressurePolicy : std::uint8_t {
+    Block  = 0,
+    Throw  = 1,
+    Reject = 2
+};
+
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_BATCHING_GOAL_HPP
+#define MOFKA_BATCHING_GOAL_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <chrono>
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Goal that a Producer created with BatchSize::Adaptive()
+ * tries to reach when deciding how many events to put in each batch.
+ *
+ * With a latency goal, the producer sizes its batches so that the time
+ * an event spends waiting for its batch to fill up, plus the round-trip
+ * time of the RPC sending the batch, stays within the budget.
+ *
+ * With a throughput goal, the producer sizes its batches so that
+ * (batch size / round-trip time) reaches the requested number of
+ * events per second.
+ */
+struct BatchingGoal {
+
+    enum class Kind : std::uint8_t {
+        Latency,
+        Throughput
+    };
+
+    Kind        kind;
+    std::size_t value; /* latency budget in microseconds, or events per second */
+
+    explicit constexpr BatchingGoal(Kind k, std::size_t val)
+    : kind(k), value(val) {}
+
+    /**
+     * @brief Create a goal of sending each event within the given latency budget.
+     */
+    static constexpr BatchingGoal Latency(std::chrono::microseconds budget) {
+        return BatchingGoal{Kind::Latency, static_cast<std::size_t>(budget.count())};
+    }
+
+    /**
+     * @brief Create a goal of sending the given number of events per second.
+     */
+    static constexpr BatchingGoal Throughput(std::size_t events_per_sec) {
+        return BatchingGoal{Kind::Throughput, events_per_sec};
+    }
+
+    /**
+     * @brief Goal used by default (latency budget of 1ms).
+     */
+    static constexpr BatchingGoal Default() {
+        return Latency(std::chrono::milliseconds{1});
+    }
+
+    inline bool operator==(const BatchingGoal& other) const {
+        return kind == other.kind && value == other.value;
+    }
+    inline bool operator!=(const BatchingGoal& other) const {
+        return !(*this == other);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_COMPRESSOR_HPP
+#define MOFKA_COMPRESSOR_HPP
+
+#include <mofka/ForwardDcl.hpp>
+#include <mofka/Metadata.hpp>
+#include <mofka/Data.hpp>
+#include <mofka/Factory.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief The CompressorInterface class provides an interface for
+ * compressing the metadata of whole batches of events, when they
+ * are transferred from producers to servers and from servers to
+ * consumers.
+ *
+ * A CompressorInterface must also provide functions to convert
+ * itself into a Metadata object an back, so that its internal
+ * configuration can be stored with the topic.
+ */
+class CompressorInterface {
+
+    public:
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~CompressorInterface() = default;
+
+    /**
+     * @brief Compress the content of the provided segments, taken
+     * as a single contiguous buffer, into the output vector, which
+     * is resized to the compressed size. The output must carry enough
+     * information for decompress to restore the original size.
+     * Errors whould be handled by throwing a mofka::Exception.
+     *
+     * @param segments Segments of memory to compress.
+     * @param output Vector receiving the compressed content.
+     */
+    virtual void compress(const std::vector<Data::Segment>& segments,
+                          std::vector<char>& output) const = 0;
+
+    /**
+     * @brief Decompress the provided buffer into the output vector,
+     * which is resized to the original size.
+     * Errors whould be handled by throwing a mofka::Exception.
+     *
+     * @param input Compressed content.
+     * @param size Size of the compressed content.
+     * @param output Vector receiving the decompressed content.
+     */
+    virtual void decompress(const char* input, size_t size,
+                            std::vector<char>& output) const = 0;
+
+    /**
+     * @brief Convert the underlying compressor implementation into a Metadata
+     * object that can be stored (e.g. the compression algorithm and level).
+     */
+    virtual Metadata metadata() const = 0;
+
+    /**
+     * @note A CompressorInterface class must also provide a static create
+     * function with the following prototype, instanciating a unique_ptr of
+     * the class from the provided Metadata:
+     *
+     * static std::unique_ptr<CompressorInterface> create(const Metadata&);
+     */
+};
+
+class Compressor {
+
+    public:
+
+    /**
+     * @brief Constructor. Will construct a valid Compressor that
+     * does not compress anything.
+     */
+    Compressor();
+
+    /**
+     * @brief Copy-constructor.
+     */
+    Compressor(const Compressor&);
+
+    /**
+     * @brief Move-constructor.
+     */
+    Compressor(Compressor&&);
+
+    /**
+     * @brief copy-assignment operator.
+     */
+    Compressor& operator=(const Compressor&);
+
+    /**
+     * @brief Move-assignment operator.
+     */
+    Compressor& operator=(Compressor&&);
+
+    /**
+     * @brief Destructor.
+     */
+    ~Compressor();
+
+    /**
+     * @brief Compress the content of the provided segments into the output.
+     *
+     * @param segments Segments of memory to compress.
+     * @param output Vector receiving the compressed content.
+     */
+    void compress(const std::vector<Data::Segment>& segments,
+                  std::vector<char>& output) const;
+
+    /**
+     * @brief Decompress the provided buffer into the output.
+     *
+     * @param input Compressed content.
+     * @param size Size of the compressed content.
+     * @param output Vector receiving the decompressed content.
+     */
+    void decompress(const char* input, size_t size,
+                    std::vector<char>& output) const;
+
+    /**
+     * @brief Convert the underlying compressor implementation
+     * into a Metadata object that can be stored.
+     */
+    Metadata metadata() const;
+
+    /**
+     * @brief Returns true if the Compressor leaves the content as is,
+     * in which case batches are transferred without any compression step.
+     */
+    bool isPassThrough() const;
+
+    /**
+     * @brief Factory function to create a Compressor instance
+     * when the underlying implementation is not known.
+     *
+     * @param metadata Metadata of the Compressor.
+     *
+     * @return Compressor instance.
+     */
+    static Compressor FromMetadata(const Metadata& metadata);
+
+    /**
+     * @brief Checks for the validity of the underlying pointer.
+     */
+    operator bool() const;
+
+    private:
+
+    std::shared_ptr<CompressorInterface> self;
+
+    Compressor(const std::shared_ptr<CompressorInterface>& impl);
+
+};
+
+using CompressorFactory = Factory<CompressorInterface, const Metadata&>;
+
+}
+
+
+#define MOFKA_REGISTER_COMPRESSOR(__name__, __type__) \
+    MOFKA_REGISTER_IMPLEMENTATION_FOR(CompressorFactory, __type__, __name__)
+
+#endif
@@ -19,6 +19,13 @@
 #include <mofka/EventProcessor.hpp>
 #include <mofka/BatchSize.hpp>
 #include <mofka/NumEvents.hpp>
+#include <mofka/MaxInFlightEvents.hpp>
+#include <mofka/MaxPendingEvents.hpp>
+#include <mofka/MaxPendingBytes.hpp>
+#include <mofka/MaxPrefetchBytes.hpp>
+#include <mofka/PrefetchDepth.hpp>
+#include <mofka/DataFetchMode.hpp>
+#include <mofka/Ordering.hpp>
 
 #include <thallium.hpp>
 #include <rapidjson/document.h>
@@ -98,6 +105,35 @@ class Consumer {
      */
     DataSelector dataSelector() const;
 
+    /**
+     * @brief Returns the number of events each partition may send
+     * to the Consumer ahead of the pull() calls.
+     */
+    MaxPendingEvents maxPendingEvents() const;
+
+    /**
+     * @brief Returns the size of the metadata each partition may
+     * send to the Consumer ahead of the pull() calls.
+     */
+    MaxPendingBytes maxPendingBytes() const;
+
+    /**
+     * @brief Returns the number of batches whose data
+     * the Consumer may fetch in the background.
+     */
+    PrefetchDepth prefetchDepth() const;
+
+    /**
+     * @brief Returns the maximum size of the data the Consumer
+     * may fetch ahead of the pull() calls.
+     */
+    MaxPrefetchBytes maxPrefetchBytes() const;
+
+    /**
+     * @brief Returns when the Consumer fetches the data of its events.
+     */
+    DataFetchMode dataFetchMode() const;
+
     /**
      * @brief Pull an Event. This function will immediately
      * return a Future<Event>. Calling wait() on the event will
@@ -109,16 +145,38 @@ class Consumer {
      * @brief Feed the Events pulled by the Consumer into the provided
      * EventProcessor function. The Consumer will stop feeding the processor
      * if it raises a StopEventProcessor exception, or after maxEvents events
-     * have been processed.
+     * have been pulled. The function returns once all the events given to
+     * the processor have been processed.
+     *
+     * Events are processed by ULTs of the provided ThreadPool, with at most
+     * maxInFlight of them pulled and not yet processed. The ordering can be:
+     * - Loose: events are processed concurrently;
+     * - PerPartition: events of a partition are processed one at a time,
+     *   in order, while different partitions are processed concurrently;
+     * - Strict: events are processed one at a time, in the order pulled.
+     *
+     * Events are acknowledged automatically: for each partition, once an
+     * event and all the events before it have been processed, the last of
+     * them is acknowledged. An event for which the processor raised
+     * StopEventProcessor counts as processed. If the processor raises any
+     * other exception, process stops pulling, waits for the events in
+     * flight, and rethrows the exception; the failed event and the events
+     * after it in its partition are not acknowledged.
      *
      * @note Calling process from multiple threads concurrently on the same
      * consumer is not allowed and will throw an exception.
      *
      * @param processor EventProcessor.
+     * @param threadPool ThreadPool in which to run the processor.
+     * @param maxEvents Maximum number of events to process.
+     * @param ordering Ordering in which events are processed.
+     * @param maxInFlight Maximum number of events being processed.
      */
     void process(EventProcessor processor,
                  ThreadPool threadPool = ThreadPool{},
-                 NumEvents maxEvents = NumEvents::Infinity()) const;
+                 NumEvents maxEvents = NumEvents::Infinity(),
+                 Ordering ordering = Ordering::Loose,
+                 MaxInFlightEvents maxInFlight = MaxInFlightEvents::Default()) const;
 
     /**
      * @brief This method is syntactic sugar to call process with
@@ -80,6 +80,18 @@ class ConsumerHandle {
               const BulkRef& data_desc_sizes,
               const BulkRef& data_desc);
 
+    /**
+     * @brief Takes the credits needed to feed the next events to the
+     * ConsumerHandle and returns the number of events that can be sent,
+     * between 0 and count. A TopicManager should call this function
+     * before feed() and wait for wakeUp() when it returns 0, since the
+     * consumer grants new credits as its application pulls events.
+     *
+     * @param metadata_sizes Sizes of the metadata of the next events.
+     * @param count Number of events available.
+     */
+    size_t takeCredits(const size_t* metadata_sizes, size_t count);
+
     /**
      * @brief Check if we should stop feeding the ConsumerHandle.
      */
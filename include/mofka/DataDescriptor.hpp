@@ -211,6 +211,7 @@ class DataDescriptor {
     std::shared_ptr<DataDescriptorImpl> self;
 
     friend class ConsumerImpl;
+    friend class Event;
     friend class BatchImpl;
     friend struct Cerealized<DataDescriptor>;
 };
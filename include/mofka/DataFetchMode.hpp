@@ -0,0 +1,33 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_DATA_FETCH_MODE_HPP
+#define MOFKA_DATA_FETCH_MODE_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief When a Consumer fetches the data of its events.
+ *
+ * - Eager: the DataSelector and DataBroker are called when the event
+ *   is received, and its data is fetched before the event is delivered.
+ * - Lazy: events are delivered with only their DataDescriptor. The
+ *   DataSelector (selecting all the data if not provided) and DataBroker
+ *   are called, and the data fetched, when the application calls
+ *   Event::fetchData() or Event::data(). Concurrent fetches from the
+ *   same partition are sent together.
+ */
+enum class DataFetchMode : std::uint8_t {
+    Eager = 0,
+    Lazy  = 1
+};
+
+}
+
+#endif
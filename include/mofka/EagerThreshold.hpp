@@ -0,0 +1,51 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_EAGER_THRESHOLD_HPP
+#define MOFKA_EAGER_THRESHOLD_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the size in bytes
+ * (serialized metadata and data combined) under which a Producer
+ * sends a batch inline, in the arguments of its RPC, instead of
+ * exposing it for the server to pull with RDMA.
+ *
+ * Sending a small batch inline saves the two RDMA transfers the
+ * server would otherwise issue. The threshold should stay below the
+ * size of the eager messages of the network, past which the RPC
+ * arguments are themselves transferred with RDMA.
+ */
+struct EagerThreshold {
+
+    std::size_t value;
+
+    explicit constexpr EagerThreshold(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Returns a value telling the producer to always
+     * expose its batches for RDMA.
+     */
+    static constexpr EagerThreshold Disabled() {
+        return EagerThreshold{0};
+    }
+
+    inline bool operator<(const EagerThreshold& other) const { return value < other.value; }
+    inline bool operator>(const EagerThreshold& other) const { return value > other.value; }
+    inline bool operator<=(const EagerThreshold& other) const { return value <= other.value; }
+    inline bool operator>=(const EagerThreshold& other) const { return value >= other.value; }
+    inline bool operator==(const EagerThreshold& other) const { return value == other.value; }
+    inline bool operator!=(const EagerThreshold& other) const { return value != other.value; }
+};
+
+}
+
+#endif
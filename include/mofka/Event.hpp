@@ -9,6 +9,8 @@
 #include <mofka/ForwardDcl.hpp>
 #include <mofka/Data.hpp>
 #include <mofka/Metadata.hpp>
+#include <mofka/DataDescriptor.hpp>
+#include <mofka/Future.hpp>
 #include <mofka/Exception.hpp>
 #include <mofka/TargetSelector.hpp>
 #include <mofka/EventID.hpp>
@@ -68,10 +70,27 @@ class Event {
     Metadata metadata() const;
 
     /**
-     * @brief Get event Event's Data.
+     * @brief Get event Event's Data. If the Consumer uses
+     * DataFetchMode::Lazy, this function fetches the data the
+     * first time it is called, blocking until it is available.
      */
     Data data() const;
 
+    /**
+     * @brief Get the DataDescriptor of the Event's Data,
+     * which describes the whole data stored in the partition.
+     */
+    DataDescriptor dataDescriptor() const;
+
+    /**
+     * @brief Returns a Future for the Event's Data. If the Consumer uses
+     * DataFetchMode::Lazy, the first call to fetchData (or data) runs the
+     * DataSelector and DataBroker and requests the data from the partition,
+     * and subsequent calls return the same Future. Otherwise the Future
+     * is already completed.
+     */
+    Future<Data> fetchData() const;
+
     /**
      * @brief Returns information about the partition
      * this Event originates from.
@@ -32,6 +32,18 @@ class Exception : public std::logic_error {
     : std::logic_error(w) {}
 };
 
+/**
+ * @brief Exception reported by Producer::push when the producer
+ * has reached its MaxPendingEvents or MaxPendingBytes and its
+ * BackpressurePolicy is Throw or Reject.
+ */
+class BackpressureException : public Exception {
+
+    public:
+
+    using Exception::Exception;
+};
+
 }
 
 #endif
@@ -9,21 +9,34 @@
 namespace mofka {
 
 class Archive;
+class BackpressureException;
 struct BatchSize;
+struct BatchingGoal;
 struct BufferWrapperOutputArchive;
 struct BufferWrapperInputArchive;
 struct BulkRef;
 template<typename T>
 struct Cerealized;
 class Client;
+class CompressorInterface;
+class Compressor;
 class Consumer;
 class ConsumerHandle;
 class Data;
 class DataDescriptor;
+struct EagerThreshold;
 class Event;
 struct StopEventProcessor;
 class Exception;
 template<typename ResultType, typename WaitFn, typename TestFn> class Future;
+struct Linger;
+struct MaxBatchBytes;
+struct MaxBatchRetries;
+struct MaxInFlightBatches;
+struct MaxInFlightEvents;
+struct MaxPendingBytes;
+struct MaxPendingEvents;
+struct MaxPrefetchBytes;
 class Metadata;
 struct NumEvents;
 class Producer;
@@ -35,7 +48,9 @@ class Serializer;
 class ServiceHandle;
 struct SSGFileName;
 struct SSGGroupID;
+struct StagingThreshold;
 class PartitionTargetInfo;
+struct PrefetchDepth;
 class TargetSelectorInterface;
 class TargetSelector;
 struct ThreadCount;
@@ -9,11 +9,88 @@
 #include <mofka/ForwardDcl.hpp>
 #include <mofka/Exception.hpp>
 
+#include <thallium.hpp>
+#include <atomic>
+#include <exception>
 #include <memory>
 #include <functional>
+#include <iterator>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
 namespace mofka {
 
+/**
+ * @brief Shared state of a Future, implemented by the objects
+ * that complete the operation.
+ */
+template<typename ResultType>
+class FutureState {
+
+    public:
+
+    /**
+     * @brief Result of a completed operation: its value, or the exception
+     * it failed with, kept as an exception_ptr to preserve its type
+     * (e.g. BackpressureException).
+     */
+    using Outcome = std::variant<ResultType, std::exception_ptr>;
+
+    /**
+     * @brief Identifies a callback registered with subscribe, so that
+     * it can be removed with unsubscribe. NoSubscription is returned
+     * when the callback has been invoked immediately.
+     */
+    using Subscription = std::size_t;
+    static constexpr Subscription NoSubscription = 0;
+
+    virtual ~FutureState() = default;
+
+    /**
+     * @brief Blocks until completion, then returns the result
+     * or throws the exception of the operation.
+     */
+    virtual ResultType wait() = 0;
+
+    /**
+     * @brief Tests for completion without blocking.
+     */
+    virtual bool completed() = 0;
+
+    /**
+     * @brief Registers a callback to be invoked with the Outcome of the
+     * operation as soon as it completes (immediately if it has already
+     * completed).
+     */
+    virtual Subscription subscribe(std::function<void(const Outcome&)> callback) = 0;
+
+    /**
+     * @brief Removes a callback registered with subscribe, if it has not
+     * been invoked yet. Does nothing by default, in which case the
+     * callback is simply invoked on completion.
+     */
+    virtual void unsubscribe(Subscription subscription) { (void)subscription; }
+
+    /**
+     * @brief Submits work to the ThreadPool of the object that created
+     * the future. Runs it in the caller by default.
+     */
+    virtual void execute(std::function<void()> fn) { fn(); }
+
+    /**
+     * @brief Called by Future::wait before blocking, e.g. to flush
+     * the Producer.
+     */
+    virtual void onWait() {}
+
+    /**
+     * @brief Identifies the object onWait acts upon, so that waitAll
+     * and waitAny call onWait only once per object.
+     */
+    virtual const void* onWaitKey() const { return nullptr; }
+};
+
 /**
  * @brief Future objects are used to keep track of
  * on-going asynchronous operations.
@@ -25,6 +102,34 @@ class Future {
 
     public:
 
+    /**
+     * @brief Result of a completed operation.
+     */
+    using Outcome = typename FutureState<ResultType>::Outcome;
+
+    /**
+     * @brief Identifier of a callback registered with a SubscribeFn.
+     */
+    using Subscription = typename FutureState<ResultType>::Subscription;
+
+    /**
+     * @brief Function registering a callback to be invoked with the
+     * Outcome of the operation as soon as it completes (immediately
+     * if it has already completed, returning NoSubscription).
+     */
+    using SubscribeFn = std::function<Subscription(std::function<void(const Outcome&)>)>;
+
+    /**
+     * @brief Function removing a callback registered with a SubscribeFn.
+     */
+    using UnsubscribeFn = std::function<void(Subscription)>;
+
+    /**
+     * @brief Function submitting work to the ThreadPool of the object
+     * that created the future.
+     */
+    using ExecuteFn = std::function<void(std::function<void()>)>;
+
     /**
      * @brief Default constructor. Will create a non-valid Future.
      */
@@ -59,36 +164,266 @@ class Future {
      * @brief Wait for the request to complete.
      */
     ResultType wait() const {
-        if(!m_wait)
+        if(!m_state)
             throw Exception("Calling Future::wait on an invalid future");
-        return m_wait();
+        if(!m_state->completed()) m_state->onWait();
+        return m_state->wait();
     }
 
     /**
      * @brief Test if the request has completed, without blocking.
      */
     bool completed() const {
-        if(!m_completed)
+        if(!m_state)
             throw Exception("Calling Future::completed on an invalid future");
-        return m_completed();
+        return m_state->completed();
+    }
+
+    /**
+     * @brief Registers callbacks to invoke when the request completes:
+     * on_success with its result, or on_error with the exception it
+     * failed with. The callbacks run on the ThreadPool of the object
+     * that created the future (e.g. the Producer), or immediately in
+     * the caller if the request has already completed.
+     *
+     * Contrary to wait(), then() does not trigger a flush of the
+     * Producer: the request completes when its batch is sent.
+     */
+    void then(std::function<void(ResultType)> on_success,
+              std::function<void(const Exception&)> on_error = {}) const {
+        if(!m_state)
+            throw Exception("Calling Future::then on an invalid future");
+        auto state = m_state;
+        auto already_completed = m_state->completed();
+        m_state->subscribe(
+            [state=already_completed ? nullptr : std::move(state),
+             on_success=std::move(on_success),
+             on_error=std::move(on_error)](const Outcome& outcome) {
+                auto fn = [outcome, on_success, on_error]() {
+                    if(std::holds_alternative<std::exception_ptr>(outcome)) {
+                        if(!on_error) return;
+                        try {
+                            std::rethrow_exception(std::get<std::exception_ptr>(outcome));
+                        } catch(const Exception& ex) {
+                            on_error(ex);
+                        } catch(const std::exception& ex) {
+                            on_error(Exception{ex.what()});
+                        }
+                    } else if(on_success) {
+                        on_success(std::get<ResultType>(outcome));
+                    }
+                };
+                if(state) state->execute(std::move(fn));
+                else fn();
+            });
     }
 
     /**
      * @brief Constructor meant for classes that actually know what the
      * internals of the future are.
+     *
+     * @param state Shared state of the future.
+     */
+    explicit Future(std::shared_ptr<FutureState<ResultType>> state)
+    : m_state(std::move(state)) {}
+
+    /**
+     * @brief Constructor meant for classes that actually know what the
+     * internals of the future are.
+     *
+     * @param wait_fn Function blocking until completion.
+     * @param completed_fn Function testing for completion.
+     * @param subscribe_fn Function registering completion callbacks.
+     * @param execute_fn Function submitting work to a ThreadPool
+     * (callbacks of then() run in the completing ULT if empty).
+     * @param on_wait Function to call before blocking in wait(),
+     * e.g. to flush the Producer.
+     * @param on_wait_key Identifies the object on_wait acts upon, so that
+     * waitAll and waitAny call on_wait only once per object.
+     * @param unsubscribe_fn Function removing a registered callback
+     * (waitAny leaves its callbacks registered if empty).
      */
     Future(WaitFn wait_fn,
-           TestFn completed_fn)
-    : m_wait(std::move(wait_fn))
-    , m_completed(std::move(completed_fn)) {}
+           TestFn completed_fn,
+           SubscribeFn subscribe_fn = SubscribeFn{},
+           ExecuteFn execute_fn = ExecuteFn{},
+           std::function<void()> on_wait = std::function<void()>{},
+           const void* on_wait_key = nullptr,
+           UnsubscribeFn unsubscribe_fn = UnsubscribeFn{})
+    : m_state(std::make_shared<FunctionState>(
+            std::move(wait_fn), std::move(completed_fn),
+            std::move(subscribe_fn), std::move(execute_fn),
+            std::move(on_wait), on_wait_key,
+            std::move(unsubscribe_fn))) {}
+
+    template<typename Range>
+    friend void waitAll(const Range& futures);
+
+    template<typename Range>
+    friend size_t waitAny(const Range& futures);
 
     private:
 
-    WaitFn m_wait;
-    TestFn m_completed;
+    /**
+     * @brief FutureState implemented by a set of functions.
+     */
+    class FunctionState : public FutureState<ResultType> {
+
+        public:
+
+        FunctionState(WaitFn wait_fn,
+                      TestFn completed_fn,
+                      SubscribeFn subscribe_fn,
+                      ExecuteFn execute_fn,
+                      std::function<void()> on_wait,
+                      const void* on_wait_key,
+                      UnsubscribeFn unsubscribe_fn)
+        : m_wait(std::move(wait_fn))
+        , m_completed(std::move(completed_fn))
+        , m_subscribe(std::move(subscribe_fn))
+        , m_unsubscribe(std::move(unsubscribe_fn))
+        , m_execute(std::move(execute_fn))
+        , m_on_wait(std::move(on_wait))
+        , m_on_wait_key(on_wait_key) {}
+
+        ResultType wait() override {
+            return m_wait();
+        }
+
+        bool completed() override {
+            return m_completed();
+        }
+
+        Subscription subscribe(std::function<void(const Outcome&)> callback) override {
+            if(!m_subscribe)
+                throw Exception("Future::then is not supported by this future");
+            return m_subscribe(std::move(callback));
+        }
+
+        void unsubscribe(Subscription subscription) override {
+            if(m_unsubscribe) m_unsubscribe(subscription);
+        }
+
+        void execute(std::function<void()> fn) override {
+            if(m_execute) m_execute(std::move(fn));
+            else fn();
+        }
+
+        void onWait() override {
+            if(m_on_wait) m_on_wait();
+        }
+
+        const void* onWaitKey() const override {
+            return m_on_wait_key;
+        }
+
+        private:
+
+        WaitFn                m_wait;
+        TestFn                m_completed;
+        SubscribeFn           m_subscribe;
+        UnsubscribeFn         m_unsubscribe;
+        ExecuteFn             m_execute;
+        std::function<void()> m_on_wait;
+        const void*           m_on_wait_key = nullptr;
+    };
+
+    std::shared_ptr<FutureState<ResultType>> m_state;
+
+    /**
+     * @brief Calls onWait on the states of the futures of the range
+     * that have not completed, once for each onWaitKey.
+     */
+    template<typename Range>
+    static void CallOnWaitOnce(const Range& futures) {
+        std::vector<const void*> keys;
+        for(const auto& future : futures) {
+            if(future.m_state->completed()) continue;
+            auto key = future.m_state->onWaitKey();
+            if(key) {
+                bool seen = false;
+                for(auto k : keys) seen = seen || (k == key);
+                if(seen) continue;
+                keys.push_back(key);
+            }
+            future.m_state->onWait();
+        }
+    }
 
 };
 
+/**
+ * @brief Blocks until all the futures of the range have completed,
+ * flushing each Producer involved at most once. Failures are not
+ * reported: calling wait() on a future afterwards returns its result
+ * or throws its exception without blocking or flushing.
+ *
+ * @param futures Range (e.g. std::vector) of valid futures.
+ */
+template<typename Range>
+void waitAll(const Range& futures) {
+    for(const auto& future : futures) {
+        if(!future.m_state)
+            throw Exception("Calling waitAll on an invalid future");
+    }
+    using FutureType = std::decay_t<decltype(*std::begin(futures))>;
+    FutureType::CallOnWaitOnce(futures);
+    for(const auto& future : futures) {
+        try {
+            future.m_state->wait();
+        } catch(const Exception&) {}
+    }
+}
+
+/**
+ * @brief Blocks until at least one of the futures of the range has
+ * completed, flushing each Producer involved at most once, and returns
+ * the index of a completed future in the range. The callbacks waitAny
+ * registers on the other futures are removed before it returns, so
+ * calling it repeatedly on a shrinking range does not accumulate them.
+ *
+ * @param futures Non-empty range (e.g. std::vector) of valid futures.
+ */
+template<typename Range>
+size_t waitAny(const Range& futures) {
+    using FutureType = std::decay_t<decltype(*std::begin(futures))>;
+    using Outcome = typename FutureType::Outcome;
+    size_t index = 0;
+    for(const auto& future : futures) {
+        if(!future.m_state)
+            throw Exception("Calling waitAny on an invalid future");
+        if(future.m_state->completed()) return index;
+        ++index;
+    }
+    if(index == 0)
+        throw Exception("Calling waitAny on an empty range of futures");
+    FutureType::CallOnWaitOnce(futures);
+    struct FirstCompleted {
+        std::atomic<bool>          found = false;
+        thallium::eventual<size_t> index;
+    };
+    auto first = std::make_shared<FirstCompleted>();
+    using Subscription = typename FutureType::Subscription;
+    std::vector<Subscription> subscriptions;
+    index = 0;
+    for(const auto& future : futures) {
+        subscriptions.push_back(future.m_state->subscribe([first, index](const Outcome&) {
+            if(!first->found.exchange(true))
+                first->index.set_value(index);
+        }));
+        ++index;
+        if(first->found) break;
+    }
+    auto result = first->index.wait();
+    index = 0;
+    for(const auto& future : futures) {
+        if(index == subscriptions.size()) break;
+        future.m_state->unsubscribe(subscriptions[index]);
+        ++index;
+    }
+    return result;
+}
+
 }
 
 #endif
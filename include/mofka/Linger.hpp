@@ -0,0 +1,44 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_LINGER_HPP
+#define MOFKA_LINGER_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <chrono>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped duration meant to store the maximum amount of
+ * time a partially filled batch may wait for more events in a Producer
+ * before being sent, even if nobody calls Producer::flush() or waits
+ * on one of its futures.
+ */
+struct Linger {
+
+    std::chrono::microseconds value;
+
+    explicit constexpr Linger(std::chrono::microseconds val)
+    : value(val) {}
+
+    /**
+     * @brief Returns a value telling the producer to keep partially
+     * filled batches until they are full or explicitly flushed.
+     */
+    static Linger Infinite();
+
+    inline bool operator<(const Linger& other) const { return value < other.value; }
+    inline bool operator>(const Linger& other) const { return value > other.value; }
+    inline bool operator<=(const Linger& other) const { return value <= other.value; }
+    inline bool operator>=(const Linger& other) const { return value >= other.value; }
+    inline bool operator==(const Linger& other) const { return value == other.value; }
+    inline bool operator!=(const Linger& other) const { return value != other.value; }
+};
+
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MAX_BATCH_BYTES_HPP
+#define MOFKA_MAX_BATCH_BYTES_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the maximum number
+ * of bytes (serialized metadata and data combined) a Producer may
+ * put in a single batch. A batch always contains at least one event,
+ * even if this event alone exceeds the limit.
+ */
+struct MaxBatchBytes {
+
+    std::size_t value;
+
+    explicit constexpr MaxBatchBytes(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Returns a value telling the producer not to bound
+     * its batches by size in bytes.
+     */
+    static MaxBatchBytes Unlimited();
+
+    inline bool operator<(const MaxBatchBytes& other) const { return value < other.value; }
+    inline bool operator>(const MaxBatchBytes& other) const { return value > other.value; }
+    inline bool operator<=(const MaxBatchBytes& other) const { return value <= other.value; }
+    inline bool operator>=(const MaxBatchBytes& other) const { return value >= other.value; }
+    inline bool operator==(const MaxBatchBytes& other) const { return value == other.value; }
+    inline bool operator!=(const MaxBatchBytes& other) const { return value != other.value; }
+};
+
+}
+
+#endif
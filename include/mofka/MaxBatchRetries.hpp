@@ -0,0 +1,58 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MAX_BATCH_RETRIES_HPP
+#define MOFKA_MAX_BATCH_RETRIES_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the number of times
+ * a Producer sends a batch again when its RPC fails (e.g. because of
+ * a network error), waiting exponentially longer between attempts.
+ * Servers recognize batches they already appended, so a batch sent
+ * again does not create duplicate events. Errors reported by the
+ * server (e.g. invalid metadata) are not retried.
+ *
+ * A batch sent again is appended after the batches that were sent
+ * while it was being retried. This can only happen with
+ * MaxInFlightBatches greater than 1, hence with Ordering::Loose.
+ */
+struct MaxBatchRetries {
+
+    std::size_t value;
+
+    explicit constexpr MaxBatchRetries(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Default number of retries.
+     */
+    static constexpr MaxBatchRetries Default() {
+        return MaxBatchRetries{3};
+    }
+
+    /**
+     * @brief Fail batches at the first error.
+     */
+    static constexpr MaxBatchRetries None() {
+        return MaxBatchRetries{0};
+    }
+
+    inline bool operator<(const MaxBatchRetries& other) const { return value < other.value; }
+    inline bool operator>(const MaxBatchRetries& other) const { return value > other.value; }
+    inline bool operator<=(const MaxBatchRetries& other) const { return value <= other.value; }
+    inline bool operator>=(const MaxBatchRetries& other) const { return value >= other.value; }
+    inline bool operator==(const MaxBatchRetries& other) const { return value == other.value; }
+    inline bool operator!=(const MaxBatchRetries& other) const { return value != other.value; }
+};
+
+}
+
+#endif
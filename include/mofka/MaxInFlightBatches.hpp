@@ -0,0 +1,52 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MAX_IN_FLIGHT_BATCHES_HPP
+#define MOFKA_MAX_IN_FLIGHT_BATCHES_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the number of batches
+ * a Producer may have in flight (sent but not yet acknowledged) towards
+ * each partition target.
+ *
+ * With a value greater than 1, the next batch is sent while previous
+ * ones are still travelling, which hides the network round-trip time.
+ * Futures still complete in the order events were pushed. Note however
+ * that the server assigns EventIDs in the order it receives batches,
+ * and the network does not guarantee that concurrent RPCs arrive in
+ * the order they were issued, which is why a value greater than 1
+ * is only accepted with Ordering::Loose.
+ */
+struct MaxInFlightBatches {
+
+    std::size_t value;
+
+    explicit constexpr MaxInFlightBatches(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Default window: a single batch in flight per target.
+     */
+    static constexpr MaxInFlightBatches Default() {
+        return MaxInFlightBatches{1};
+    }
+
+    inline bool operator<(const MaxInFlightBatches& other) const { return value < other.value; }
+    inline bool operator>(const MaxInFlightBatches& other) const { return value > other.value; }
+    inline bool operator<=(const MaxInFlightBatches& other) const { return value <= other.value; }
+    inline bool operator>=(const MaxInFlightBatches& other) const { return value >= other.value; }
+    inline bool operator==(const MaxInFlightBatches& other) const { return value == other.value; }
+    inline bool operator!=(const MaxInFlightBatches& other) const { return value != other.value; }
+};
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MAX_IN_FLIGHT_EVENTS_HPP
+#define MOFKA_MAX_IN_FLIGHT_EVENTS_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the number of events
+ * Consumer::process may have in flight, from the moment they are pulled
+ * to the moment the EventProcessor returns. When this limit is reached,
+ * process stops pulling events until some of them complete.
+ */
+struct MaxInFlightEvents {
+
+    std::size_t value;
+
+    explicit constexpr MaxInFlightEvents(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Default limit.
+     */
+    static constexpr MaxInFlightEvents Default() {
+        return MaxInFlightEvents{64};
+    }
+
+    inline bool operator<(const MaxInFlightEvents& other) const { return value < other.value; }
+    inline bool operator>(const MaxInFlightEvents& other) const { return value > other.value; }
+    inline bool operator<=(const MaxInFlightEvents& other) const { return value <= other.value; }
+    inline bool operator>=(const MaxInFlightEvents& other) const { return value >= other.value; }
+    inline bool operator==(const MaxInFlightEvents& other) const { return value == other.value; }
+    inline bool operator!=(const MaxInFlightEvents& other) const { return value != other.value; }
+};
+
+}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MAX_PENDING_BYTES_HPP
+#define MOFKA_MAX_PENDING_BYTES_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store a maximum number of
+ * bytes of the events in flight, used by both sides of a topic:
+ *
+ * - Producer: the size (metadata string and data combined) of the
+ *   events the Producer may hold, from the moment they are pushed to
+ *   the moment their future completes. When this limit is reached, the
+ *   Producer applies its BackpressurePolicy.
+ *
+ * - Consumer: the size of the serialized metadata (the data is not
+ *   counted) that each partition may send to the Consumer ahead of the
+ *   pull() calls of the application, in addition to MaxPendingEvents.
+ *
+ * In both cases an event is always accepted when nothing is pending,
+ * even if this event alone exceeds the limit. Both default to
+ * Unlimited(), and a Consumer requires a value of at least 1.
+ */
+struct MaxPendingBytes {
+
+    std::size_t value;
+
+    explicit constexpr MaxPendingBytes(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Returns a value telling the Producer not to bound its
+     * number of pending bytes, or the Consumer not to limit the size
+     * of the metadata its partitions send ahead of pull().
+     */
+    static MaxPendingBytes Unlimited();
+
+    inline bool operator<(const MaxPendingBytes& other) const { return value < other.value; }
+    inline bool operator>(const MaxPendingBytes& other) const { return value > other.value; }
+    inline bool operator<=(const MaxPendingBytes& other) const { return value <= other.value; }
+    inline bool operator>=(const MaxPendingBytes& other) const { return value >= other.value; }
+    inline bool operator==(const MaxPendingBytes& other) const { return value == other.value; }
+    inline bool operator!=(const MaxPendingBytes& other) const { return value != other.value; }
+};
+
+}
+
+#endif
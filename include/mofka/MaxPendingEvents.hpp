@@ -0,0 +1,62 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MAX_PENDING_EVENTS_HPP
+#define MOFKA_MAX_PENDING_EVENTS_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store a maximum number of
+ * events in flight, used by both sides of a topic:
+ *
+ * - Producer: the number of events the Producer may hold, from the
+ *   moment they are pushed to the moment their future completes. When
+ *   this limit is reached, the Producer applies its BackpressurePolicy.
+ *   Defaults to Unlimited().
+ *
+ * - Consumer: the credit window of the Consumer for each partition,
+ *   i.e. the number of events a partition may send to the Consumer
+ *   ahead of the pull() calls of the application. The partition stops
+ *   sending events when the window is full and resumes as the
+ *   application pulls. Defaults to ConsumerDefault().
+ *
+ * In both cases the value must be at least 1.
+ */
+struct MaxPendingEvents {
+
+    std::size_t value;
+
+    explicit constexpr MaxPendingEvents(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Returns a value telling the Producer not to bound its
+     * number of pending events, or the Consumer not to limit the
+     * number of events its partitions send ahead of pull().
+     */
+    static MaxPendingEvents Unlimited();
+
+    /**
+     * @brief Returns the default credit window of a Consumer
+     * (1024 events per partition).
+     */
+    static MaxPendingEvents ConsumerDefault();
+
+    inline bool operator<(const MaxPendingEvents& other) const { return value < other.value; }
+    inline bool operator>(const MaxPendingEvents& other) const { return value > other.value; }
+    inline bool operator<=(const MaxPendingEvents& other) const { return value <= other.value; }
+    inline bool operator>=(const MaxPendingEvents& other) const { return value >= other.value; }
+    inline bool operator==(const MaxPendingEvents& other) const { return value == other.value; }
+    inline bool operator!=(const MaxPendingEvents& other) const { return value != other.value; }
+};
+
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MAX_PREFETCH_BYTES_HPP
+#define MOFKA_MAX_PREFETCH_BYTES_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the maximum size of the
+ * data a Consumer may fetch ahead of the pull() calls of the application,
+ * in the buffers provided by its DataBroker. When this limit is reached,
+ * the Consumer keeps receiving the metadata of the batches (within its
+ * MaxPendingEvents and MaxPendingBytes) but defers fetching their data
+ * until the application pulls some of the events.
+ */
+struct MaxPrefetchBytes {
+
+    std::size_t value;
+
+    explicit constexpr MaxPrefetchBytes(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Returns a value telling the consumer not to bound
+     * the size of the data it prefetches.
+     */
+    static MaxPrefetchBytes Unlimited();
+
+    inline bool operator<(const MaxPrefetchBytes& other) const { return value < other.value; }
+    inline bool operator>(const MaxPrefetchBytes& other) const { return value > other.value; }
+    inline bool operator<=(const MaxPrefetchBytes& other) const { return value <= other.value; }
+    inline bool operator>=(const MaxPrefetchBytes& other) const { return value >= other.value; }
+    inline bool operator==(const MaxPrefetchBytes& other) const { return value == other.value; }
+    inline bool operator!=(const MaxPrefetchBytes& other) const { return value != other.value; }
+};
+
+}
+
+#endif
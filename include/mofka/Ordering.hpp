@@ -8,11 +8,29 @@
 
 #include <mofka/ForwardDcl.hpp>
 
+#include <cstdint>
+
 namespace mofka {
 
-enum class Ordering : bool {
-    Strict = true,
-    Loose  = false
+/**
+ * @brief Ordering guarantees of a Producer.
+ *
+ * - Strict: events are added to the topic in the order they were pushed,
+ *   across all the partitions.
+ * - PerPartition: events that go to the same partition are added in the
+ *   order they were pushed, but pushes to different partitions proceed
+ *   in parallel. The partition is selected when Producer::push is called.
+ * - Loose: no ordering guarantee.
+ *
+ * Strict and PerPartition rely on a partition receiving batches in the
+ * order they were sent, hence they require a single batch in flight per
+ * target: TopicHandle::makeProducer rejects them when MaxInFlightBatches
+ * is greater than 1.
+ */
+enum class Ordering : std::uint8_t {
+    Loose        = 0,
+    Strict       = 1,
+    PerPartition = 2
 };
 
 }
@@ -0,0 +1,46 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_PREFETCH_DEPTH_HPP
+#define MOFKA_PREFETCH_DEPTH_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the number of batches
+ * of events whose data a Consumer may fetch in the background, while
+ * the partitions keep sending it the next batches and the application
+ * processes the previous events. With a depth of 0, the data of a batch
+ * is fetched before the partition can send the next batch.
+ */
+struct PrefetchDepth {
+
+    std::size_t value;
+
+    explicit constexpr PrefetchDepth(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Default depth.
+     */
+    static constexpr PrefetchDepth Default() {
+        return PrefetchDepth{1};
+    }
+
+    inline bool operator<(const PrefetchDepth& other) const { return value < other.value; }
+    inline bool operator>(const PrefetchDepth& other) const { return value > other.value; }
+    inline bool operator<=(const PrefetchDepth& other) const { return value <= other.value; }
+    inline bool operator>=(const PrefetchDepth& other) const { return value >= other.value; }
+    inline bool operator==(const PrefetchDepth& other) const { return value == other.value; }
+    inline bool operator!=(const PrefetchDepth& other) const { return value != other.value; }
+};
+
+}
+
+#endif
@@ -15,10 +15,22 @@
 #include <mofka/Future.hpp>
 #include <mofka/ThreadPool.hpp>
 #include <mofka/BatchSize.hpp>
+#include <mofka/BatchingGoal.hpp>
+#include <mofka/MaxBatchBytes.hpp>
+#include <mofka/Linger.hpp>
+#include <mofka/MaxInFlightBatches.hpp>
+#include <mofka/EagerThreshold.hpp>
+#include <mofka/StagingThreshold.hpp>
+#include <mofka/MaxPendingEvents.hpp>
+#include <mofka/MaxPendingBytes.hpp>
+#include <mofka/BackpressurePolicy.hpp>
+#include <mofka/MaxBatchRetries.hpp>
+#include <mofka/TargetSelector.hpp>
 
 #include <thallium.hpp>
 #include <rapidjson/document.h>
 #include <memory>
+#include <vector>
 
 namespace mofka {
 
@@ -76,6 +88,95 @@ class Producer {
      */
     BatchSize batchSize() const;
 
+    /**
+     * @brief Returns the goal the producer tries to reach when
+     * its batch size is BatchSize::Adaptive().
+     */
+    BatchingGoal batchingGoal() const;
+
+    /**
+     * @brief Returns the maximum number of bytes of a batch.
+     */
+    MaxBatchBytes maxBatchBytes() const;
+
+    /**
+     * @brief Returns the maximum amount of time a partially
+     * filled batch waits before being sent.
+     */
+    Linger linger() const;
+
+    /**
+     * @brief Returns the maximum number of batches the producer
+     * may have in flight towards each target.
+     */
+    MaxInFlightBatches maxInFlightBatches() const;
+
+    /**
+     * @brief Returns the size under which the producer
+     * sends its batches inline instead of using RDMA.
+     */
+    EagerThreshold eagerThreshold() const;
+
+    /**
+     * @brief Returns the size up to which the producer copies
+     * the segments of its data instead of exposing them zero-copy.
+     */
+    StagingThreshold stagingThreshold() const;
+
+    /**
+     * @brief Returns the maximum number of events the producer
+     * may hold before applying its BackpressurePolicy.
+     */
+    MaxPendingEvents maxPendingEvents() const;
+
+    /**
+     * @brief Returns the maximum size of the events the producer
+     * may hold before applying its BackpressurePolicy.
+     */
+    MaxPendingBytes maxPendingBytes() const;
+
+    /**
+     * @brief Returns what push does when the producer
+     * has reached its limits.
+     */
+    BackpressurePolicy backpressurePolicy() const;
+
+    /**
+     * @brief Returns the number of times the producer sends
+     * a batch again when its RPC fails.
+     */
+    MaxBatchRetries maxBatchRetries() const;
+
+    /**
+     * @brief Returns the number of events pushed whose future has
+     * not completed yet. Only counted if the producer has a limit.
+     */
+    size_t pendingEvents() const;
+
+    /**
+     * @brief Returns the size of the events pushed whose future has
+     * not completed yet. Only counted if the producer has a byte limit.
+     */
+    size_t pendingBytes() const;
+
+    /**
+     * @brief Returns the number of events refused by push because the
+     * producer had reached its limits, with BackpressurePolicy::Throw
+     * or BackpressurePolicy::Reject.
+     */
+    size_t numRejectedEvents() const;
+
+    /**
+     * @brief Returns the number of events the producer currently
+     * puts in the batches it sends to the specified target. With a
+     * fixed batch size, this is simply the value of the BatchSize.
+     * With BatchSize::Adaptive(), this is the size chosen by the
+     * controller to meet the BatchingGoal.
+     *
+     * @param target Partition target.
+     */
+    size_t effectiveBatchSize(const PartitionTargetInfo& target) const;
+
     /**
      * @brief Returns the ThreadPool associated with the Producer.
      */
@@ -95,6 +196,11 @@ class Producer {
      * @brief Pushes an event into the producer's underlying topic,
      * returning a Future that can be awaited.
      *
+     * If the producer has reached its MaxPendingEvents or MaxPendingBytes,
+     * this function blocks, throws a BackpressureException, or returns a
+     * Future whose wait() function throws a BackpressureException,
+     * depending on its BackpressurePolicy.
+     *
      * @param metadata Metadata of the event.
      * @param data Optional data to attach to the event.
      *
@@ -102,6 +208,23 @@ class Producer {
      */
     Future<EventID> push(Metadata metadata, Data data = Data{}) const;
 
+    /**
+     * @brief Pushes a group of events into the producer's underlying
+     * topic. The events are validated, dispatched, and serialized by
+     * a single ULT, in the order of the vector, which is cheaper than
+     * calling push() for each event. The events are counted against the
+     * limits of the producer as a group, and refused as a group.
+     *
+     * @param metadata Metadata of the events.
+     * @param data Data of the events. May be empty if the events don't
+     * have data, otherwise must have the same size as metadata.
+     *
+     * @return a Future<EventID> for each event.
+     */
+    std::vector<Future<EventID>> push(
+        std::vector<Metadata> metadata,
+        std::vector<Data> data = std::vector<Data>{}) const;
+
     /**
      * @brief Block until all the pending events have been sent.
      */
@@ -10,6 +10,7 @@
 #include <mofka/Client.hpp>
 #include <mofka/Exception.hpp>
 #include <mofka/Serializer.hpp>
+#include <mofka/Compressor.hpp>
 #include <mofka/Validator.hpp>
 #include <mofka/TargetSelector.hpp>
 #include <mofka/Metadata.hpp>
@@ -90,6 +91,7 @@ class ServiceHandle {
      * @param validator Validator object to validate events pushed to the topic.
      * @param selector TargetSelector object of the topic.
      * @param serializer Serializer to use for all the events in the topic.
+     * @param compressor Compressor applied to the metadata of batches of events.
      *
      * @return a TopicHandle representing the topic.
      */
@@ -97,7 +99,8 @@ class ServiceHandle {
                             TopicBackendConfig config = TopicBackendConfig{},
                             Validator validator = Validator{},
                             TargetSelector selector = TargetSelector{},
-                            Serializer serializer = Serializer{});
+                            Serializer serializer = Serializer{},
+                            Compressor compressor = Compressor{});
 
     /**
      * @brief Open an existing topic with the given name.
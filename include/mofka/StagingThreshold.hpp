@@ -0,0 +1,58 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_STAGING_THRESHOLD_HPP
+#define MOFKA_STAGING_THRESHOLD_HPP
+
+#include <mofka/ForwardDcl.hpp>
+
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Strongly typped size_t meant to store the size in bytes up to
+ * which a Producer copies a segment of Data into the staging buffer of
+ * its batch, which stays registered for RDMA, instead of exposing the
+ * segment zero-copy in a bulk handle created for the batch.
+ *
+ * Copying is cheaper than registering memory for small segments, and
+ * the crossover depends on the network and the machine. The default of
+ * 16 KiB comes from benchmarks/staging.cpp over na+sm and can be tuned
+ * by running this benchmark with the protocol of the deployment.
+ */
+struct StagingThreshold {
+
+    std::size_t value;
+
+    explicit constexpr StagingThreshold(std::size_t val)
+    : value(val) {}
+
+    /**
+     * @brief Returns the default threshold.
+     */
+    static constexpr StagingThreshold Default() {
+        return StagingThreshold{16*1024};
+    }
+
+    /**
+     * @brief Returns a value telling the producer to always
+     * expose the segments of its data zero-copy.
+     */
+    static constexpr StagingThreshold Disabled() {
+        return StagingThreshold{0};
+    }
+
+    inline bool operator<(const StagingThreshold& other) const { return value < other.value; }
+    inline bool operator>(const StagingThreshold& other) const { return value > other.value; }
+    inline bool operator<=(const StagingThreshold& other) const { return value <= other.value; }
+    inline bool operator>=(const StagingThreshold& other) const { return value >= other.value; }
+    inline bool operator==(const StagingThreshold& other) const { return value == other.value; }
+    inline bool operator!=(const StagingThreshold& other) const { return value != other.value; }
+};
+
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include <mofka/Exception.hpp>
 #include <mofka/Factory.hpp>
 
+#include <chrono>
 #include <functional>
 #include <exception>
 #include <stdexcept>
@@ -52,6 +53,11 @@ class PartitionTargetInfo {
      */
     uint16_t providerID() const;
 
+    /**
+     * @brief Constructor. The resulting PartitionTargetInfo will be invalid.
+     */
+    PartitionTargetInfo();
+
     /**
      * @brief Move constructor.
      */
@@ -82,6 +88,16 @@ class PartitionTargetInfo {
      */
     operator bool() const;
 
+    /**
+     * @brief Checks if two PartitionTargetInfo refer to the same target.
+     */
+    bool operator==(const PartitionTargetInfo& other) const;
+
+    /**
+     * @brief Checks if two PartitionTargetInfo refer to different targets.
+     */
+    bool operator!=(const PartitionTargetInfo& other) const;
+
     private:
 
     std::shared_ptr<PartitionTargetInfoImpl> self;
@@ -92,6 +108,7 @@ class PartitionTargetInfo {
     friend class TopicHandleImpl;
     friend class ClientImpl;
     friend class Producer;
+    friend class ProducerImpl;
     friend class ServiceHandle;
     friend class ConsumerImpl;
     friend class Event;
@@ -129,6 +146,47 @@ class TargetSelectorInterface {
      */
     virtual PartitionTargetInfo selectTargetFor(const Metadata& metadata) = 0;
 
+    /**
+     * @brief Notifies the selector that a batch of events for the given
+     * target stopped accepting events, because it is full or because it
+     * is being sent after lingering. Selectors may use it to decide when
+     * to switch targets. selectTargetFor and onBatchClosed may be called
+     * concurrently by the ULTs of the producers.
+     *
+     * @param target Target of the batch.
+     */
+    virtual void onBatchClosed(const PartitionTargetInfo& target) {
+        (void)target;
+    }
+
+    /**
+     * @brief Notifies the selector that the target acknowledged (or failed)
+     * a batch of events, giving feedback on the load of the target.
+     *
+     * @param target Target of the batch.
+     * @param count Number of events in the batch.
+     * @param rtt Time between sending the batch and receiving the response.
+     */
+    virtual void onBatchCompleted(const PartitionTargetInfo& target,
+                                  size_t count,
+                                  std::chrono::microseconds rtt) {
+        (void)target;
+        (void)count;
+        (void)rtt;
+    }
+
+    /**
+     * @brief Notifies the selector that an event for which selectTargetFor
+     * returned the given target will not be sent after all (e.g. because
+     * its metadata is invalid), so that selectors keeping count of the
+     * events sent to each target can forget it.
+     *
+     * @param target Target selected for the event.
+     */
+    virtual void onSelectionCancelled(const PartitionTargetInfo& target) {
+        (void)target;
+    }
+
     /**
      * @brief Convert the underlying validator implementation into a Metadata
      * object that can be stored (e.g. if the validator uses a JSON schema
@@ -199,6 +257,34 @@ class TargetSelector {
      */
     PartitionTargetInfo selectTargetFor(const Metadata& metadata);
 
+    /**
+     * @brief Notifies the selector that a batch of events for the given
+     * target stopped accepting events.
+     *
+     * @param target Target of the batch.
+     */
+    void onBatchClosed(const PartitionTargetInfo& target);
+
+    /**
+     * @brief Notifies the selector that the target acknowledged
+     * (or failed) a batch of events.
+     *
+     * @param target Target of the batch.
+     * @param count Number of events in the batch.
+     * @param rtt Time between sending the batch and receiving the response.
+     */
+    void onBatchCompleted(const PartitionTargetInfo& target,
+                          size_t count,
+                          std::chrono::microseconds rtt);
+
+    /**
+     * @brief Notifies the selector that an event for which it selected
+     * the given target will not be sent.
+     *
+     * @param target Target selected for the event.
+     */
+    void onSelectionCancelled(const PartitionTargetInfo& target);
+
     /**
      * @brief Convert the underlying validator implementation into a Metadata
      * object that can be stored (e.g. if the validator uses a JSON schema
@@ -90,6 +90,16 @@ class TopicHandle {
         return makeProducer(
             GetArgOrDefault(std::string_view{""}, std::forward<Options>(opts)...),
             GetArgOrDefault(BatchSize::Adaptive(), std::forward<Options>(opts)...),
+            GetArgOrDefault(BatchingGoal::Default(), std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxBatchBytes::Unlimited(), std::forward<Options>(opts)...),
+            GetArgOrDefault(Linger::Infinite(), std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxInFlightBatches::Default(), std::forward<Options>(opts)...),
+            GetArgOrDefault(EagerThreshold::Disabled(), std::forward<Options>(opts)...),
+            GetArgOrDefault(StagingThreshold::Default(), std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxPendingEvents::Unlimited(), std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxPendingBytes::Unlimited(), std::forward<Options>(opts)...),
+            GetArgOrDefault(BackpressurePolicy::Block, std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxBatchRetries::Default(), std::forward<Options>(opts)...),
             GetArgOrDefault(ThreadPool{}, std::forward<Options>(opts)...),
             GetArgOrDefault(defaultOrdering(), std::forward<Options>(opts)...));
     }
@@ -110,7 +120,12 @@ class TopicHandle {
             GetArgOrDefault(ThreadPool{}, std::forward<Options>(opts)...),
             GetArgOrDefault(DataBroker{}, std::forward<Options>(opts)...),
             GetArgOrDefault(DataSelector{}, std::forward<Options>(opts)...),
-            GetArgOrDefault(targets(), std::forward<Options>(opts)...));
+            GetArgOrDefault(targets(), std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxPendingEvents::ConsumerDefault(), std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxPendingBytes::Unlimited(), std::forward<Options>(opts)...),
+            GetArgOrDefault(PrefetchDepth::Default(), std::forward<Options>(opts)...),
+            GetArgOrDefault(MaxPrefetchBytes::Unlimited(), std::forward<Options>(opts)...),
+            GetArgOrDefault(DataFetchMode::Eager, std::forward<Options>(opts)...));
     }
 
     /**
@@ -141,6 +156,17 @@ class TopicHandle {
      *
      * @param name Name of the Producer.
      * @param batch_size Batch size.
+     * @param batching_goal Goal of the adaptive batch size.
+     * @param max_batch_bytes Maximum size of a batch in bytes.
+     * @param linger Maximum time a partially filled batch waits.
+     * @param max_in_flight Number of batches in flight per target (must be 1
+     * unless ordering is Ordering::Loose).
+     * @param eager_threshold Size under which batches are sent inline.
+     * @param staging_threshold Size up to which data segments are copied.
+     * @param max_pending_events Maximum number of pending events.
+     * @param max_pending_bytes Maximum size of the pending events.
+     * @param backpressure_policy What push does when a limit is reached.
+     * @param max_retries Number of times a failed batch is sent again.
      * @param thread_pool Thread pool.
      * @param ordering Whether to enforce strict ordering.
      *
@@ -148,6 +174,16 @@ class TopicHandle {
      */
     Producer makeProducer(std::string_view name,
                           BatchSize batch_size,
+                          BatchingGoal batching_goal,
+                          MaxBatchBytes max_batch_bytes,
+                          Linger linger,
+                          MaxInFlightBatches max_in_flight,
+                          EagerThreshold eager_threshold,
+                          StagingThreshold staging_threshold,
+                          MaxPendingEvents max_pending_events,
+                          MaxPendingBytes max_pending_bytes,
+                          BackpressurePolicy backpressure_policy,
+                          MaxBatchRetries max_retries,
                           ThreadPool thread_pool,
                           Ordering ordering) const;
 
@@ -160,6 +196,12 @@ class TopicHandle {
      * @param thread_pool Thread pool.
      * @param data_broker Data broker.
      * @param data_selector Data selector.
+     * @param targets Partitions to consume from.
+     * @param max_pending_events Credit window of each partition, in events.
+     * @param max_pending_bytes Credit window of each partition, in bytes of metadata.
+     * @param prefetch_depth Number of batches whose data is fetched in the background.
+     * @param max_prefetch_bytes Maximum size of the data fetched ahead of pull().
+     * @param data_fetch_mode Whether data is fetched on reception or on access.
      *
      * @return Consumer instance.
      */
@@ -168,7 +210,12 @@ class TopicHandle {
                           ThreadPool thread_pool,
                           DataBroker data_broker,
                           DataSelector data_selector,
-                          const std::vector<PartitionTargetInfo>& targets) const;
+                          const std::vector<PartitionTargetInfo>& targets,
+                          MaxPendingEvents max_pending_events,
+                          MaxPendingBytes max_pending_bytes,
+                          PrefetchDepth prefetch_depth,
+                          MaxPrefetchBytes max_prefetch_bytes,
+                          DataFetchMode data_fetch_mode) const;
 
     static Ordering defaultOrdering();
 
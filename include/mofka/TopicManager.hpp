@@ -12,6 +12,7 @@
 #include <mofka/Json.hpp>
 #include <mofka/BatchSize.hpp>
 #include <mofka/EventID.hpp>
+#include <mofka/UUID.hpp>
 #include <mofka/ConsumerHandle.hpp>
 #include <mofka/Factory.hpp>
 
@@ -85,10 +86,17 @@ class TopicManager {
      */
     virtual Metadata getSerializerMetadata() const = 0;
 
+    /**
+     * @brief Get the Metadata of the Compressor associated with this topic.
+     */
+    virtual Metadata getCompressorMetadata() const = 0;
+
     /**
      * @brief Receive a batch of events from a sender.
      *
      * @param producer_name Name of the producer.
+     * @param producer_id UUID of the producer.
+     * @param batch_seq Sequence number of the batch for this producer.
      * @param num_events Number of events sent.
      * @param metadata_bulk_size Total size of the bulk handle holding metadata and sizes.
      * @param metadata_bulk_offset Offset at which to start in the bulk handle.
@@ -102,18 +110,52 @@ class TopicManager {
      * - the first N*sizeof(size_t) bytes contain metadata/data sizes;
      * - the next S bytes (sum of the above sizes) contain the metadata/data content.
      *
+     * If the topic's Compressor is not pass-through, the metadata bulk
+     * instead exposes the compressed form of the above (sizes and content).
+     *
+     * A producer may send a batch again after a network error. If a batch
+     * with the same producer_id and batch_seq was already appended, the
+     * TopicManager should not append it again and should return the
+     * EventID of its first event.
+     *
      * @return a Result containing the result.
      */
     virtual Result<EventID> receiveBatch(
         const thallium::endpoint& sender,
         const std::string& producer_name,
+        const UUID& producer_id,
+        uint64_t batch_seq,
         size_t num_events,
         const BulkRef& metadata_bulk,
         const BulkRef& data_bulk) = 0;
 
+    /**
+     * @brief Receive a batch of events sent inline in the arguments of
+     * the sender's RPC. The metadata and data buffers have the same
+     * format as the content exposed by the bulk handles of receiveBatch.
+     *
+     * @param producer_name Name of the producer.
+     * @param producer_id UUID of the producer.
+     * @param batch_seq Sequence number of the batch for this producer.
+     * @param num_events Number of events sent.
+     * @param metadata Metadata sizes and metadata.
+     * @param data Data sizes and data.
+     *
+     * @return a Result containing the result.
+     */
+    virtual Result<EventID> receiveEagerBatch(
+        const thallium::endpoint& sender,
+        const std::string& producer_name,
+        const UUID& producer_id,
+        uint64_t batch_seq,
+        size_t num_events,
+        std::string_view metadata,
+        std::string_view data) = 0;
+
     /**
      * @brief This function is used to wake up the topic manager to make
-     * if check again the shouldStop() function of blocked ConsumerHandles.
+     * if check again the shouldStop() and takeCredits() functions of
+     * blocked ConsumerHandles.
      */
     virtual void wakeUp() = 0;
 
@@ -128,6 +170,14 @@ class TopicManager {
      * Multiple ConsumderHandle may be fed in parallel. The TopicManager
      * is responsible for feeding each event only once.
      *
+     * The TopicManager should not feed more events than the ConsumerHandle
+     * has credits for (see ConsumerHandle::takeCredits), blocking until
+     * wakeUp() is called when the consumer has no more credits.
+     *
+     * If the topic's Compressor is not pass-through, the metadata sizes and
+     * content are fed compressed together in the metadata BulkRef, and
+     * the metadata sizes BulkRef is empty.
+     *
      * @param consumerHandle ConsumerHandle to feed event batches.
      * @param bathSize batch size requested by the consumer.
      */
@@ -168,6 +218,7 @@ using TopicManagerFactory = Factory<TopicManager,
     const Metadata&,
     const Metadata&,
     const Metadata&,
+    const Metadata&,
     const Metadata&>;
 
 #define MOFKA_REGISTER_TOPIC_MANAGER(__name__, __type__) \
@@ -0,0 +1,144 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_ADAPTIVE_BATCH_CONTROLLER_H
+#define MOFKA_ADAPTIVE_BATCH_CONTROLLER_H
+
+#include "mofka/BatchingGoal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief The AdaptiveBatchController decides how many events an
+ * ActiveProducerBatchQueue should put in a batch when the Producer
+ * uses BatchSize::Adaptive(), and for how long a partially filled
+ * batch may wait for more events before being sent.
+ *
+ * It keeps an exponentially-weighted moving average (EWMA) of the
+ * inter-arrival time of events and of the round-trip time (RTT)
+ * of the RPCs sending batches to the target, and derives from them
+ * the batch size that meets the configured BatchingGoal:
+ *
+ * - Latency goal L: the first event of a batch of size B waits
+ *   B/rate to fill the batch, then RTT to be sent, hence
+ *   B = rate * (L - RTT).
+ * - Throughput goal T: with one batch in flight, the producer sends
+ *   B events every RTT, hence B = T * RTT.
+ *
+ * This class is not thread-safe, it is meant to be protected by
+ * the mutex of the ActiveProducerBatchQueue that owns it.
+ */
+class AdaptiveBatchController {
+
+    public:
+
+    using clock    = std::chrono::steady_clock;
+    using duration = std::chrono::duration<double, std::micro>;
+
+    static constexpr std::size_t MinBatchSize = 1;
+    static constexpr std::size_t MaxBatchSize = 16384;
+
+    AdaptiveBatchController(BatchingGoal goal)
+    : m_goal(goal) {}
+
+    /**
+     * @brief Record the arrival of a new event in the queue.
+     */
+    void recordArrival(clock::time_point now = clock::now()) {
+        if(m_last_arrival != clock::time_point{}) {
+            auto delta = duration{now - m_last_arrival}.count();
+            m_interarrival_us = ewma(m_interarrival_us, delta);
+        }
+        m_last_arrival = now;
+        update();
+    }
+
+    /**
+     * @brief Record the completion of a batch of the given size
+     * that took the given time to be sent.
+     */
+    void recordCompletion(std::size_t count, duration rtt) {
+        (void)count;
+        m_rtt_us = ewma(m_rtt_us, rtt.count());
+        update();
+    }
+
+    /**
+     * @brief Number of events the current batch should reach before
+     * being sent.
+     */
+    std::size_t batchSize() const {
+        return m_batch_size;
+    }
+
+    /**
+     * @brief Maximum amount of time a partially filled batch should
+     * wait for new events before being sent anyway.
+     */
+    duration maxWait() const {
+        return duration{m_max_wait_us};
+    }
+
+    /**
+     * @brief Estimated round-trip time of sending a batch.
+     */
+    duration roundTripTime() const {
+        return duration{m_rtt_us};
+    }
+
+    /**
+     * @brief Estimated arrival rate of events, in events per second.
+     */
+    double arrivalRate() const {
+        return m_interarrival_us > 0.0 ? 1e6/m_interarrival_us : 0.0;
+    }
+
+    private:
+
+    static constexpr double Alpha = 0.125; /* same weight as TCP's SRTT */
+
+    static double ewma(double current, double sample) {
+        if(current < 0.0) return sample;
+        return (1.0 - Alpha)*current + Alpha*sample;
+    }
+
+    void update() {
+        double target;
+        double rtt  = std::max(m_rtt_us, 0.0);
+        double rate = arrivalRate()/1e6; /* events per microsecond */
+        if(m_goal.kind == BatchingGoal::Kind::Latency) {
+            double budget = static_cast<double>(m_goal.value);
+            m_max_wait_us = std::max(budget - rtt, 0.0);
+            target = rate * m_max_wait_us;
+        } else {
+            double goal = static_cast<double>(m_goal.value)/1e6; /* events per microsecond */
+            target = goal * rtt;
+            /* there is no point waiting for more than one RTT, since the previous
+             * batch needs that long to complete before the next one can be sent */
+            m_max_wait_us = rtt;
+        }
+        target = std::clamp(target, (double)MinBatchSize, (double)MaxBatchSize);
+        /* smooth the changes so that a single outlier does not make
+         * the batch size oscillate */
+        auto smoothed = 0.5*static_cast<double>(m_batch_size) + 0.5*target;
+        m_batch_size = std::clamp(
+            static_cast<std::size_t>(smoothed + 0.5), MinBatchSize, MaxBatchSize);
+    }
+
+    BatchingGoal      m_goal;
+    clock::time_point m_last_arrival;
+    double            m_interarrival_us = -1.0;
+    double            m_rtt_us          = -1.0;
+    double            m_max_wait_us     = 0.0;
+    std::size_t       m_batch_size      = MinBatchSize;
+};
+
+}
+
+#endif
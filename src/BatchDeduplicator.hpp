@@ -0,0 +1,99 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_BATCH_DEDUPLICATOR_H
+#define MOFKA_BATCH_DEDUPLICATOR_H
+
+#include "mofka/UUID.hpp"
+#include "mofka/EventID.hpp"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <unordered_map>
+
+namespace mofka {
+
+/**
+ * @brief The BatchDeduplicator remembers, for each producer, the
+ * sequence numbers of the last batches a TopicManager appended and
+ * the EventID of their first event, so that a batch sent again by
+ * a producer retrying after a network error is not appended twice.
+ *
+ * Producers that have not appended a batch for a while are forgotten
+ * in least-recently-used order, so that a long-running topic does not
+ * accumulate an entry for every producer it has ever seen.
+ *
+ * The BatchDeduplicator is not thread-safe: the TopicManager should
+ * call find and record under the lock it holds when appending events.
+ */
+class BatchDeduplicator {
+
+    public:
+
+    /* Number of batches remembered per producer. Should be larger
+     * than the number of batches a producer may have in flight. */
+    static constexpr size_t MaxRememberedBatches = 1024;
+
+    /* Number of producers remembered. A producer is forgotten after
+     * this many other producers have appended a batch since its last
+     * one, by which time it is not expected to retry anymore. */
+    static constexpr size_t MaxRememberedProducers = 1024;
+
+    /**
+     * @brief Looks for a batch already appended. Returns true and
+     * sets first_id to its first EventID if it is found.
+     */
+    bool find(const UUID& producer_id, uint64_t batch_seq, EventID& first_id) const {
+        auto p = m_producers.find(producer_id);
+        if(p == m_producers.end()) return false;
+        auto it = p->second.batches.find(batch_seq);
+        if(it == p->second.batches.end()) return false;
+        first_id = it->second;
+        return true;
+    }
+
+    /**
+     * @brief Records that a batch has been appended.
+     */
+    void record(const UUID& producer_id, uint64_t batch_seq, EventID first_id) {
+        auto p = m_producers.find(producer_id);
+        if(p == m_producers.end()) {
+            m_lru.push_front(producer_id);
+            p = m_producers.emplace(producer_id, Producer{m_lru.begin(), {}}).first;
+            if(m_producers.size() > MaxRememberedProducers) {
+                m_producers.erase(m_lru.back());
+                m_lru.pop_back();
+            }
+        } else {
+            m_lru.splice(m_lru.begin(), m_lru, p->second.lru_position);
+        }
+        auto& batches = p->second.batches;
+        batches.emplace(batch_seq, first_id);
+        if(batches.size() > MaxRememberedBatches)
+            batches.erase(batches.begin());
+    }
+
+    /**
+     * @brief Returns the number of producers currently remembered.
+     */
+    size_t numProducers() const {
+        return m_producers.size();
+    }
+
+    private:
+
+    struct Producer {
+        std::list<UUID>::iterator   lru_position;
+        std::map<uint64_t, EventID> batches;
+    };
+
+    std::unordered_map<UUID, Producer> m_producers;
+    std::list<UUID>                    m_lru; /* most recently recorded first */
+};
+
+}
+
+#endif
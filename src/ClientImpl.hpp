@@ -29,9 +29,11 @@ class ClientImpl {
     tl::remote_procedure m_open_topic;
     tl::remote_procedure m_get_uuid;
     tl::remote_procedure m_producer_send_batch;
+    tl::remote_procedure m_producer_send_eager_batch;
     tl::remote_procedure m_consumer_request_events;
     tl::remote_procedure m_consumer_ack_event;
     tl::remote_procedure m_consumer_remove_consumer;
+    tl::remote_procedure m_consumer_grant_credits;
     tl::remote_procedure m_consumer_request_data;
     tl::remote_procedure m_consumer_recv_batch;
 
@@ -42,9 +44,11 @@ class ClientImpl {
     , m_create_topic(m_engine.define("mofka_create_topic"))
     , m_open_topic(m_engine.define("mofka_open_topic"))
     , m_producer_send_batch(m_engine.define("mofka_producer_send_batch"))
+    , m_producer_send_eager_batch(m_engine.define("mofka_producer_send_eager_batch"))
     , m_consumer_request_events(m_engine.define("mofka_consumer_request_events"))
     , m_consumer_ack_event(m_engine.define("mofka_consumer_ack_event"))
     , m_consumer_remove_consumer(m_engine.define("mofka_consumer_remove_consumer"))
+    , m_consumer_grant_credits(m_engine.define("mofka_consumer_grant_credits"))
     , m_consumer_request_data(m_engine.define("mofka_consumer_request_data"))
     , m_consumer_recv_batch(m_engine.define("mofka_consumer_recv_batch", forwardBatchToConsumer))
     , m_bedrock_client(m_engine)
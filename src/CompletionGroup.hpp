@@ -0,0 +1,309 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_COMPLETION_GROUP_H
+#define MOFKA_COMPLETION_GROUP_H
+
+#include "PimplUtil.hpp"
+#include "ThreadPoolImpl.hpp"
+
+#include "mofka/Future.hpp"
+#include "mofka/EventID.hpp"
+#include "mofka/Exception.hpp"
+
+#include <thallium.hpp>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace mofka {
+
+class CompletionGroup;
+
+/**
+ * @brief Promise of an event pushed by a Producer: a reference to the
+ * slot of the event in its CompletionGroup.
+ */
+struct EventPromise {
+
+    SP<CompletionGroup> group;
+    size_t              index = 0;
+
+    inline void setValue(EventID id);
+    inline void setException(const Exception& ex);
+    inline void setException(std::exception_ptr ex);
+
+    /**
+     * @brief Completes the events of a batch, which received consecutive
+     * EventIDs starting at firstID. Consecutive promises belonging to the
+     * same CompletionGroup are completed together, with a single lock
+     * and a single notification.
+     */
+    static inline void SetValues(const std::vector<EventPromise>& promises, EventID firstID);
+
+    /**
+     * @brief Fails the events of a batch.
+     */
+    static inline void SetExceptions(const std::vector<EventPromise>& promises, const Exception& ex);
+};
+
+/**
+ * @brief A CompletionGroup holds the completion state of a group of
+ * events pushed consecutively by a Producer, so that pushing an event
+ * does not allocate a state (eventual, mutex, functions) of its own.
+ * Each Future points to the slot of its event with a shared_ptr that
+ * shares the ownership of the whole group.
+ *
+ * Waiters block on a condition variable shared by the group, which is
+ * notified once per batch completing some of its events.
+ */
+class CompletionGroup : public std::enable_shared_from_this<CompletionGroup> {
+
+    public:
+
+    /* Number of slots of the groups shared by events pushed one by one. */
+    static constexpr size_t DefaultCapacity = 64;
+
+    using Outcome = FutureState<EventID>::Outcome;
+    using Subscription = FutureState<EventID>::Subscription;
+    using Callback = std::function<void(const Outcome&)>;
+
+    /**
+     * @brief Creates a group of the given capacity. The callbacks of
+     * Future::then run on thread_pool. If not empty, on_wait is called
+     * by Future::wait before blocking; on_wait_key identifies the object
+     * it acts upon.
+     */
+    static SP<CompletionGroup> Create(
+            size_t capacity,
+            SP<ThreadPoolImpl> thread_pool,
+            std::function<void()> on_wait,
+            const void* on_wait_key) {
+        return SP<CompletionGroup>{new CompletionGroup{
+            capacity, std::move(thread_pool), std::move(on_wait), on_wait_key}};
+    }
+
+    size_t capacity() const {
+        return m_slots.size();
+    }
+
+    /**
+     * @brief Returns the Future of the event in the given slot.
+     * Does not allocate memory.
+     */
+    Future<EventID> future(size_t index) {
+        return Future<EventID>{SP<FutureState<EventID>>{shared_from_this(), &m_slots[index]}};
+    }
+
+    /**
+     * @brief Returns the promise of the event in the given slot.
+     */
+    EventPromise promise(size_t index) {
+        return EventPromise{shared_from_this(), index};
+    }
+
+    /**
+     * @brief Completes count slots, given their indices
+     * and the EventID of the first one.
+     */
+    void setValues(const EventPromise* promises, size_t count, EventID firstID) {
+        complete(promises, count, [firstID](size_t i, Slot& slot) {
+            slot.id = firstID + i;
+            slot.status.store(Slot::Succeeded, std::memory_order_release);
+        });
+    }
+
+    /**
+     * @brief Fails count slots, given their indices.
+     */
+    void setExceptions(const EventPromise* promises, size_t count, const Exception& ex) {
+        setExceptions(promises, count, std::make_exception_ptr(ex));
+    }
+
+    /**
+     * @brief Same as above, keeping the dynamic type of the exception
+     * (e.g. InvalidMetadata) for wait() and the callbacks of the slots.
+     */
+    void setExceptions(const EventPromise* promises, size_t count, std::exception_ptr error) {
+        complete(promises, count, [this, &error](size_t, Slot& slot) {
+            m_errors.emplace(slot.index, error);
+            slot.status.store(Slot::Failed, std::memory_order_release);
+        });
+    }
+
+    private:
+
+    /**
+     * @brief Slot of an event. Its FutureState interface forwards to the group.
+     */
+    struct Slot : public FutureState<EventID> {
+
+        enum Status : uint8_t { Pending, Succeeded, Failed };
+
+        CompletionGroup*     group = nullptr;
+        size_t               index = 0;
+        EventID              id    = 0;
+        std::atomic<uint8_t> status{Pending};
+        std::vector<std::pair<
+            Subscription,
+            Callback>>       callbacks; /* registered by Future::then, protected by the group's mutex */
+
+        EventID wait() override {
+            return group->wait(*this);
+        }
+
+        bool completed() override {
+            return status.load(std::memory_order_acquire) != Pending;
+        }
+
+        Subscription subscribe(Callback callback) override {
+            return group->subscribe(*this, std::move(callback));
+        }
+
+        void unsubscribe(Subscription subscription) override {
+            group->unsubscribe(*this, subscription);
+        }
+
+        void execute(std::function<void()> fn) override {
+            group->m_thread_pool->pushWork(std::move(fn));
+        }
+
+        void onWait() override {
+            if(group->m_on_wait) group->m_on_wait();
+        }
+
+        const void* onWaitKey() const override {
+            return group->m_on_wait_key;
+        }
+    };
+
+    std::vector<Slot>                        m_slots;
+    SP<ThreadPoolImpl>                       m_thread_pool;
+    std::function<void()>                    m_on_wait;
+    const void*                              m_on_wait_key;
+    thallium::mutex                          m_mutex;
+    thallium::condition_variable             m_cv;
+    std::unordered_map<size_t,
+        std::exception_ptr>                  m_errors;    /* exception of each failed slot */
+    Subscription                             m_last_subscription = 0;
+
+    CompletionGroup(size_t capacity,
+                    SP<ThreadPoolImpl> thread_pool,
+                    std::function<void()> on_wait,
+                    const void* on_wait_key)
+    : m_slots(capacity)
+    , m_thread_pool(std::move(thread_pool))
+    , m_on_wait(std::move(on_wait))
+    , m_on_wait_key(on_wait_key) {
+        for(size_t i = 0; i < capacity; ++i) {
+            m_slots[i].group = this;
+            m_slots[i].index = i;
+        }
+    }
+
+    /* must be called with m_mutex held, on a completed slot */
+    Outcome outcomeOf(const Slot& slot) const {
+        if(slot.status.load(std::memory_order_acquire) == Slot::Failed)
+            return m_errors.at(slot.index);
+        return slot.id;
+    }
+
+    template<typename SetFn>
+    void complete(const EventPromise* promises, size_t count, SetFn&& set) {
+        std::vector<std::pair<Outcome, Callback>> to_invoke;
+        {
+            std::lock_guard<thallium::mutex> guard{m_mutex};
+            for(size_t i = 0; i < count; ++i) {
+                auto& slot = m_slots[promises[i].index];
+                set(i, slot);
+                if(slot.callbacks.empty()) continue;
+                auto outcome = outcomeOf(slot);
+                for(auto& p : slot.callbacks)
+                    to_invoke.emplace_back(outcome, std::move(p.second));
+                slot.callbacks.clear();
+            }
+        }
+        m_cv.notify_all();
+        for(auto& p : to_invoke) p.second(p.first);
+    }
+
+    EventID wait(Slot& slot) {
+        auto status = slot.status.load(std::memory_order_acquire);
+        if(status == Slot::Succeeded) return slot.id;
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        m_cv.wait(guard, [&slot]() {
+            return slot.status.load(std::memory_order_acquire) != Slot::Pending;
+        });
+        if(slot.status.load(std::memory_order_acquire) == Slot::Failed)
+            std::rethrow_exception(m_errors.at(slot.index));
+        return slot.id;
+    }
+
+    Subscription subscribe(Slot& slot, Callback callback) {
+        Outcome outcome;
+        {
+            std::lock_guard<thallium::mutex> guard{m_mutex};
+            if(slot.status.load(std::memory_order_acquire) == Slot::Pending) {
+                slot.callbacks.emplace_back(++m_last_subscription, std::move(callback));
+                return m_last_subscription;
+            }
+            outcome = outcomeOf(slot);
+        }
+        callback(outcome);
+        return FutureState<EventID>::NoSubscription;
+    }
+
+    void unsubscribe(Slot& slot, Subscription subscription) {
+        std::lock_guard<thallium::mutex> guard{m_mutex};
+        auto& callbacks = slot.callbacks;
+        for(auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+            if(it->first != subscription) continue;
+            callbacks.erase(it);
+            return;
+        }
+    }
+};
+
+inline void EventPromise::setValue(EventID id) {
+    group->setValues(this, 1, id);
+}
+
+inline void EventPromise::setException(const Exception& ex) {
+    group->setExceptions(this, 1, ex);
+}
+
+inline void EventPromise::setException(std::exception_ptr ex) {
+    group->setExceptions(this, 1, std::move(ex));
+}
+
+inline void EventPromise::SetValues(const std::vector<EventPromise>& promises, EventID firstID) {
+    size_t begin = 0;
+    while(begin < promises.size()) {
+        auto group = promises[begin].group.get();
+        size_t end = begin + 1;
+        while(end < promises.size() && promises[end].group.get() == group) ++end;
+        group->setValues(promises.data() + begin, end - begin, firstID + begin);
+        begin = end;
+    }
+}
+
+inline void EventPromise::SetExceptions(const std::vector<EventPromise>& promises, const Exception& ex) {
+    size_t begin = 0;
+    while(begin < promises.size()) {
+        auto group = promises[begin].group.get();
+        size_t end = begin + 1;
+        while(end < promises.size() && promises[end].group.get() == group) ++end;
+        group->setExceptions(promises.data() + begin, end - begin, ex);
+        begin = end;
+    }
+}
+
+}
+
+#endif
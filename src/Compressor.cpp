@@ -0,0 +1,76 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "RapidJsonUtil.hpp"
+#include "mofka/Exception.hpp"
+#include "mofka/Compressor.hpp"
+#include "MetadataImpl.hpp"
+#include "PimplUtil.hpp"
+#include "NullCompressor.hpp"
+#include "Config.h"
+#ifdef MOFKA_HAS_ZLIB
+#include "ZlibCompressor.hpp"
+#endif
+#include <fmt/format.h>
+
+namespace mofka {
+
+using CompressorImpl = CompressorInterface;
+
+PIMPL_DEFINE_COMMON_FUNCTIONS_NO_CTOR(Compressor);
+
+Compressor::Compressor()
+: self(std::make_shared<NullCompressor>()) {}
+
+void Compressor::compress(const std::vector<Data::Segment>& segments,
+                          std::vector<char>& output) const {
+    self->compress(segments, output);
+}
+
+void Compressor::decompress(const char* input, size_t size,
+                            std::vector<char>& output) const {
+    self->decompress(input, size, output);
+}
+
+Metadata Compressor::metadata() const {
+    return self->metadata();
+}
+
+bool Compressor::isPassThrough() const {
+    return dynamic_cast<const NullCompressor*>(self.get()) != nullptr;
+}
+
+MOFKA_REGISTER_COMPRESSOR(null, NullCompressor);
+#ifdef MOFKA_HAS_ZLIB
+MOFKA_REGISTER_COMPRESSOR(zlib, ZlibCompressor);
+#endif
+
+Compressor Compressor::FromMetadata(const Metadata& metadata) {
+    auto& json = metadata.json();
+    if(!json.IsObject()) {
+        throw Exception(
+                "Cannot create Compressor from Metadata: "
+                "invalid Metadata (expected JSON object)");
+    }
+    if(!json.HasMember("__type__")) {
+        return Compressor{};
+    }
+    auto& type = json["__type__"];
+    if(!type.IsString()) {
+        throw Exception(
+                "Cannot create Compressor from Metadata: "
+                "invalid __type__ in Metadata (expected string)");
+    }
+    auto type_str = std::string{type.GetString()};
+    std::shared_ptr<CompressorInterface> c = CompressorFactory::create(type_str, metadata);
+    if(!c) {
+        throw Exception(fmt::format(
+                "Cannot create Compressor from Metadata: "
+                "unknown compressor type \"{}\"", type_str));
+    }
+    return Compressor(std::move(c));
+}
+
+}
@@ -18,7 +18,10 @@
 #include "PimplUtil.hpp"
 #include "ThreadPoolImpl.hpp"
 #include "ConsumerBatchImpl.hpp"
+#include "ProcessingEngine.hpp"
+#include <spdlog/spdlog.h>
 #include <limits>
+#include <optional>
 
 #include <thallium/serialization/stl/string.hpp>
 #include <thallium/serialization/stl/pair.hpp>
@@ -28,6 +31,21 @@ namespace mofka {
 
 PIMPL_DEFINE_COMMON_FUNCTIONS(Consumer);
 
+/**
+ * @brief Creates a future/promise pair for an event (or its data) of the
+ * consumer. Callbacks registered with Future::then run on the consumer's
+ * ThreadPool.
+ */
+template<typename T>
+static std::pair<Future<T>, Promise<T>> CreateFutureAndPromise(
+        const SP<ThreadPoolImpl>& thread_pool) {
+    auto execute = [thread_pool](std::function<void()> fn) {
+        thread_pool->pushWork(std::move(fn));
+    };
+    return Promise<T>::CreateFutureAndPromise(
+        std::function<void()>{}, nullptr, std::move(execute));
+}
+
 const std::string& Consumer::name() const {
     return self->m_name;
 }
@@ -52,32 +70,113 @@ DataSelector Consumer::dataSelector() const {
     return self->m_data_selector;
 }
 
+MaxPendingEvents Consumer::maxPendingEvents() const {
+    return self->m_max_pending_events;
+}
+
+MaxPendingBytes Consumer::maxPendingBytes() const {
+    return self->m_max_pending_bytes;
+}
+
 Future<Event> Consumer::pull() const {
+    return self->pull();
+}
+
+Future<Event> ConsumerImpl::pull(uint64_t* pull_id) {
     Future<Event> future;
-    std::unique_lock<thallium::mutex> guard{self->m_futures_mtx};
-    if(self->m_futures_credit || self->m_futures.empty()) {
+    std::optional<size_t> grant_to;
+    bool start_fetches = false;
+    std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+    if(m_futures_credit || m_futures.empty()) {
         // the queue of futures is empty or the futures
         // already in the queue have been created by
         // previous calls to pull() that haven't completed
         Promise<Event> promise;
-        std::tie(future, promise) = Promise<Event>::CreateFutureAndPromise();
-        self->m_futures.emplace_back(std::move(promise), future);
-        self->m_futures_credit = true;
+        std::tie(future, promise) = CreateFutureAndPromise<Event>(m_thread_pool);
+        PendingEvent pending{std::move(promise), future};
+        pending.pull_id = ++m_last_pull_id;
+        if(pull_id) *pull_id = pending.pull_id;
+        m_futures.push_back(std::move(pending));
+        m_futures_credit = true;
     } else {
         // the queue of futures has futures already
         // created by the consumer
-        future = std::move(self->m_futures.front().second);
-        self->m_futures.pop_front();
-        self->m_futures_credit = false;
+        auto& pending = m_futures.front();
+        auto target_info_index = pending.target_info_index;
+        future = std::move(pending.future);
+        if(pending.counted) {
+            m_credits[target_info_index].unpulled -= 1;
+            auto deferred = std::find_if(m_deferred_fetches.begin(), m_deferred_fetches.end(),
+                [&pending](const DeferredFetch& d) { return d.batch == pending.batch; });
+            if(deferred != m_deferred_fetches.end())
+                deferred->bytes -= pending.data_size;
+            else
+                m_prefetched_bytes -= pending.data_size;
+            start_fetches = !m_deferred_fetches.empty();
+            if(returnCredits(target_info_index, pending.metadata_size))
+                grant_to = target_info_index;
+        }
+        if(pull_id) *pull_id = 0;
+        m_futures.pop_front();
+        m_futures_credit = false;
     }
+    guard.unlock();
+    if(start_fetches) startDeferredFetches();
+    if(grant_to) grantCredits(*grant_to);
     return future;
 }
 
+bool ConsumerImpl::cancelPull(uint64_t pull_id) {
+    std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+    if(!m_futures_credit || pull_id == 0) return false;
+    auto it = std::find_if(m_futures.begin(), m_futures.end(),
+        [pull_id](const PendingEvent& pending) { return pending.pull_id == pull_id; });
+    if(it == m_futures.end()) return false;
+    m_futures.erase(it);
+    return true;
+}
+
+void ConsumerImpl::unpull(std::vector<Event> events) {
+    std::vector<std::pair<Promise<Event>, Event>> to_complete;
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        size_t i = 0;
+        // the first events go to the pull() calls waiting for one
+        while(i < events.size() && m_futures_credit && !m_futures.empty()) {
+            to_complete.emplace_back(std::move(m_futures.front().promise), std::move(events[i++]));
+            m_futures.pop_front();
+        }
+        // the others go before the events received from the partitions
+        if(i < events.size()) m_futures_credit = false;
+        for(size_t j = events.size(); j > i; --j) {
+            Future<Event> future;
+            Promise<Event> promise;
+            std::tie(future, promise) = CreateFutureAndPromise<Event>(m_thread_pool);
+            promise.setValue(std::move(events[j-1]));
+            PendingEvent pending{std::move(promise), std::move(future)};
+            pending.counted = false;
+            m_futures.push_front(std::move(pending));
+        }
+    }
+    for(auto& p : to_complete) p.first.setValue(std::move(p.second));
+}
+
 void Consumer::process(EventProcessor processor,
                        ThreadPool threadPool,
-                       NumEvents maxEvents) const {
-
-    // TODO
+                       NumEvents maxEvents,
+                       Ordering ordering,
+                       MaxInFlightEvents maxInFlight) const {
+    if(self->m_processing.exchange(true))
+        throw Exception{"Consumer::process is already running on this consumer"};
+    auto engine = std::make_shared<ProcessingEngine>(
+        std::move(processor), ordering, maxInFlight.value);
+    try {
+        engine->run(self, *threadPool.self, maxEvents.value);
+    } catch(...) {
+        self->m_processing = false;
+        throw;
+    }
+    self->m_processing = false;
 }
 
 void Consumer::operator|(EventProcessor processor) const && {
@@ -88,6 +187,26 @@ NumEvents NumEvents::Infinity() {
     return NumEvents{std::numeric_limits<size_t>::max()};
 }
 
+PrefetchDepth Consumer::prefetchDepth() const {
+    return self->m_prefetch_depth;
+}
+
+MaxPrefetchBytes Consumer::maxPrefetchBytes() const {
+    return self->m_max_prefetch_bytes;
+}
+
+DataFetchMode Consumer::dataFetchMode() const {
+    return self->m_data_fetch_mode;
+}
+
+MaxPrefetchBytes MaxPrefetchBytes::Unlimited() {
+    return MaxPrefetchBytes{std::numeric_limits<size_t>::max()};
+}
+
+MaxPendingEvents MaxPendingEvents::ConsumerDefault() {
+    return MaxPendingEvents{1024};
+}
+
 void ConsumerImpl::start() {
     // for each target, submit a ULT that pulls from that target
     auto n = m_targets.size();
@@ -110,6 +229,14 @@ void ConsumerImpl::join() {
     // wait for the ULTs to complete
     for(auto& ev : m_pulling_ult_completed)
         ev.wait();
+    // fetch the data of the batches that are still deferred,
+    // since some of their events may have been pulled
+    std::deque<DeferredFetch> deferred;
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        std::swap(deferred, m_deferred_fetches);
+    }
+    for(auto& d : deferred) d.fetch();
 }
 
 void ConsumerImpl::pullFrom(size_t target_info_index,
@@ -124,11 +251,38 @@ void ConsumerImpl::pullFrom(size_t target_info_index,
                    target_info_index,
                    m_uuid,
                    m_name,
-                   0, 0);
-    // TODO use max_item, batch_size (and some more options)
+                   m_max_pending_events.value,
+                   m_max_pending_bytes.value,
+                   0);
+    // TODO use batch_size (and some more options)
     ev.set_value();
 }
 
+void ConsumerImpl::grantCredits(size_t target_info_index) {
+    auto weak_self = weak_from_this();
+    m_thread_pool->pushWork([weak_self, target_info_index]() {
+        auto self = weak_self.lock();
+        if(!self) return;
+        Credits credits;
+        {
+            std::unique_lock<thallium::mutex> guard{self->m_futures_mtx};
+            auto& accumulated = self->m_credits[target_info_index];
+            std::swap(credits.events, accumulated.events);
+            std::swap(credits.bytes, accumulated.bytes);
+        }
+        // another ULT may have sent them already
+        if(credits.events == 0 && credits.bytes == 0) return;
+        auto& rpc = self->m_topic->m_service->m_client->m_consumer_grant_credits;
+        auto& ph  = self->m_targets[target_info_index].self->m_ph;
+        try {
+            Result<void> result = rpc.on(ph)(
+                self->m_uuid, target_info_index, credits.events, credits.bytes);
+        } catch(const std::exception& ex) {
+            spdlog::warn("Exception thrown while granting credits to partition: {}", ex.what());
+        }
+    });
+}
+
 void ConsumerImpl::recvBatch(size_t target_info_index,
                              size_t count,
                              EventID startID,
@@ -143,42 +297,52 @@ void ConsumerImpl::recvBatch(size_t target_info_index,
         m_engine, count, metadata.size, data_desc.size);
     batch->pullFrom(metadata_sizes, metadata, data_desc_sizes, data_desc);
 
+    // decompress the metadata, if needed; on failure, the
+    // error is reported through the promises of the events
+    std::optional<Exception> batch_error;
+    if(!m_topic->m_compressor.isPassThrough()) {
+        try {
+            batch->decompressMetadata(m_topic->m_compressor);
+        } catch(const Exception& ex) {
+            batch_error = ex;
+        }
+    }
+
     auto serializer = m_topic->m_serializer;
     thallium::future<void> ults_completed{(uint32_t)count};
     size_t metadata_offset  = 0;
     size_t data_desc_offset = 0;
 
+    // state of each event of the batch, shared with the
+    // ULT fetching the data of the batch in the background
+    struct BatchState {
+        std::vector<Promise<Event>>           promises;
+        std::vector<SP<EventImpl>>            events;
+        std::vector<DataDescriptor>           requested_descriptors;
+        std::vector<Data>                     data;
+        std::vector<std::optional<Exception>> errors;
+    };
+    auto state = std::make_shared<BatchState>();
+    state->promises.resize(count);
+    state->events.resize(count);
+    state->requested_descriptors.resize(count);
+    state->data.resize(count);
+    state->errors.resize(count);
+
     for(size_t i = 0; i < count; ++i) {
         auto eventID = startID + i;
-        // get a promise/future pair
-        Promise<Event> promise;
-        {
-            std::unique_lock<thallium::mutex> guard{m_futures_mtx};
-            if(!m_futures_credit || m_futures.empty()) {
-                // the queue of futures is empty or the futures
-                // already in the queue have been created by
-                // previous calls to recvBatch() that haven't had
-                // a corresponding pull() call from the user.
-                Future<Event> future;
-                std::tie(future, promise) = Promise<Event>::CreateFutureAndPromise();
-                m_futures.emplace_back(promise, future);
-                m_futures_credit = false;
-            } else {
-                // the queue of futures has futures already
-                // created by pull() calls from the user
-                promise = std::move(m_futures.front().first);
-                m_futures.pop_front();
-                m_futures_credit = true;
-            }
-        }
         // create new event instance
-        auto event_impl = std::make_shared<EventImpl>(
+        state->events[i] = std::make_shared<EventImpl>(
             eventID, target.self, shared_from_this());
+        state->events[i]->m_target_info_index = target_info_index;
+        state->events[i]->m_lazy = m_data_fetch_mode == DataFetchMode::Lazy;
         // create the ULT
-        auto ult = [this, &batch, i, event_impl, promise,
+        auto ult = [this, &batch, i, &batch_state = *state,
                     metadata_offset, data_desc_offset,
-                    &serializer, &ults_completed]() mutable {
+                    &serializer, &ults_completed, &batch_error]() mutable {
+            auto& event_impl = batch_state.events[i];
             try {
+                if(batch_error) throw *batch_error;
                 // deserialize its metadata
                 Metadata metadata{event_impl->m_metadata};
                 BufferWrapperInputArchive metadata_archive{
@@ -193,17 +357,21 @@ void ConsumerImpl::recvBatch(size_t target_info_index,
                             batch->m_data_desc_sizes[i]}};
                 DataDescriptor descriptor;
                 descriptor.load(descriptors_archive);
-                // request Data associated with the event
-                event_impl->m_data = requestData(
-                        event_impl->m_target,
+                event_impl->m_descriptor = descriptor.self;
+                // in lazy mode, the data is fetched by Event::fetchData
+                if(event_impl->m_lazy) {
+                    ults_completed.set(nullptr);
+                    return;
+                }
+                // select and allocate the Data associated with the event
+                batch_state.data[i] = allocateData(
                         event_impl->m_metadata,
-                        descriptor.self);
-                // set the promise
-                promise.setValue(Event{event_impl});
+                        descriptor.self,
+                        batch_state.requested_descriptors[i]);
             } catch(const Exception& ex) {
                 // something bad happened somewhere,
                 // pass the exception to the promise.
-                promise.setException(ex);
+                batch_state.errors[i] = ex;
             }
             ults_completed.set(nullptr);
         };
@@ -212,18 +380,135 @@ void ConsumerImpl::recvBatch(size_t target_info_index,
         data_desc_offset += batch->m_data_desc_sizes[i];
     }
     ults_completed.wait();
+
+    // request the data of the whole batch at once, then set the promises
+    auto fetch = [this, &target, state, count]() {
+        auto& errors = state->errors;
+        std::vector<size_t> requested_events;
+        for(size_t i = 0; i < count; ++i) {
+            if(errors[i] || state->requested_descriptors[i].size() == 0) continue;
+            requested_events.push_back(i);
+        }
+        if(!requested_events.empty()) {
+            std::vector<DataDescriptor> descriptors;
+            std::vector<Data>           buffers;
+            descriptors.reserve(requested_events.size());
+            buffers.reserve(requested_events.size());
+            for(auto i : requested_events) {
+                descriptors.push_back(state->requested_descriptors[i]);
+                buffers.push_back(state->data[i]);
+            }
+            try {
+                auto results = requestData(target.self, descriptors, buffers);
+                for(size_t j = 0; j < requested_events.size(); ++j) {
+                    if(!results[j].success())
+                        errors[requested_events[j]] = Exception(results[j].error());
+                }
+            } catch(const Exception& ex) {
+                for(auto i : requested_events) errors[i] = ex;
+            }
+        }
+        for(size_t i = 0; i < count; ++i) {
+            if(errors[i]) {
+                state->promises[i].setException(*errors[i]);
+            } else {
+                state->events[i]->m_data = state->data[i].self;
+                state->promises[i].setValue(Event{state->events[i]});
+            }
+        }
+    };
+
+    // get a promise/future pair for each event, and decide
+    // whether the data of the batch can be fetched right away
+    bool grant = false;
+    bool start_now = false;
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        auto batch_id = ++m_last_batch;
+        size_t batch_bytes = 0;
+        for(size_t i = 0; i < count; ++i) {
+            auto& promise = state->promises[i];
+            if(!m_futures_credit || m_futures.empty()) {
+                // the queue of futures is empty or the futures
+                // already in the queue have been created by
+                // previous calls to recvBatch() that haven't had
+                // a corresponding pull() call from the user.
+                Future<Event> future;
+                std::tie(future, promise) = CreateFutureAndPromise<Event>(m_thread_pool);
+                auto data_size = state->errors[i] ? 0 : state->data[i].size();
+                m_futures.push_back({promise, future, target_info_index,
+                                     batch->m_meta_sizes[i], data_size});
+                m_futures.back().batch = batch_id;
+                m_credits[target_info_index].unpulled += 1;
+                batch_bytes += data_size;
+                m_futures_credit = false;
+            } else {
+                // the queue of futures has futures already
+                // created by pull() calls from the user
+                promise = std::move(m_futures.front().promise);
+                m_futures.pop_front();
+                m_futures_credit = true;
+                grant |= returnCredits(target_info_index, batch->m_meta_sizes[i]);
+            }
+        }
+        // without prefetching, the partition waits for the data to be
+        // fetched, otherwise the fetch is handed to a ULT so that the
+        // partition can send the next batch; either way the fetches
+        // start in the order of the batches
+        start_now = m_deferred_fetches.empty() && canStartFetch();
+        if(start_now) {
+            m_prefetched_bytes += batch_bytes;
+            if(m_prefetch_depth.value != 0) m_fetching_batches += 1;
+        } else {
+            m_deferred_fetches.push_back({batch_id, startID, batch_bytes, fetch});
+        }
+    }
+    if(grant) grantCredits(target_info_index);
+    if(!start_now) return;
+    if(m_prefetch_depth.value == 0) fetch();
+    else startFetch(std::move(fetch), startID);
 }
 
-SP<DataImpl> ConsumerImpl::requestData(
-        SP<PartitionTargetInfoImpl> target,
+void ConsumerImpl::startFetch(std::function<void()> fetch, EventID first_id) {
+    m_thread_pool->pushWork([self=shared_from_this(), fetch=std::move(fetch)]() {
+        fetch();
+        {
+            std::unique_lock<thallium::mutex> guard{self->m_futures_mtx};
+            self->m_fetching_batches -= 1;
+        }
+        self->startDeferredFetches();
+    }, first_id);
+}
+
+void ConsumerImpl::startDeferredFetches() {
+    std::vector<DeferredFetch> to_start;
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        while(!m_deferred_fetches.empty() && canStartFetch()) {
+            auto& deferred = m_deferred_fetches.front();
+            m_prefetched_bytes += deferred.bytes;
+            m_fetching_batches += 1;
+            to_start.push_back(std::move(deferred));
+            m_deferred_fetches.pop_front();
+        }
+    }
+    for(auto& deferred : to_start)
+        startFetch(std::move(deferred.fetch), deferred.first_id);
+}
+
+Data ConsumerImpl::allocateData(
         SP<MetadataImpl> metadata,
-        SP<DataDescriptorImpl> descriptor) {
-    // run data selector
-    auto requested_descriptor = (m_data_selector && m_data_broker)
-        ? m_data_selector(metadata, descriptor)
-        : DataDescriptor::Null();
+        SP<DataDescriptorImpl> descriptor,
+        DataDescriptor& requested_descriptor) {
+    // run data selector (in lazy mode, all the data is selected by default)
+    if(m_data_selector && m_data_broker)
+        requested_descriptor = m_data_selector(metadata, descriptor);
+    else if(m_data_broker && m_data_fetch_mode == DataFetchMode::Lazy)
+        requested_descriptor = descriptor;
+    else
+        requested_descriptor = DataDescriptor::Null();
     if(requested_descriptor.size() == 0)
-        return Data{}.self;
+        return Data{};
     // run data broker
     auto data = m_data_broker(metadata, requested_descriptor);
     if(data.size() != requested_descriptor.size()) {
@@ -231,34 +516,121 @@ SP<DataImpl> ConsumerImpl::requestData(
                 "DataBroker returned a Data object with a "
                 "size different from the DataDescriptor size");
     }
-    // expose the local_data_target for RDMA
+    return data;
+}
+
+Future<Data> ConsumerImpl::fetchData(
+        size_t target_info_index,
+        SP<MetadataImpl> metadata,
+        SP<DataDescriptorImpl> descriptor) {
+    Future<Data> future;
+    Promise<Data> promise;
+    std::tie(future, promise) = CreateFutureAndPromise<Data>(m_thread_pool);
+    DataDescriptor requested_descriptor;
+    Data data;
+    try {
+        data = allocateData(metadata, descriptor, requested_descriptor);
+    } catch(const Exception& ex) {
+        promise.setException(ex);
+        return future;
+    }
+    if(requested_descriptor.size() == 0) {
+        promise.setValue(data);
+        return future;
+    }
+    bool send = false;
+    {
+        std::unique_lock<thallium::mutex> guard{m_lazy_fetches_mtx};
+        auto& queue = m_lazy_fetches[target_info_index];
+        queue.pending.push_back({requested_descriptor, data, promise});
+        if(!queue.sending) {
+            queue.sending = true;
+            send = true;
+        }
+    }
+    if(send) {
+        m_thread_pool->pushWork([self=shared_from_this(), target_info_index]() {
+            self->sendLazyFetches(target_info_index);
+        });
+    }
+    return future;
+}
+
+void ConsumerImpl::sendLazyFetches(size_t target_info_index) {
+    auto& target = m_targets[target_info_index];
+    while(true) {
+        std::vector<LazyFetch> fetches;
+        {
+            std::unique_lock<thallium::mutex> guard{m_lazy_fetches_mtx};
+            auto& queue = m_lazy_fetches[target_info_index];
+            if(queue.pending.empty()) {
+                queue.sending = false;
+                return;
+            }
+            std::swap(fetches, queue.pending);
+        }
+        std::vector<DataDescriptor> descriptors;
+        std::vector<Data>           buffers;
+        descriptors.reserve(fetches.size());
+        buffers.reserve(fetches.size());
+        for(auto& fetch : fetches) {
+            descriptors.push_back(fetch.descriptor);
+            buffers.push_back(fetch.data);
+        }
+        try {
+            auto results = requestData(target.self, descriptors, buffers);
+            for(size_t i = 0; i < fetches.size(); ++i) {
+                if(results[i].success())
+                    fetches[i].promise.setValue(fetches[i].data);
+                else
+                    fetches[i].promise.setException(Exception(results[i].error()));
+            }
+        } catch(const Exception& ex) {
+            for(auto& fetch : fetches) fetch.promise.setException(ex);
+        }
+    }
+}
+
+std::vector<Result<void>> ConsumerImpl::requestData(
+        SP<PartitionTargetInfoImpl> target,
+        const std::vector<DataDescriptor>& descriptors,
+        const std::vector<Data>& data) {
+    // expose the segments of all the Data objects as a single bulk,
+    // in which the partition writes the data one after the other
     std::vector<std::pair<void*, size_t>> segments;
-    segments.reserve(data.segments().size());
-    for(auto& s : data.segments()) {
-        segments.emplace_back((void*)s.ptr, s.size);
+    size_t total_size = 0;
+    for(auto& d : data) {
+        for(auto& s : d.segments()) {
+            if(s.size == 0) continue;
+            segments.emplace_back((void*)s.ptr, s.size);
+        }
+        total_size += d.size();
     }
     auto local_bulk_ref = BulkRef{
         m_engine.expose(segments, thallium::bulk_mode::write_only),
-            0, data.size(),
+            0, total_size,
             m_self_addr
     };
+    std::vector<Cerealized<DataDescriptor>> cerealized_descriptors;
+    cerealized_descriptors.reserve(descriptors.size());
+    for(auto& descriptor : descriptors)
+        cerealized_descriptors.emplace_back(descriptor);
     // request data
     auto& rpc = m_topic->m_service->m_client->m_consumer_request_data;
     auto& ph  = target->m_ph;
 
     Result<std::vector<Result<void>>> result = rpc.on(ph)(
             m_topic->m_name,
-            Cerealized<DataDescriptor>(descriptor),
+            cerealized_descriptors,
             local_bulk_ref);
 
     if(!result.success())
         throw Exception(result.error());
 
-    if(!result.value()[0].success()) {
-        throw Exception(result.value()[0].error());
-    }
+    if(result.value().size() != descriptors.size())
+        throw Exception("Unexpected number of results from requestData");
 
-    return data.self;
+    return std::move(result.value());
 }
 
 }
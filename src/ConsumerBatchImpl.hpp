@@ -15,6 +15,8 @@
 #include "mofka/Metadata.hpp"
 #include "mofka/Archive.hpp"
 #include "mofka/Serializer.hpp"
+#include "mofka/Compressor.hpp"
+#include "mofka/Exception.hpp"
 #include "mofka/Data.hpp"
 #include "mofka/Future.hpp"
 #include "mofka/Consumer.hpp"
@@ -25,6 +27,7 @@
 #include "DataImpl.hpp"
 #include <vector>
 #include <cstdint>
+#include <cstring>
 
 namespace mofka {
 
@@ -94,6 +97,21 @@ class ConsumerBatchImpl {
         pull_bulk_ref(local_bulk, offset, remote_ep, remote_desc_buffer);
     }
 
+    /**
+     * @brief If the topic has a Compressor, pullFrom receives the
+     * compressed metadata sizes and metadata in m_meta_buffer.
+     * This function decompresses them into m_meta_sizes and m_meta_buffer.
+     */
+    void decompressMetadata(const Compressor& compressor) {
+        std::vector<char> decompressed;
+        compressor.decompress(m_meta_buffer.data(), m_meta_buffer.size(), decompressed);
+        auto sizes_size = m_meta_sizes.size()*sizeof(m_meta_sizes[0]);
+        if(decompressed.size() < sizes_size)
+            throw Exception{"Decompressed batch metadata is smaller than expected"};
+        std::memcpy(m_meta_sizes.data(), decompressed.data(), sizes_size);
+        m_meta_buffer.assign(decompressed.begin() + sizes_size, decompressed.end());
+    }
+
     size_t count() const {
         return m_meta_sizes.size();
     }
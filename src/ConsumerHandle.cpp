@@ -6,6 +6,7 @@
 #include "ConsumerHandleImpl.hpp"
 #include "PimplUtil.hpp"
 #include <spdlog/spdlog.h>
+#include <algorithm>
 #include <limits>
 
 namespace mofka {
@@ -19,6 +20,30 @@ const std::string& ConsumerHandle::name() const {
     return self->m_consumer_name;
 }
 
+size_t ConsumerHandle::takeCredits(const size_t* metadata_sizes, size_t count) {
+    constexpr auto unlimited = std::numeric_limits<size_t>::max();
+    auto g = std::unique_lock<thallium::mutex>{self->m_credits_mtx};
+    if(self->m_max_events != unlimited)
+        count = std::min(count, self->m_event_credits);
+    if(self->m_max_bytes != unlimited) {
+        size_t n = 0, bytes = 0;
+        while(n < count && bytes + metadata_sizes[n] <= self->m_byte_credits) {
+            bytes += metadata_sizes[n];
+            n += 1;
+        }
+        // an event larger than the window is sent when the window is empty
+        if(n == 0 && count != 0 && self->m_byte_credits == self->m_max_bytes) {
+            bytes = metadata_sizes[0];
+            n = 1;
+        }
+        count = n;
+        self->m_byte_credits -= std::min(bytes, self->m_byte_credits);
+    }
+    if(self->m_max_events != unlimited)
+        self->m_event_credits -= count;
+    return count;
+}
+
 bool ConsumerHandle::shouldStop() const {
     return self->m_should_stop;
 }
@@ -51,4 +76,16 @@ void ConsumerHandleImpl::stop() {
     m_topic_manager->wakeUp();
 }
 
+void ConsumerHandleImpl::grantCredits(size_t events, size_t bytes) {
+    constexpr auto unlimited = std::numeric_limits<size_t>::max();
+    {
+        auto g = std::unique_lock<thallium::mutex>{m_credits_mtx};
+        if(m_max_events != unlimited)
+            m_event_credits = std::min(m_max_events, m_event_credits + events);
+        if(m_max_bytes != unlimited)
+            m_byte_credits = std::min(m_max_bytes, m_byte_credits + bytes);
+    }
+    m_topic_manager->wakeUp();
+}
+
 }
@@ -11,6 +11,7 @@
 #include "mofka/ConsumerHandle.hpp"
 #include "mofka/TopicManager.hpp"
 #include <thallium.hpp>
+#include <limits>
 #include <queue>
 
 namespace mofka {
@@ -23,30 +24,47 @@ class ConsumerHandleImpl {
     const size_t                     m_target_info_index;
     const std::string                m_consumer_name;
     const size_t                     m_max_events;
+    const size_t                     m_max_bytes;
     const SP<TopicManager>           m_topic_manager;
     const thallium::endpoint         m_consumer_endpoint;
     const thallium::remote_procedure m_send_batch;
     std::atomic<bool>                m_should_stop = false;
 
+    /* credits left in the window of the consumer, a maximum
+     * of std::numeric_limits<size_t>::max() meaning unlimited */
+    size_t          m_event_credits;
+    size_t          m_byte_credits;
+    thallium::mutex m_credits_mtx;
+
     size_t m_sent_events = 0;
 
     ConsumerHandleImpl(
         intptr_t ctx,
         size_t target_info_index,
         std::string_view name,
-        size_t max,
+        size_t max_events,
+        size_t max_bytes,
         SP<TopicManager> topic_manager,
         thallium::endpoint endpoint,
         thallium::remote_procedure rpc)
     : m_consumer_ctx(ctx)
     , m_target_info_index(target_info_index)
     , m_consumer_name(name.data(), name.size())
-    , m_max_events(max)
+    , m_max_events(max_events)
+    , m_max_bytes(max_bytes)
     , m_topic_manager(std::move(topic_manager))
     , m_consumer_endpoint(std::move(endpoint))
-    , m_send_batch(std::move(rpc)) {}
+    , m_send_batch(std::move(rpc))
+    , m_event_credits(max_events)
+    , m_byte_credits(max_bytes) {}
 
     void stop();
+
+    /**
+     * @brief Gives back credits that the consumer has freed
+     * by handing events to its application.
+     */
+    void grantCredits(size_t events, size_t bytes);
 };
 
 }
@@ -13,10 +13,16 @@
 
 #include "mofka/Consumer.hpp"
 #include "mofka/UUID.hpp"
+#include "mofka/Result.hpp"
 
 #include <thallium.hpp>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <string_view>
 #include <queue>
+#include <vector>
 
 namespace mofka {
 
@@ -32,6 +38,11 @@ class ConsumerImpl : public std::enable_shared_from_this<ConsumerImpl> {
     const std::string                      m_name;
     const UUID                             m_uuid;
     const BatchSize                        m_batch_size;
+    const MaxPendingEvents                 m_max_pending_events;
+    const MaxPendingBytes                  m_max_pending_bytes;
+    const PrefetchDepth                    m_prefetch_depth;
+    const MaxPrefetchBytes                 m_max_prefetch_bytes;
+    const DataFetchMode                    m_data_fetch_mode;
     const SP<ThreadPoolImpl>               m_thread_pool;
     const DataBroker                       m_data_broker;
     const DataSelector                     m_data_selector;
@@ -57,10 +68,71 @@ class ConsumerImpl : public std::enable_shared_from_this<ConsumerImpl> {
      * of the queue. If the user calls pull(), it will use the future
      * at in m_futures.front() (the oldest created by the consumer)
      * and take it off the queue. This is the symetric of the above.
+     * Entries created by the consumer remember the partition and the
+     * metadata size of their event, so that pull() can give the
+     * corresponding credits back to the partition, as well as the
+     * size of the data prefetched for the event. Events given back
+     * by unpull() have already returned their credits.
      */
-    std::deque<std::pair<Promise<Event>, Future<Event>>> m_futures;
-    bool                                                 m_futures_credit;
-    thallium::mutex                                      m_futures_mtx;
+    struct PendingEvent {
+        Promise<Event> promise;
+        Future<Event>  future;
+        size_t         target_info_index = 0;
+        size_t         metadata_size = 0;
+        size_t         data_size = 0;
+        bool           counted = true; /* counted in m_credits and m_prefetched_bytes */
+        uint64_t       pull_id = 0;    /* identifies the entries created by pull() */
+        uint64_t       batch = 0;      /* batch of the event, for its DeferredFetch */
+    };
+    std::deque<PendingEvent> m_futures;
+    bool                     m_futures_credit;
+    uint64_t                 m_last_pull_id = 0;
+    thallium::mutex          m_futures_mtx;
+
+    /* Credits that the application has freed by pulling events,
+     * and that have not been given back to the partition yet,
+     * as well as the number of events of the partition that wait
+     * in m_futures for a pull(). Protected by m_futures_mtx. */
+    struct Credits {
+        size_t events   = 0;
+        size_t bytes    = 0;
+        size_t unpulled = 0;
+    };
+    std::vector<Credits> m_credits;
+
+    /* Size of the data of the events waiting in m_futures for a pull()
+     * whose fetch has started, and number of batches whose data is being
+     * fetched in the background. recvBatch runs in the handler of an RPC
+     * of the partition, so it never waits for them to go under
+     * m_max_prefetch_bytes and m_prefetch_depth: the fetch of a batch
+     * received above either limit is deferred, and started in order by
+     * pull() and by the end of other fetches. Protected by m_futures_mtx. */
+    struct DeferredFetch {
+        uint64_t              batch;
+        EventID               first_id;
+        size_t                bytes; /* data of its events waiting in m_futures */
+        std::function<void()> fetch;
+    };
+    size_t                    m_prefetched_bytes = 0;
+    size_t                    m_fetching_batches = 0;
+    uint64_t                  m_last_batch = 0;
+    std::deque<DeferredFetch> m_deferred_fetches;
+
+    /* Data requested through Event::fetchData in DataFetchMode::Lazy,
+     * for each partition. One ULT at a time per partition sends the
+     * pending fetches in a single requestData RPC, so fetches requested
+     * while an RPC is in flight are sent together by the next one. */
+    struct LazyFetch {
+        DataDescriptor descriptor;
+        Data           data;
+        Promise<Data>  promise;
+    };
+    struct LazyFetchQueue {
+        std::vector<LazyFetch> pending;
+        bool                   sending = false;
+    };
+    std::vector<LazyFetchQueue> m_lazy_fetches;
+    thallium::mutex             m_lazy_fetches_mtx;
 
     /**
      * Vector of eventuals that will be set on completion of the
@@ -68,6 +140,11 @@ class ConsumerImpl : public std::enable_shared_from_this<ConsumerImpl> {
      */
     std::vector<thallium::eventual<void>> m_pulling_ult_completed;
 
+    /**
+     * Whether Consumer::process is running.
+     */
+    std::atomic<bool> m_processing = false;
+
     ConsumerImpl(thallium::engine engine,
                  std::string_view name,
                  BatchSize batch_size,
@@ -75,17 +152,29 @@ class ConsumerImpl : public std::enable_shared_from_this<ConsumerImpl> {
                  DataBroker broker,
                  DataSelector selector,
                  std::vector<PartitionTargetInfo> targets,
+                 MaxPendingEvents max_pending_events,
+                 MaxPendingBytes max_pending_bytes,
+                 PrefetchDepth prefetch_depth,
+                 MaxPrefetchBytes max_prefetch_bytes,
+                 DataFetchMode data_fetch_mode,
                  std::shared_ptr<TopicHandleImpl> topic)
     : m_engine(std::move(engine))
     , m_name(name)
     , m_uuid(UUID::generate())
     , m_batch_size(batch_size)
+    , m_max_pending_events(max_pending_events)
+    , m_max_pending_bytes(max_pending_bytes)
+    , m_prefetch_depth(prefetch_depth)
+    , m_max_prefetch_bytes(max_prefetch_bytes)
+    , m_data_fetch_mode(data_fetch_mode)
     , m_thread_pool(std::move(thread_pool))
     , m_data_broker(std::move(broker))
     , m_data_selector(std::move(selector))
     , m_targets(std::move(targets))
     , m_topic(std::move(topic))
     , m_self_addr(m_engine.self())
+    , m_credits(m_targets.size())
+    , m_lazy_fetches(m_targets.size())
     {
         start();
     }
@@ -94,6 +183,61 @@ class ConsumerImpl : public std::enable_shared_from_this<ConsumerImpl> {
         join();
     }
 
+    /**
+     * @brief Records the credits of an event handed to the application.
+     * Must be called with m_futures_mtx held. Returns whether the credits
+     * accumulated for the partition should be granted now, that is when
+     * they reach a quarter of the window or when the application has
+     * pulled all the events received from the partition (otherwise a
+     * partition waiting for the bytes of a large event could wait forever).
+     */
+    bool returnCredits(size_t target_info_index, size_t metadata_size) {
+        if(m_max_pending_events == MaxPendingEvents::Unlimited()
+        && m_max_pending_bytes == MaxPendingBytes::Unlimited())
+            return false;
+        auto& credits = m_credits[target_info_index];
+        credits.events += 1;
+        credits.bytes  += metadata_size;
+        return credits.events >= std::max<size_t>(1, m_max_pending_events.value/4)
+            || credits.bytes  >= std::max<size_t>(1, m_max_pending_bytes.value/4)
+            || (credits.unpulled == 0 && m_max_pending_bytes != MaxPendingBytes::Unlimited());
+    }
+
+    /**
+     * @brief Sends the credits accumulated for a partition back to
+     * it from a ULT. Must be called without m_futures_mtx held.
+     */
+    void grantCredits(size_t target_info_index);
+
+    /**
+     * @brief Implements Consumer::pull. If pull_id is not null, it is
+     * set to an identifier of the call that cancelPull accepts.
+     */
+    Future<Event> pull(uint64_t* pull_id = nullptr);
+
+    /**
+     * @brief Cancels a call to pull() that no event has been assigned to
+     * yet. Returns false if an event has already been assigned to it, in
+     * which case its future completes as if it had not been cancelled.
+     */
+    bool cancelPull(uint64_t pull_id);
+
+    /**
+     * @brief Gives back events that have been pulled but not processed
+     * (e.g. by Consumer::process after the processor stopped), so that the
+     * next calls to pull() return them first, in the order of the vector.
+     */
+    void unpull(std::vector<Event> events);
+
+    /**
+     * @brief Runs the DataSelector and DataBroker on the event and
+     * queues the fetch of its data from the partition (DataFetchMode::Lazy).
+     */
+    Future<Data> fetchData(
+        size_t target_info_index,
+        SP<MetadataImpl> metadata,
+        SP<DataDescriptorImpl> descriptor);
+
     private:
 
     void start();
@@ -104,6 +248,30 @@ class ConsumerImpl : public std::enable_shared_from_this<ConsumerImpl> {
         size_t target_info_index,
         thallium::eventual<void>& ev);
 
+    void sendLazyFetches(size_t target_info_index);
+
+    /**
+     * @brief Whether the data of another batch can be fetched in the
+     * background. Must be called with m_futures_mtx held. One batch can
+     * always be fetched when no prefetched data waits for a pull().
+     */
+    bool canStartFetch() const {
+        return m_fetching_batches < std::max<size_t>(1, m_prefetch_depth.value)
+            && (m_prefetched_bytes == 0 || m_prefetched_bytes < m_max_prefetch_bytes.value);
+    }
+
+    /**
+     * @brief Starts the deferred fetches that canStartFetch allows.
+     * Must be called without m_futures_mtx held.
+     */
+    void startDeferredFetches();
+
+    /**
+     * @brief Runs the fetch of a batch in a ULT, m_fetching_batches
+     * having been incremented for it.
+     */
+    void startFetch(std::function<void()> fetch, EventID first_id);
+
     void recvBatch(
         size_t target_info_index,
         size_t count,
@@ -113,10 +281,27 @@ class ConsumerImpl : public std::enable_shared_from_this<ConsumerImpl> {
         const BulkRef &data_desc_sizes,
         const BulkRef &data_desc);
 
-    SP<DataImpl> requestData(
-        SP<PartitionTargetInfoImpl> target,
+    /**
+     * @brief Runs the DataSelector and the DataBroker on an event,
+     * returning the Data in which to receive the requested part of
+     * its data (described by requested_descriptor).
+     */
+    Data allocateData(
         SP<MetadataImpl> metadata,
-        SP<DataDescriptorImpl> descriptor);
+        SP<DataDescriptorImpl> descriptor,
+        DataDescriptor& requested_descriptor);
+
+    /**
+     * @brief Requests the data of a list of events from a partition
+     * with a single RPC, the partition writing the data described by
+     * descriptors[i] into data[i] through a single bulk handle.
+     * Throws an Exception if the RPC fails, otherwise returns
+     * a Result for each descriptor.
+     */
+    std::vector<Result<void>> requestData(
+        SP<PartitionTargetInfoImpl> target,
+        const std::vector<DataDescriptor>& descriptors,
+        const std::vector<Data>& data);
 };
 
 }
@@ -12,35 +12,75 @@
 #include "MetadataImpl.hpp"
 #include "RapidJsonUtil.hpp"
 
+#include <atomic>
+#include <cstring>
+#include <random>
+
 namespace mofka {
 
+/**
+ * @brief Default TargetSelector. In "round_robin" mode (the default),
+ * consecutive events are sent to consecutive targets. In "sticky" mode,
+ * events are sent to the same target until a batch for this target
+ * closes (it is full or it lingered), then to the next target, so that
+ * batches fill up as fast as with a single target.
+ *
+ * Example of Metadata:
+ * { "__type__": "default", "mode": "sticky" }
+ */
 class DefaultTargetSelector : public TargetSelectorInterface {
 
     public:
 
+    DefaultTargetSelector(bool sticky = false)
+    : m_sticky(sticky) {}
+
     void setTargets(const std::vector<PartitionTargetInfo>& targets) override {
         m_targets = targets;
+        /* sticky producers should not all start with the same target */
+        if(m_sticky) m_index = std::random_device{}();
     }
 
     PartitionTargetInfo selectTargetFor(const Metadata& metadata) override {
         (void)metadata;
         if(m_targets.size() == 0)
             throw Exception("TargetSelector has no target to select from");
-        if(m_index >= m_targets.size()) m_index = m_index % m_targets.size();
-        m_index += 1;
-        return m_targets.at(m_index-1);
+        if(m_sticky)
+            return m_targets[m_index.load() % m_targets.size()];
+        return m_targets[m_index++ % m_targets.size()];
+    }
+
+    void onBatchClosed(const PartitionTargetInfo& target) override {
+        if(!m_sticky || m_targets.size() == 0) return;
+        auto index = m_index.load();
+        /* only the batches of the current target make the selector move on */
+        if(m_targets[index % m_targets.size()] == target)
+            m_index.compare_exchange_strong(index, index + 1);
     }
 
     Metadata metadata() const override {
+        if(m_sticky)
+            return Metadata{"{\"__type__\":\"default\",\"mode\":\"sticky\"}"};
         return Metadata{"{\"type\":\"default\"}"};
     }
 
     static std::unique_ptr<TargetSelectorInterface> create(const Metadata& metadata) {
-        (void)metadata;
-        return std::make_unique<DefaultTargetSelector>();
+        auto& json = metadata.json();
+        bool sticky = false;
+        if(json.IsObject() && json.HasMember("mode")) {
+            auto& mode = json["mode"];
+            if(mode.IsString() && std::strcmp(mode.GetString(), "sticky") == 0)
+                sticky = true;
+            else if(!mode.IsString() || std::strcmp(mode.GetString(), "round_robin") != 0)
+                throw Exception{"Invalid \"mode\" for default TargetSelector (expected \"round_robin\" or \"sticky\")"};
+        }
+        return std::make_unique<DefaultTargetSelector>(sticky);
     }
 
-    size_t                           m_index = 0;
+    private:
+
+    bool                             m_sticky;
+    std::atomic<size_t>              m_index = 0;
     std::vector<PartitionTargetInfo> m_targets;
 };
 
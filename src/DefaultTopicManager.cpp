@@ -5,11 +5,14 @@
  */
 #include "RapidJsonUtil.hpp"
 #include "DefaultTopicManager.hpp"
+#include "TopicManagerUtil.hpp"
 #include "mofka/DataDescriptor.hpp"
 #include "mofka/BufferWrapperArchive.hpp"
 #include "RapidJsonUtil.hpp"
 #include <rapidjson/writer.h>
 #include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <cstring>
 #include <numeric>
 #include <iostream>
 
@@ -30,9 +33,35 @@ Metadata DefaultTopicManager::getTargetSelectorMetadata() const {
     return m_selector;
 }
 
+Metadata DefaultTopicManager::getCompressorMetadata() const {
+    return m_compressor.metadata();
+}
+
+void DefaultTopicManager::appendDataDescriptors(
+        EventID first_id,
+        const std::vector<DataDescriptor>& descriptors) {
+    size_t data_desc_offset = 0;
+    if(!m_events_data_desc_offsets.empty())
+        data_desc_offset = m_events_data_desc_offsets.back() + m_events_data_desc_sizes.back();
+    m_events_data_desc_sizes.resize(first_id + descriptors.size());
+    m_events_data_desc_offsets.resize(first_id + descriptors.size());
+    BufferWrapperOutputArchive output_archive{m_events_data_desc};
+    for(size_t i = first_id; i < m_events_data_desc_sizes.size(); ++i) {
+        const auto& data_descriptor = descriptors[i - first_id];
+        size_t m_events_data_desc_size = m_events_data_desc.size();
+        data_descriptor.save(output_archive);
+        auto data_descriptor_size = m_events_data_desc.size() - m_events_data_desc_size;
+        m_events_data_desc_sizes[i] = data_descriptor_size;
+        m_events_data_desc_offsets[i] = data_desc_offset;
+        data_desc_offset += data_descriptor_size;
+    }
+}
+
 Result<EventID> DefaultTopicManager::receiveBatch(
           const thallium::endpoint& sender,
           const std::string& producer_name,
+          const UUID& producer_id,
+          uint64_t batch_seq,
           size_t num_events,
           const BulkRef& metadata_bulk,
           const BulkRef& data_bulk)
@@ -40,38 +69,51 @@ Result<EventID> DefaultTopicManager::receiveBatch(
     (void)producer_name;
     Result<EventID> result;
     EventID first_id;
+    // --------- transfer and decompress the metadata, if compressed
+    std::vector<char> decompressed_metadata;
+    if(!m_compressor.isPassThrough()) {
+        std::vector<char> compressed_metadata(metadata_bulk.size);
+        auto local_compressed_bulk = m_engine.expose(
+            {{compressed_metadata.data(), compressed_metadata.size()}},
+            thallium::bulk_mode::write_only);
+        local_compressed_bulk << metadata_bulk.handle.on(sender).select(
+            metadata_bulk.offset, metadata_bulk.size);
+        auto decompressed = DecompressBatchMetadata(
+            m_compressor, num_events, {compressed_metadata.data(), compressed_metadata.size()},
+            decompressed_metadata);
+        if(!decompressed.success()) {
+            result.success() = false;
+            result.error() = decompressed.error();
+            return result;
+        }
+    }
     {
         auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
         first_id = m_events_metadata_sizes.size();
-        // --------- transfer the metadata
-        auto metadata_size = metadata_bulk.size - num_events*sizeof(size_t);
-        // resize the sizes and offsets arrays, and metadata array
-        if(m_events_metadata_sizes.capacity() < first_id + num_events) {
-            m_events_metadata_sizes.reserve(2*(first_id + num_events));
-        }
-        if(m_events_metadata_offsets.capacity() < first_id + num_events) {
-            m_events_metadata_offsets.reserve(2*(first_id + num_events));
-        }
-        m_events_metadata_sizes.resize(first_id + num_events);
-        m_events_metadata_offsets.resize(first_id + num_events);
-        size_t first_metadata_offset = m_events_metadata.size();
-        if(m_events_metadata.capacity() < first_metadata_offset + metadata_size) {
-            m_events_metadata.reserve(2*(first_metadata_offset + metadata_size));
+        // --------- skip the batch if it was already appended
+        if(m_deduplicator.find(producer_id, batch_seq, first_id)) {
+            result.value() = first_id;
+            return result;
         }
-        m_events_metadata.resize(first_metadata_offset + metadata_size);
-        // transfer the metadata sizes and content
-        auto local_metadata_bulk = m_engine.expose(
-            {{(char*)(m_events_metadata_sizes.data() + first_id), num_events*sizeof(size_t)},
-             {m_events_metadata.data() + first_metadata_offset, metadata_size}},
-            thallium::bulk_mode::write_only);
-        local_metadata_bulk << metadata_bulk.handle.on(sender).select(
-            metadata_bulk.offset, metadata_bulk.size);
-        // TODO check that metadata_size = sum of m_events_metadata_sizes recveived
-        // update the metadata offsets vector
-        auto metadata_offset = first_metadata_offset;
-        for(size_t i = first_id; i < m_events_metadata_sizes.size(); ++i) {
-            m_events_metadata_offsets[i] = metadata_offset;
-            metadata_offset += m_events_metadata_sizes[i];
+        if(m_compressor.isPassThrough()) {
+            // --------- transfer the metadata
+            auto metadata_size = metadata_bulk.size - num_events*sizeof(size_t);
+            auto first_metadata_offset = GrowPackedEvents(
+                m_events_metadata_sizes, m_events_metadata_offsets, m_events_metadata,
+                num_events, metadata_size);
+            // transfer the metadata sizes and content
+            auto local_metadata_bulk = m_engine.expose(
+                {{(char*)(m_events_metadata_sizes.data() + first_id), num_events*sizeof(size_t)},
+                 {m_events_metadata.data() + first_metadata_offset, metadata_size}},
+                thallium::bulk_mode::write_only);
+            local_metadata_bulk << metadata_bulk.handle.on(sender).select(
+                metadata_bulk.offset, metadata_bulk.size);
+            UpdatePackedOffsets(m_events_metadata_sizes, m_events_metadata_offsets,
+                                first_id, first_metadata_offset);
+        } else {
+            // --------- copy the decompressed metadata
+            AppendPackedEvents(m_events_metadata_sizes, m_events_metadata_offsets, m_events_metadata,
+                               num_events, {decompressed_metadata.data(), decompressed_metadata.size()});
         }
         // --------- transfer the data to the DataStore
         auto descriptors = m_data_store->store(num_events, data_bulk);
@@ -80,23 +122,57 @@ Result<EventID> DefaultTopicManager::receiveBatch(
             result.error() = descriptors.error();
             return result;
         }
-
         // update the list of DataDescriptors
-        size_t data_desc_offset = 0;
-        if(!m_events_data_desc_offsets.empty())
-            data_desc_offset = m_events_data_desc_offsets.back() + m_events_data_desc_sizes.back();
-        m_events_data_desc_sizes.resize(first_id + num_events);
-        m_events_data_desc_offsets.resize(first_id + num_events);
-        BufferWrapperOutputArchive output_archive{m_events_data_desc};
-        for(size_t i = first_id; i < m_events_data_desc_sizes.size(); ++i) {
-            const auto& data_descriptor = descriptors.value()[i - first_id];
-            size_t m_events_data_desc_size = m_events_data_desc.size();
-            data_descriptor.save(output_archive);
-            auto data_descriptor_size = m_events_data_desc.size() - m_events_data_desc_size;
-            m_events_data_desc_sizes[i] = data_descriptor_size;
-            m_events_data_desc_offsets[i] = data_desc_offset;
-            data_desc_offset += data_descriptor_size;
+        appendDataDescriptors(first_id, descriptors.value());
+        m_deduplicator.record(producer_id, batch_seq, first_id);
+    }
+    m_events_cv.notify_all();
+    result.value() = first_id;
+    return result;
+}
+
+Result<EventID> DefaultTopicManager::receiveEagerBatch(
+          const thallium::endpoint& sender,
+          const std::string& producer_name,
+          const UUID& producer_id,
+          uint64_t batch_seq,
+          size_t num_events,
+          std::string_view metadata,
+          std::string_view data)
+{
+    (void)sender;
+    (void)producer_name;
+    Result<EventID> result;
+    EventID first_id;
+    // --------- decompress the metadata, if compressed, and check the sizes
+    std::vector<char> decompressed_metadata;
+    auto unpacked = UnpackEagerBatch(m_compressor, num_events, metadata, data, decompressed_metadata);
+    if(!unpacked.success()) {
+        result.success() = false;
+        result.error() = unpacked.error();
+        return result;
+    }
+    {
+        auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
+        first_id = m_events_metadata_sizes.size();
+        // --------- skip the batch if it was already appended
+        if(m_deduplicator.find(producer_id, batch_seq, first_id)) {
+            result.value() = first_id;
+            return result;
         }
+        // --------- copy the metadata
+        AppendPackedEvents(m_events_metadata_sizes, m_events_metadata_offsets, m_events_metadata,
+                           num_events, metadata);
+        // --------- write the data to the DataStore
+        auto descriptors = m_data_store->store(num_events, data);
+        if(!descriptors.success()) {
+            result.success() = false;
+            result.error() = descriptors.error();
+            return result;
+        }
+        // update the list of DataDescriptors
+        appendDataDescriptors(first_id, descriptors.value());
+        m_deduplicator.record(producer_id, batch_seq, first_id);
     }
     m_events_cv.notify_all();
     result.value() = first_id;
@@ -104,6 +180,9 @@ Result<EventID> DefaultTopicManager::receiveBatch(
 }
 
 void DefaultTopicManager::wakeUp() {
+    // holding the mutex ensures that a feedConsumer about to
+    // wait on m_events_cv does not miss the notification
+    auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
     m_events_cv.notify_all();
 }
 
@@ -121,6 +200,7 @@ Result<void> DefaultTopicManager::feedConsumer(
     }
 
     auto self_addr = static_cast<std::string>(m_engine.self());
+    std::vector<char> compressed_metadata;
     {
         auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
         while(!consumerHandle.shouldStop()) {
@@ -130,6 +210,10 @@ Result<void> DefaultTopicManager::feedConsumer(
                 // find the number of events we can send
                 size_t max_available_events = m_events_metadata_sizes.size() - first_id;
                 num_events_to_send = std::min(batchSize.value, max_available_events);
+                // limit it to the credits of the consumer
+                if(num_events_to_send != 0)
+                    num_events_to_send = consumerHandle.takeCredits(
+                        m_events_metadata_sizes.data() + first_id, num_events_to_send);
                 should_stop = consumerHandle.shouldStop();
                 if(num_events_to_send != 0 || should_stop) break;
                 m_events_cv.wait(g);
@@ -143,16 +227,35 @@ Result<void> DefaultTopicManager::feedConsumer(
             const auto metadata_size = std::accumulate(
                     metadata_sizes_ptr, metadata_sizes_ptr + num_events_to_send, (size_t)0);
             // create the BulkRefs for the metadata sizes and contents
-            auto metadata_bulk = m_engine.expose(
-                    {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
-                     {metadata_ptr, metadata_size}},
-                    thallium::bulk_mode::read_only);
-            auto metadata_size_bulk_ref = BulkRef{
-                metadata_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
-            };
-            auto metadata_bulk_ref = BulkRef{
-                metadata_bulk, num_events_to_send*sizeof(size_t), metadata_size, self_addr
-            };
+            thallium::bulk metadata_bulk;
+            BulkRef metadata_size_bulk_ref, metadata_bulk_ref;
+            if(m_compressor.isPassThrough()) {
+                metadata_bulk = m_engine.expose(
+                        {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
+                         {metadata_ptr, metadata_size}},
+                        thallium::bulk_mode::read_only);
+                metadata_size_bulk_ref = BulkRef{
+                    metadata_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
+                };
+                metadata_bulk_ref = BulkRef{
+                    metadata_bulk, num_events_to_send*sizeof(size_t), metadata_size, self_addr
+                };
+            } else {
+                // compress the metadata sizes and contents together
+                m_compressor.compress(
+                        {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
+                         {metadata_ptr, metadata_size}},
+                        compressed_metadata);
+                metadata_bulk = m_engine.expose(
+                        {{compressed_metadata.data(), compressed_metadata.size()}},
+                        thallium::bulk_mode::read_only);
+                metadata_size_bulk_ref = BulkRef{
+                    metadata_bulk, 0, 0, self_addr
+                };
+                metadata_bulk_ref = BulkRef{
+                    metadata_bulk, 0, compressed_metadata.size(), self_addr
+                };
+            }
 
             // find the range of descriptor sizes
             const auto descriptors_sizes_ptr = m_events_data_desc_sizes.data() + first_id;
@@ -216,7 +319,8 @@ std::unique_ptr<mofka::TopicManager> DefaultTopicManager::create(
         const Metadata& config,
         const Metadata& validator,
         const Metadata& selector,
-        const Metadata& serializer) {
+        const Metadata& serializer,
+        const Metadata& compressor) {
 
     static constexpr const char* configSchema = R"(
     {
@@ -255,6 +359,9 @@ std::unique_ptr<mofka::TopicManager> DefaultTopicManager::create(
     datastore_config_doc.CopyFrom(config.json()["data"], datastore_config_doc.GetAllocator());
     Metadata datastore_config{std::move(datastore_config_doc)};
 
+    /* create the compressor */
+    auto metadata_compressor = Compressor::FromMetadata(compressor);
+
     /* create data store */
     auto data_store = WarabiDataStore::create(engine, std::move(datastore_config));
 
@@ -264,6 +371,7 @@ std::unique_ptr<mofka::TopicManager> DefaultTopicManager::create(
                                 validator,
                                 selector,
                                 serializer,
+                                std::move(metadata_compressor),
                                 std::move(data_store),
                                 engine));
 }
@@ -8,7 +8,9 @@
 
 #include <mofka/UUID.hpp>
 #include <mofka/TopicManager.hpp>
+#include <mofka/Compressor.hpp>
 #include "WarabiDataStore.hpp"
+#include "BatchDeduplicator.hpp"
 
 namespace mofka {
 
@@ -21,6 +23,7 @@ class DefaultTopicManager : public mofka::TopicManager {
     Metadata m_validator;
     Metadata m_selector;
     Metadata m_serializer;
+    Compressor m_compressor;
 
     std::unique_ptr<WarabiDataStore> m_data_store;
 
@@ -35,11 +38,19 @@ class DefaultTopicManager : public mofka::TopicManager {
     thallium::mutex              m_events_metadata_mtx;
     thallium::mutex              m_events_data_mtx;
     thallium::condition_variable m_events_cv;
+    BatchDeduplicator            m_deduplicator; /* protected by m_events_metadata_mtx */
 
 
     std::unordered_map<std::string, EventID> m_consumer_cursor;
     thallium::mutex                          m_consumer_cursor_mtx;
 
+    /**
+     * @brief Appends the DataDescriptors of the events from first_id.
+     */
+    void appendDataDescriptors(
+            EventID first_id,
+            const std::vector<DataDescriptor>& descriptors);
+
     public:
 
     /**
@@ -50,12 +61,14 @@ class DefaultTopicManager : public mofka::TopicManager {
         const Metadata& validator,
         const Metadata& selector,
         const Metadata& serializer,
+        Compressor compressor,
         std::unique_ptr<WarabiDataStore> data_store,
         thallium::engine engine)
     : m_config(config)
     , m_validator(validator)
     , m_selector(selector)
     , m_serializer(serializer)
+    , m_compressor(std::move(compressor))
     , m_data_store(std::move(data_store))
     , m_engine(engine) {}
 
@@ -99,16 +112,35 @@ class DefaultTopicManager : public mofka::TopicManager {
      */
     virtual Metadata getSerializerMetadata() const override;
 
+    /**
+     * @brief Get the Metadata of the Compressor associated with this topic.
+     */
+    virtual Metadata getCompressorMetadata() const override;
+
     /**
      * @brief Receives a batch.
      */
     Result<EventID> receiveBatch(
             const thallium::endpoint& sender,
             const std::string& producer_name,
+            const UUID& producer_id,
+            uint64_t batch_seq,
             size_t num_events,
             const BulkRef& metadata_bulk,
             const BulkRef& data_bulk) override;
 
+    /**
+     * @see TopicManager::receiveEagerBatch.
+     */
+    Result<EventID> receiveEagerBatch(
+            const thallium::endpoint& sender,
+            const std::string& producer_name,
+            const UUID& producer_id,
+            uint64_t batch_seq,
+            size_t num_events,
+            std::string_view metadata,
+            std::string_view data) override;
+
     /**
      * @brief Wake up the TopicManager's blocked ConsumerHandles.
      */
@@ -151,6 +183,7 @@ class DefaultTopicManager : public mofka::TopicManager {
      * @param config Metadata configuration for the manager.
      * @param validator Metadata of the topic's Validator.
      * @param serializer Metadata of the topic's Serializer.
+     * @param compressor Metadata of the topic's Compressor.
      *
      * @return a unique_ptr to a TopicManager.
      */
@@ -159,7 +192,8 @@ class DefaultTopicManager : public mofka::TopicManager {
         const Metadata& config,
         const Metadata& validator,
         const Metadata& selector,
-        const Metadata& serializer);
+        const Metadata& serializer,
+        const Metadata& compressor);
 
 };
 
@@ -10,6 +10,7 @@
 #include "PartitionTargetInfoImpl.hpp"
 #include "EventImpl.hpp"
 #include "PimplUtil.hpp"
+#include "Promise.hpp"
 
 namespace mofka {
 
@@ -20,7 +21,30 @@ Metadata Event::metadata() const {
 }
 
 Data Event::data() const {
-    return self->m_data;
+    if(!self->m_lazy) return self->m_data;
+    return fetchData().wait();
+}
+
+DataDescriptor Event::dataDescriptor() const {
+    if(!self->m_descriptor) return DataDescriptor::Null();
+    return self->m_descriptor;
+}
+
+Future<Data> Event::fetchData() const {
+    std::unique_lock<thallium::mutex> guard{self->m_data_mtx};
+    if(!self->m_data_future) {
+        if(self->m_lazy) {
+            self->m_data_future = self->m_consumer->fetchData(
+                self->m_target_info_index, self->m_metadata, self->m_descriptor);
+        } else {
+            Future<Data> future;
+            Promise<Data> promise;
+            std::tie(future, promise) = Promise<Data>::CreateFutureAndPromise();
+            promise.setValue(self->m_data);
+            self->m_data_future = std::move(future);
+        }
+    }
+    return *self->m_data_future;
 }
 
 PartitionTargetInfo Event::partition() const {
@@ -10,10 +10,12 @@
 #include "ConsumerImpl.hpp"
 #include "MetadataImpl.hpp"
 #include "DataImpl.hpp"
+#include "DataDescriptorImpl.hpp"
 
 #include "mofka/Event.hpp"
 
 #include <thallium.hpp>
+#include <optional>
 
 namespace mofka {
 
@@ -35,6 +37,14 @@ class EventImpl {
     SP<ConsumerImpl>            m_consumer;
     SP<MetadataImpl>            m_metadata;
     SP<DataImpl>                m_data;
+    SP<DataDescriptorImpl>      m_descriptor;
+    size_t                      m_target_info_index = 0;
+
+    /* DataFetchMode::Lazy: m_data is not set, the data is
+     * fetched by the first call to Event::fetchData */
+    bool                        m_lazy = false;
+    std::optional<Future<Data>> m_data_future;
+    thallium::mutex             m_data_mtx;
 };
 
 }
@@ -0,0 +1,69 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_INLINE_CONTENT_H
+#define MOFKA_INLINE_CONTENT_H
+
+#include "mofka/Data.hpp"
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace mofka {
+
+/**
+ * @brief Content sent in the arguments of an RPC instead of being
+ * exposed for RDMA. The sender provides a list of segments, which are
+ * serialized one after the other without being copied into an
+ * intermediate buffer. The receiver gets them as a contiguous buffer.
+ */
+struct InlineContent {
+
+    std::vector<Data::Segment> segments; /* memory to send (sender side) */
+    std::vector<char>          buffer;   /* memory received (receiver side) */
+
+    template<typename A>
+    void save(A& ar) const {
+        size_t size = 0;
+        for(const auto& seg : segments) size += seg.size;
+        ar(size);
+        for(const auto& seg : segments) {
+            if(!seg.size) continue;
+            ar.write(static_cast<const char*>(seg.ptr), seg.size);
+        }
+    }
+
+    template<typename A>
+    void load(A& ar) {
+        size_t size = 0;
+        ar(size);
+        buffer.resize(size);
+        if(size) ar.read(buffer.data(), size);
+    }
+};
+
+/**
+ * @brief Checks that a buffer received inline, made of count sizes
+ * followed by the pieces they describe, is consistent: the sizes must
+ * add up to the length of the rest of the buffer. This should be
+ * checked before trusting the sizes, since they come from the sender.
+ */
+inline bool ValidateSizePrefixedContent(size_t count, std::string_view content) {
+    if(count > content.size()/sizeof(size_t)) return false;
+    const auto remaining = content.size() - count*sizeof(size_t);
+    size_t total = 0;
+    for(size_t i = 0; i < count; ++i) {
+        size_t size;
+        std::memcpy(&size, content.data() + i*sizeof(size_t), sizeof(size_t));
+        if(size > remaining - total) return false;
+        total += size;
+    }
+    return total == remaining;
+}
+
+}
+
+#endif
@@ -0,0 +1,234 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_JSON_SCANNER_H
+#define MOFKA_JSON_SCANNER_H
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace mofka {
+
+/**
+ * @brief Structural scanner checking that the brackets of a JSON string
+ * are balanced, ignoring those in strings and those that are escaped.
+ *
+ * The string is processed in blocks of 64 bytes. For each block, the
+ * positions of quotes, backslashes, and opening and closing brackets are
+ * found 32 (AVX2) or 16 (SSE2) bytes at a time, or byte by byte on other
+ * architectures, as 64-bit masks. The escaped characters and the inside
+ * of strings are then derived with bitwise arithmetic, carrying the state
+ * from one block to the next, so that only the brackets that remain are
+ * visited one by one. The kinds of the open brackets are kept in a
+ * fixed-size bit stack; documents nested deeper than MaxDepth are checked
+ * with the byte-by-byte algorithm.
+ */
+class JsonScanner {
+
+    public:
+
+    static constexpr size_t MaxDepth = 1024;
+
+    static bool ValidateStructure(std::string_view json) {
+        uint64_t stack[MaxDepth/64];
+        size_t   depth = 0;
+        uint64_t prev_escaped = 0; /* 1 if the first byte of the next block is escaped */
+        uint64_t prev_inside  = 0; /* all ones if the next block starts inside a string */
+        const char* ptr = json.data();
+        size_t remaining = json.size();
+        char last_block[64];
+        while(remaining) {
+            const char* block = ptr;
+            size_t size = 64;
+            if(remaining < 64) {
+                std::memset(last_block, 0, 64);
+                std::memcpy(last_block, ptr, remaining);
+                block = last_block;
+                size = remaining;
+            }
+            Masks masks = FindCharacters(block);
+            uint64_t escaped = FindEscaped(masks.backslash, prev_escaped);
+            uint64_t inside  = PrefixXor(masks.quote & ~escaped) ^ prev_inside;
+            prev_inside = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+            uint64_t brackets = (masks.open | masks.close) & ~escaped & ~inside;
+            while(brackets) {
+                auto i = static_cast<size_t>(__builtin_ctzll(brackets));
+                brackets &= brackets - 1;
+                uint64_t curly = (block[i] & 0x20) ? 1 : 0;
+                if((masks.open >> i) & 1) {
+                    if(depth == MaxDepth) return ValidateStructureByteByByte(json);
+                    auto& word = stack[depth/64];
+                    auto bit = uint64_t{1} << (depth % 64);
+                    word = curly ? (word | bit) : (word & ~bit);
+                    depth += 1;
+                } else {
+                    /* extra or mismatched closing bracket */
+                    if(depth == 0) return false;
+                    depth -= 1;
+                    if(((stack[depth/64] >> (depth % 64)) & 1) != curly) return false;
+                }
+            }
+            ptr += size;
+            remaining -= size;
+        }
+        return depth == 0;
+    }
+
+    /**
+     * @brief Reference algorithm, one character at a time.
+     */
+    static bool ValidateStructureByteByByte(std::string_view json) {
+        std::vector<char> brackets;
+        bool insideString = false;
+        bool escaped = false;
+
+        for (char c : json) {
+            if (!escaped) {
+                if (c == '"') {
+                    insideString = !insideString;
+                } else if (!insideString) {
+                    if (c == '{' || c == '[') {
+                        brackets.push_back(c);
+                    } else if (c == '}' || c == ']') {
+                        if (brackets.empty()) {
+                            // Extra closing bracket encountered
+                            return false;
+                        }
+                        char top = brackets.back();
+                        brackets.pop_back();
+
+                        if ((c == '}' && top != '{') || (c == ']' && top != '[')) {
+                            // Mismatched brackets
+                            return false;
+                        }
+                    }
+                }
+            }
+
+            if (c == '\\') {
+                escaped = !escaped;
+            } else {
+                escaped = false;
+            }
+        }
+
+        return brackets.empty();
+    }
+
+    private:
+
+    /**
+     * @brief Masks of the characters of a 64-byte block
+     * (bit i corresponds to byte i).
+     */
+    struct Masks {
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t open;  /* '{' or '[' */
+        uint64_t close; /* '}' or ']' */
+    };
+
+    /* '[' and '{', as well as ']' and '}', only differ by the bit 0x20,
+     * so setting this bit finds both kinds of brackets with one comparison */
+
+#if defined(__AVX2__)
+    static Masks FindCharacters(const char* block) {
+        Masks masks = {0, 0, 0, 0};
+        const auto quote = _mm256_set1_epi8('"');
+        const auto backslash = _mm256_set1_epi8('\\');
+        const auto open = _mm256_set1_epi8('{');
+        const auto close = _mm256_set1_epi8('}');
+        const auto lower = _mm256_set1_epi8(0x20);
+        for(int k = 0; k < 2; ++k) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32*k));
+            auto l = _mm256_or_si256(v, lower);
+            auto shift = 32*k;
+            masks.quote     |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)))} << shift;
+            masks.backslash |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)))} << shift;
+            masks.open      |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, open)))} << shift;
+            masks.close     |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, close)))} << shift;
+        }
+        return masks;
+    }
+#elif defined(__SSE2__)
+    static Masks FindCharacters(const char* block) {
+        Masks masks = {0, 0, 0, 0};
+        const auto quote = _mm_set1_epi8('"');
+        const auto backslash = _mm_set1_epi8('\\');
+        const auto open = _mm_set1_epi8('{');
+        const auto close = _mm_set1_epi8('}');
+        const auto lower = _mm_set1_epi8(0x20);
+        for(int k = 0; k < 4; ++k) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16*k));
+            auto l = _mm_or_si128(v, lower);
+            auto shift = 16*k;
+            masks.quote     |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))} << shift;
+            masks.backslash |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)))} << shift;
+            masks.open      |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(l, open)))} << shift;
+            masks.close     |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(l, close)))} << shift;
+        }
+        return masks;
+    }
+#else
+    static Masks FindCharacters(const char* block) {
+        Masks masks = {0, 0, 0, 0};
+        for(int i = 0; i < 64; ++i) {
+            auto c = block[i];
+            auto l = static_cast<char>(c | 0x20);
+            auto bit = uint64_t{1} << i;
+            if(c == '"')  masks.quote |= bit;
+            if(c == '\\') masks.backslash |= bit;
+            if(l == '{')  masks.open |= bit;
+            if(l == '}')  masks.close |= bit;
+        }
+        return masks;
+    }
+#endif
+
+    /**
+     * @brief Returns the mask of the characters preceded by an odd number
+     * of backslashes. prev_escaped carries the state across blocks.
+     */
+    static uint64_t FindEscaped(uint64_t backslash, uint64_t& prev_escaped) {
+        /* a backslash that is itself escaped does not start a sequence */
+        backslash &= ~prev_escaped;
+        uint64_t follows_escape = (backslash << 1) | prev_escaped;
+        /* adding the start of each sequence of backslashes to the sequence
+         * makes the carry end right after it, at a position whose parity
+         * tells whether the length of the sequence is odd */
+        const uint64_t even_bits = 0x5555555555555555ULL;
+        uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+        uint64_t sequences_on_even_bits = odd_starts + backslash;
+        prev_escaped = sequences_on_even_bits < odd_starts ? 1 : 0;
+        uint64_t invert_mask = sequences_on_even_bits << 1;
+        return (even_bits ^ invert_mask) & follows_escape;
+    }
+
+    /**
+     * @brief Bit i of the result is the XOR of bits 0 to i of x,
+     * i.e. whether byte i is after an odd number of quotes.
+     */
+    static uint64_t PrefixXor(uint64_t x) {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+};
+
+}
+
+#endif
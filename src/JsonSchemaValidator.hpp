@@ -0,0 +1,594 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_JSON_SCHEMA_VALIDATOR_H
+#define MOFKA_JSON_SCHEMA_VALIDATOR_H
+
+#include "RapidJsonUtil.hpp"
+#include "mofka/Metadata.hpp"
+#include "mofka/Validator.hpp"
+#include "mofka/Json.hpp"
+#include "MetadataImpl.hpp"
+
+#include <rapidjson/reader.h>
+#include <rapidjson/writer.h>
+#include <fmt/format.h>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief Validator checking that the metadata of each event matches
+ * a JSON schema. The schema is compiled once, when the Validator is
+ * created, into a tree of nodes with constant-time property lookup.
+ * Events are then validated during a SAX parse of their metadata,
+ * without building a Document, and the parse stops at the first error.
+ *
+ * The compiled validator supports the following keywords: type,
+ * properties, required, additionalProperties, items (single schema),
+ * minItems, maxItems, minLength, maxLength, minimum, maximum,
+ * exclusiveMinimum, exclusiveMaximum (boolean or number), enum and
+ * const (scalar values), as well as the annotations (title,
+ * description, etc.). The "mode" can be:
+ * - "sax": always use the compiled validator, and refuse schemas
+ *   using other keywords;
+ * - "dom": parse the metadata into a Document and validate it with
+ *   valijson, which supports the whole JSON schema specification;
+ * - "auto" (default): use "sax" if the schema only uses supported
+ *   keywords, "dom" otherwise.
+ *
+ * Example of Metadata:
+ * { "__type__": "json_schema",
+ *   "mode": "auto",
+ *   "schema": {
+ *     "type": "object",
+ *     "properties": {
+ *       "name": { "type": "string", "maxLength": 64 },
+ *       "energy": { "type": "number", "minimum": 0 }
+ *     },
+ *     "required": ["name"]
+ *   }
+ * }
+ */
+class JsonSchemaValidator : public ValidatorInterface {
+
+    struct Node;
+
+    public:
+
+    JsonSchemaValidator(const rapidjson::Value& schema, std::string mode)
+    : m_mode(std::move(mode)) {
+        m_schema.CopyFrom(schema, m_schema.GetAllocator());
+        if(m_mode != "dom") {
+            try {
+                m_root = compile(m_schema, "");
+                return;
+            } catch(const UnsupportedKeyword& ex) {
+                if(m_mode == "sax")
+                    throw Exception{fmt::format(
+                        "Unsupported keyword \"{}\" in schema of json_schema Validator"
+                        " with \"sax\" mode (use \"dom\" or \"auto\" mode instead)", ex.keyword)};
+                m_nodes.clear();
+            }
+        }
+        std::string schema_str;
+        StringWrapper buffer{schema_str};
+        rapidjson::Writer<StringWrapper> writer{buffer};
+        m_schema.Accept(writer);
+        try {
+            m_dom_validator = std::make_unique<RapidJsonValidator>(schema_str.c_str());
+        } catch(const std::exception& ex) {
+            throw Exception{fmt::format(
+                "Invalid schema for json_schema Validator: {}", ex.what())};
+        }
+    }
+
+    void validate(const Metadata& metadata, const Data& data) const override {
+        (void)data;
+        if(m_dom_validator) {
+            validateDocument(metadata);
+            return;
+        }
+        thread_local SAXState state;
+        auto& str = metadata.string();
+        SAXChecker checker{m_root, state};
+        rapidjson::StringStream stream{str.c_str()};
+        if(state.reader.Parse(stream, checker)) return;
+        if(!checker.error.empty())
+            throw InvalidMetadata{fmt::format(
+                "Metadata does not match the schema of the topic: {}", checker.error)};
+        throw InvalidMetadata{"Metadata object does not contain valid JSON metadata"};
+    }
+
+    Metadata metadata() const override {
+        rapidjson::Document doc;
+        doc.SetObject();
+        auto& allocator = doc.GetAllocator();
+        doc.AddMember("__type__", "json_schema", allocator);
+        doc.AddMember("mode", rapidjson::Value{m_mode.c_str(), allocator}, allocator);
+        doc.AddMember("schema", rapidjson::Value{m_schema, allocator}, allocator);
+        return Metadata{std::move(doc)};
+    }
+
+    static std::unique_ptr<ValidatorInterface> create(const Metadata& metadata) {
+        auto& json = metadata.json();
+        if(!json.HasMember("schema") || !(json["schema"].IsObject() || json["schema"].IsBool()))
+            throw Exception{"Invalid or missing \"schema\" for json_schema Validator (expected object or boolean)"};
+        std::string mode = "auto";
+        if(json.HasMember("mode")) {
+            auto& m = json["mode"];
+            if(!m.IsString())
+                throw Exception{"Invalid \"mode\" for json_schema Validator (expected string)"};
+            mode = m.GetString();
+            if(mode != "auto" && mode != "sax" && mode != "dom")
+                throw Exception{"Invalid \"mode\" for json_schema Validator (expected \"auto\", \"sax\", or \"dom\")"};
+        }
+        return std::make_unique<JsonSchemaValidator>(json["schema"], std::move(mode));
+    }
+
+    private:
+
+    enum TypeMask : uint8_t {
+        NullType    = 0x01,
+        BooleanType = 0x02,
+        IntegerType = 0x04,
+        NumberType  = 0x08, /* a value of type integer is also of type number */
+        StringType  = 0x10,
+        ArrayType   = 0x20,
+        ObjectType  = 0x40,
+        AnyType     = 0x7f
+    };
+
+    static constexpr size_t NoBit = std::numeric_limits<size_t>::max();
+
+    struct Property {
+        const Node* schema   = nullptr; /* nullptr if the property is unconstrained */
+        bool        declared = false;   /* the property appears in "properties" */
+        size_t      bit      = NoBit;   /* index among the required properties */
+    };
+
+    /**
+     * @brief Compiled form of a (sub)schema. A nullptr Node accepts any value.
+     * The string_views and Value pointers refer to m_schema.
+     */
+    struct Node {
+        uint8_t                                        types = AnyType;
+        std::unordered_map<std::string_view, Property> properties;
+        std::vector<std::string_view>                  required;
+        bool                                           additional = true;
+        const Node*                                    additional_schema = nullptr;
+        const Node*                                    items = nullptr;
+        size_t                                         min_items = 0;
+        size_t                                         max_items = std::numeric_limits<size_t>::max();
+        size_t                                         min_length = 0;
+        size_t                                         max_length = std::numeric_limits<size_t>::max();
+        double                                         minimum = -std::numeric_limits<double>::infinity();
+        double                                         maximum = std::numeric_limits<double>::infinity();
+        double                                         exclusive_minimum = -std::numeric_limits<double>::infinity();
+        double                                         exclusive_maximum = std::numeric_limits<double>::infinity();
+        bool                                           has_enum = false;
+        std::vector<const rapidjson::Value*>           enumeration;
+    };
+
+    struct UnsupportedKeyword {
+        std::string keyword;
+    };
+
+    static bool IsAnnotation(std::string_view keyword) {
+        return keyword == "$schema" || keyword == "$id" || keyword == "id"
+            || keyword == "$comment" || keyword == "title" || keyword == "description"
+            || keyword == "default" || keyword == "examples" || keyword == "deprecated"
+            || keyword == "readOnly" || keyword == "writeOnly";
+    }
+
+    static uint8_t TypeFromName(std::string_view name, const std::string& where) {
+        if(name == "null")    return NullType;
+        if(name == "boolean") return BooleanType;
+        if(name == "integer") return IntegerType;
+        if(name == "number")  return NumberType | IntegerType;
+        if(name == "string")  return StringType;
+        if(name == "array")   return ArrayType;
+        if(name == "object")  return ObjectType;
+        throw Exception{fmt::format(
+            "Invalid type \"{}\" in schema of json_schema Validator at \"{}\"", name, where)};
+    }
+
+    static std::string TypeNames(uint8_t types) {
+        static const std::pair<uint8_t, const char*> names[] = {
+            {NullType, "null"}, {BooleanType, "boolean"}, {NumberType, "number"},
+            {IntegerType, "integer"}, {StringType, "string"}, {ArrayType, "array"},
+            {ObjectType, "object"}};
+        std::string result;
+        for(auto& [type, name] : names) {
+            if(!(types & type)) continue;
+            /* number implies integer */
+            if(type == IntegerType && (types & NumberType)) continue;
+            if(!result.empty()) result += " or ";
+            result += name;
+        }
+        return result.empty() ? "no value" : result;
+    }
+
+    static size_t SizeOf(const rapidjson::Value& value, const char* keyword, const std::string& where) {
+        if(!value.IsUint64())
+            throw Exception{fmt::format(
+                "Invalid \"{}\" in schema of json_schema Validator at \"{}\" (expected non-negative integer)",
+                keyword, where)};
+        return value.GetUint64();
+    }
+
+    static double NumberOf(const rapidjson::Value& value, const char* keyword, const std::string& where) {
+        if(!value.IsNumber())
+            throw Exception{fmt::format(
+                "Invalid \"{}\" in schema of json_schema Validator at \"{}\" (expected number)",
+                keyword, where)};
+        return value.GetDouble();
+    }
+
+    const Node* compile(const rapidjson::Value& schema, const std::string& where) {
+        if(schema.IsBool()) {
+            if(schema.GetBool()) return nullptr;
+            auto& node = m_nodes.emplace_back();
+            node.types = 0;
+            return &node;
+        }
+        if(!schema.IsObject())
+            throw Exception{fmt::format(
+                "Invalid schema for json_schema Validator at \"{}\" (expected object or boolean)", where)};
+        auto& node = m_nodes.emplace_back();
+        bool exclusive_minimum = false, exclusive_maximum = false; /* draft-04 booleans */
+        for(auto& member : schema.GetObject()) {
+            auto keyword = std::string_view{member.name.GetString(), member.name.GetStringLength()};
+            auto& value = member.value;
+            if(keyword == "type") {
+                if(value.IsString()) {
+                    node.types = TypeFromName(value.GetString(), where);
+                } else if(value.IsArray()) {
+                    node.types = 0;
+                    for(auto& t : value.GetArray()) {
+                        if(!t.IsString())
+                            throw Exception{fmt::format(
+                                "Invalid \"type\" in schema of json_schema Validator at \"{}\"", where)};
+                        node.types |= TypeFromName(t.GetString(), where);
+                    }
+                } else {
+                    throw Exception{fmt::format(
+                        "Invalid \"type\" in schema of json_schema Validator at \"{}\"", where)};
+                }
+            } else if(keyword == "properties") {
+                if(!value.IsObject())
+                    throw Exception{fmt::format(
+                        "Invalid \"properties\" in schema of json_schema Validator at \"{}\" (expected object)",
+                        where)};
+                for(auto& p : value.GetObject()) {
+                    auto name = std::string_view{p.name.GetString(), p.name.GetStringLength()};
+                    auto& property = node.properties[name];
+                    property.schema = compile(p.value, fmt::format("{}/properties/{}", where, name));
+                    property.declared = true;
+                }
+            } else if(keyword == "required") {
+                if(!value.IsArray())
+                    throw Exception{fmt::format(
+                        "Invalid \"required\" in schema of json_schema Validator at \"{}\" (expected array)",
+                        where)};
+                for(auto& r : value.GetArray()) {
+                    if(!r.IsString())
+                        throw Exception{fmt::format(
+                            "Invalid \"required\" in schema of json_schema Validator at \"{}\" (expected strings)",
+                            where)};
+                    auto name = std::string_view{r.GetString(), r.GetStringLength()};
+                    auto& property = node.properties[name];
+                    if(property.bit != NoBit) continue;
+                    property.bit = node.required.size();
+                    node.required.push_back(name);
+                }
+            } else if(keyword == "additionalProperties") {
+                if(value.IsBool() && !value.GetBool())
+                    node.additional = false;
+                else
+                    node.additional_schema = compile(value, where + "/additionalProperties");
+            } else if(keyword == "items") {
+                if(value.IsArray()) throw UnsupportedKeyword{"items (array form)"};
+                node.items = compile(value, where + "/items");
+            } else if(keyword == "minItems") {
+                node.min_items = SizeOf(value, "minItems", where);
+            } else if(keyword == "maxItems") {
+                node.max_items = SizeOf(value, "maxItems", where);
+            } else if(keyword == "minLength") {
+                node.min_length = SizeOf(value, "minLength", where);
+            } else if(keyword == "maxLength") {
+                node.max_length = SizeOf(value, "maxLength", where);
+            } else if(keyword == "minimum") {
+                node.minimum = NumberOf(value, "minimum", where);
+            } else if(keyword == "maximum") {
+                node.maximum = NumberOf(value, "maximum", where);
+            } else if(keyword == "exclusiveMinimum") {
+                if(value.IsBool()) exclusive_minimum = value.GetBool();
+                else node.exclusive_minimum = NumberOf(value, "exclusiveMinimum", where);
+            } else if(keyword == "exclusiveMaximum") {
+                if(value.IsBool()) exclusive_maximum = value.GetBool();
+                else node.exclusive_maximum = NumberOf(value, "exclusiveMaximum", where);
+            } else if(keyword == "enum" || keyword == "const") {
+                if(keyword == "enum" && !value.IsArray())
+                    throw Exception{fmt::format(
+                        "Invalid \"enum\" in schema of json_schema Validator at \"{}\" (expected array)",
+                        where)};
+                auto add = [&node](const rapidjson::Value& v) {
+                    if(v.IsObject() || v.IsArray())
+                        throw UnsupportedKeyword{"enum/const (non-scalar values)"};
+                    node.enumeration.push_back(&v);
+                };
+                if(node.has_enum) throw UnsupportedKeyword{"enum and const together"};
+                if(keyword == "const") add(value);
+                else for(auto& v : value.GetArray()) add(v);
+                node.has_enum = true;
+            } else if(!IsAnnotation(keyword)) {
+                throw UnsupportedKeyword{std::string{keyword}};
+            }
+        }
+        if(exclusive_minimum) {
+            node.exclusive_minimum = node.minimum;
+            node.minimum = -std::numeric_limits<double>::infinity();
+        }
+        if(exclusive_maximum) {
+            node.exclusive_maximum = node.maximum;
+            node.maximum = std::numeric_limits<double>::infinity();
+        }
+        return &node;
+    }
+
+    /**
+     * @brief Object or array being parsed.
+     */
+    struct Frame {
+        const Node* node   = nullptr;
+        bool        object = false;
+        const Node* next   = nullptr; /* object: schema of the value after the current key */
+        std::string key;              /* object: current key */
+        size_t      index  = 0;       /* array: number of elements seen */
+        size_t      seen   = 0;       /* object: offset of its required flags in SAXState::seen */
+    };
+
+    /**
+     * @brief Per-thread state reused across validations, so that
+     * validating an event does not allocate memory once warmed up.
+     */
+    struct SAXState {
+        rapidjson::Reader    reader;
+        std::vector<Frame>   frames;
+        std::vector<uint8_t> seen; /* flags of the required properties found in the open objects */
+    };
+
+    /**
+     * @brief SAX handler checking the events of the parse against the
+     * compiled schema. Returning false from a callback stops the parse,
+     * with the reason in error (empty if the JSON itself is invalid).
+     */
+    struct SAXChecker {
+
+        const Node* root;
+        SAXState&   state;
+        size_t      depth = 0;
+        std::string error;
+
+        SAXChecker(const Node* r, SAXState& s)
+        : root(r), state(s) {
+            state.seen.clear();
+        }
+
+        /* returns the schema of the value that starts */
+        const Node* next() {
+            if(depth == 0) return root;
+            auto& frame = state.frames[depth-1];
+            if(frame.object) return frame.next;
+            frame.index += 1;
+            return frame.node ? frame.node->items : nullptr;
+        }
+
+        Frame& push(const Node* node, bool object) {
+            if(state.frames.size() == depth) state.frames.emplace_back();
+            auto& frame = state.frames[depth++];
+            frame.node   = node;
+            frame.object = object;
+            frame.next   = nullptr;
+            frame.key.clear();
+            frame.index  = 0;
+            frame.seen   = state.seen.size();
+            return frame;
+        }
+
+        /* JSON pointer to the value in the levels outermost frames */
+        std::string path(size_t levels) const {
+            std::string result;
+            for(size_t i = 0; i < levels; ++i) {
+                auto& frame = state.frames[i];
+                if(frame.object) result += "/" + frame.key;
+                else result += "/" + std::to_string(frame.index - 1);
+            }
+            return result;
+        }
+
+        bool fail(std::string_view reason, size_t levels) {
+            error = fmt::format("{} at \"{}\"", reason, path(levels));
+            return false;
+        }
+
+        bool checkType(const Node* node, uint8_t type) {
+            if(node->types & type) return true;
+            return fail(fmt::format("expected {}", TypeNames(node->types)), depth);
+        }
+
+        bool checkEnum(const Node* node, const rapidjson::Value& value) {
+            if(!node->has_enum) return true;
+            for(auto v : node->enumeration)
+                if(*v == value) return true;
+            return fail("value not in enum", depth);
+        }
+
+        bool checkNumber(const Node* node, double value) {
+            if(value < node->minimum)
+                return fail(fmt::format("expected value >= {}", node->minimum), depth);
+            if(value > node->maximum)
+                return fail(fmt::format("expected value <= {}", node->maximum), depth);
+            if(value <= node->exclusive_minimum)
+                return fail(fmt::format("expected value > {}", node->exclusive_minimum), depth);
+            if(value >= node->exclusive_maximum)
+                return fail(fmt::format("expected value < {}", node->exclusive_maximum), depth);
+            return true;
+        }
+
+        template<typename T>
+        bool integer(T i) {
+            auto node = next();
+            if(!node) return true;
+            return checkType(node, IntegerType)
+                && checkNumber(node, static_cast<double>(i))
+                && checkEnum(node, rapidjson::Value{i});
+        }
+
+        bool Null() {
+            auto node = next();
+            return !node || (checkType(node, NullType) && checkEnum(node, rapidjson::Value{}));
+        }
+
+        bool Bool(bool b) {
+            auto node = next();
+            return !node || (checkType(node, BooleanType) && checkEnum(node, rapidjson::Value{b}));
+        }
+
+        bool Int(int i) { return integer(static_cast<int64_t>(i)); }
+        bool Uint(unsigned u) { return integer(static_cast<uint64_t>(u)); }
+        bool Int64(int64_t i) { return integer(i); }
+        bool Uint64(uint64_t u) { return integer(u); }
+
+        bool Double(double d) {
+            auto node = next();
+            if(!node) return true;
+            /* 1.0 is a valid integer in JSON schema */
+            auto type = (std::isfinite(d) && std::floor(d) == d) ? IntegerType : NumberType;
+            return checkType(node, type)
+                && checkNumber(node, d)
+                && checkEnum(node, rapidjson::Value{d});
+        }
+
+        bool RawNumber(const char*, rapidjson::SizeType, bool) {
+            return false; /* not produced without kParseNumbersAsStringsFlag */
+        }
+
+        bool String(const char* str, rapidjson::SizeType length, bool) {
+            auto node = next();
+            if(!node) return true;
+            if(!checkType(node, StringType)) return false;
+            if(node->min_length != 0 || node->max_length != std::numeric_limits<size_t>::max()) {
+                /* lengths are in code points: count the bytes that do not continue a sequence */
+                size_t count = 0;
+                for(rapidjson::SizeType i = 0; i < length; ++i)
+                    count += (static_cast<uint8_t>(str[i]) & 0xC0) != 0x80;
+                if(count < node->min_length)
+                    return fail(fmt::format("expected string of at least {} characters", node->min_length), depth);
+                if(count > node->max_length)
+                    return fail(fmt::format("expected string of at most {} characters", node->max_length), depth);
+            }
+            return checkEnum(node, rapidjson::Value{rapidjson::StringRef(str, length)});
+        }
+
+        bool StartObject() {
+            auto node = next();
+            if(node && !checkType(node, ObjectType)) return false;
+            push(node, true);
+            if(node) state.seen.resize(state.seen.size() + node->required.size(), 0);
+            return true;
+        }
+
+        bool Key(const char* str, rapidjson::SizeType length, bool) {
+            auto& frame = state.frames[depth-1];
+            frame.key.assign(str, length);
+            frame.next = nullptr;
+            if(!frame.node) return true;
+            auto it = frame.node->properties.find(std::string_view{str, length});
+            if(it != frame.node->properties.end()) {
+                auto& property = it->second;
+                if(property.bit != NoBit) state.seen[frame.seen + property.bit] = 1;
+                if(property.declared) {
+                    frame.next = property.schema;
+                    return true;
+                }
+            }
+            if(!frame.node->additional)
+                return fail("additional property not allowed", depth);
+            frame.next = frame.node->additional_schema;
+            return true;
+        }
+
+        bool EndObject(rapidjson::SizeType) {
+            auto& frame = state.frames[depth-1];
+            if(frame.node) {
+                for(size_t i = 0; i < frame.node->required.size(); ++i) {
+                    if(state.seen[frame.seen + i]) continue;
+                    return fail(fmt::format("missing required property \"{}\"",
+                                            frame.node->required[i]), depth - 1);
+                }
+            }
+            state.seen.resize(frame.seen);
+            depth -= 1;
+            return true;
+        }
+
+        bool StartArray() {
+            auto node = next();
+            if(node && !checkType(node, ArrayType)) return false;
+            push(node, false);
+            return true;
+        }
+
+        bool EndArray(rapidjson::SizeType count) {
+            auto& frame = state.frames[depth-1];
+            if(frame.node) {
+                if(count < frame.node->min_items)
+                    return fail(fmt::format("expected at least {} items", frame.node->min_items), depth - 1);
+                if(count > frame.node->max_items)
+                    return fail(fmt::format("expected at most {} items", frame.node->max_items), depth - 1);
+            }
+            depth -= 1;
+            return true;
+        }
+    };
+
+    void validateDocument(const Metadata& metadata) const {
+        const rapidjson::Document* doc = nullptr;
+        try {
+            doc = &metadata.json();
+        } catch(const Exception&) {
+            throw InvalidMetadata{"Metadata object does not contain valid JSON metadata"};
+        }
+        auto errors = m_dom_validator->validate(*doc);
+        if(errors.empty()) return;
+        std::string reason;
+        for(auto& e : errors) {
+            if(!reason.empty()) reason += "; ";
+            reason += e;
+        }
+        throw InvalidMetadata{fmt::format(
+            "Metadata does not match the schema of the topic: {}", reason)};
+    }
+
+    std::string                         m_mode;
+    rapidjson::Document                 m_schema;
+    std::deque<Node>                    m_nodes;   /* compiled schema (stable addresses) */
+    const Node*                         m_root = nullptr;
+    std::unique_ptr<RapidJsonValidator> m_dom_validator; /* set if the DOM validation is used */
+};
+
+}
+
+#endif
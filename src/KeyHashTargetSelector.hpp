@@ -0,0 +1,219 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_KEY_HASH_TARGET_SELECTOR_H
+#define MOFKA_KEY_HASH_TARGET_SELECTOR_H
+
+#include "mofka/Metadata.hpp"
+#include "mofka/TargetSelector.hpp"
+#include "mofka/Json.hpp"
+#include "MetadataImpl.hpp"
+#include "RapidJsonUtil.hpp"
+
+#include <rapidjson/reader.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief TargetSelector sending the events with the same key to the
+ * same target. The key is the value of a field of the metadata given
+ * by a dot-separated path (e.g. "user.id"), extracted by a SAX parse
+ * that stops as soon as the field is found. Keys are mapped to targets
+ * through a consistent-hash ring in which each target is placed at
+ * "virtual_nodes" points derived from its UUID, so that adding or
+ * removing a target only remaps the keys of the ring segments it
+ * takes over or gives up. Events without the field (or where it is
+ * an object or an array) are sent to the targets in round-robin.
+ *
+ * Example of Metadata:
+ * { "__type__": "key_hash", "key": "user.id", "virtual_nodes": 64 }
+ */
+class KeyHashTargetSelector : public TargetSelectorInterface {
+
+    public:
+
+    static constexpr size_t DefaultVirtualNodes = 64;
+
+    KeyHashTargetSelector(std::string key, size_t virtual_nodes)
+    : m_key(std::move(key))
+    , m_virtual_nodes(virtual_nodes) {
+        std::string_view path = m_key;
+        while(true) {
+            auto pos = path.find('.');
+            m_path.emplace_back(path.substr(0, pos));
+            if(pos == std::string_view::npos) break;
+            path.remove_prefix(pos + 1);
+        }
+    }
+
+    void setTargets(const std::vector<PartitionTargetInfo>& targets) override {
+        m_targets = targets;
+        m_ring.clear();
+        m_ring.reserve(targets.size()*m_virtual_nodes);
+        for(size_t i = 0; i < targets.size(); ++i) {
+            auto uuid = targets[i].uuid().to_string();
+            for(size_t j = 0; j < m_virtual_nodes; ++j) {
+                auto point = Hash(fmt::format("{}#{}", uuid, j));
+                m_ring.emplace_back(point, i);
+            }
+        }
+        std::sort(m_ring.begin(), m_ring.end());
+    }
+
+    PartitionTargetInfo selectTargetFor(const Metadata& metadata) override {
+        if(m_targets.size() == 0)
+            throw Exception("TargetSelector has no target to select from");
+        std::string key;
+        if(!extractKey(metadata.string(), key))
+            return m_targets[m_next_index++ % m_targets.size()];
+        auto it = std::lower_bound(
+            m_ring.begin(), m_ring.end(),
+            std::make_pair(Hash(key), size_t{0}));
+        if(it == m_ring.end()) it = m_ring.begin();
+        return m_targets[it->second];
+    }
+
+    Metadata metadata() const override {
+        rapidjson::Document doc;
+        doc.SetObject();
+        auto& allocator = doc.GetAllocator();
+        doc.AddMember("__type__", "key_hash", allocator);
+        doc.AddMember("key", rapidjson::Value{m_key.c_str(), allocator}, allocator);
+        doc.AddMember("virtual_nodes", static_cast<uint64_t>(m_virtual_nodes), allocator);
+        return Metadata{std::move(doc)};
+    }
+
+    static std::unique_ptr<TargetSelectorInterface> create(const Metadata& metadata) {
+        auto& json = metadata.json();
+        if(!json.HasMember("key") || !json["key"].IsString()
+        || json["key"].GetStringLength() == 0)
+            throw Exception{"Invalid or missing \"key\" for key_hash TargetSelector (expected non-empty string)"};
+        size_t virtual_nodes = DefaultVirtualNodes;
+        if(json.HasMember("virtual_nodes")) {
+            auto& v = json["virtual_nodes"];
+            if(!v.IsUint64() || v.GetUint64() == 0)
+                throw Exception{"Invalid \"virtual_nodes\" for key_hash TargetSelector (expected positive integer)"};
+            virtual_nodes = v.GetUint64();
+        }
+        return std::make_unique<KeyHashTargetSelector>(json["key"].GetString(), virtual_nodes);
+    }
+
+    private:
+
+    /**
+     * @brief 64-bit FNV-1a hash followed by a finalizer spreading the bits.
+     * The hash must not depend on the platform or the standard library,
+     * since all the producers of a topic must map a key to the same target.
+     */
+    static uint64_t Hash(std::string_view str) {
+        uint64_t h = 14695981039346656037ULL;
+        for(auto c : str) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9a64a5b87bbULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * @brief SAX handler looking for the value at m_path. Numbers are
+     * parsed as strings, so the key of 42 and 42.0 differ but the key of
+     * a number does not depend on its floating-point representation.
+     * Returning false from a callback stops the parse.
+     */
+    struct KeyExtractor : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, KeyExtractor> {
+
+        const std::vector<std::string>& path;
+        std::string&                    key;
+        bool                            found = false;
+        size_t                          depth = 0;   /* current nesting level of objects and arrays */
+        size_t                          matched = 0; /* number of components of path matched */
+        bool                            at_value = false;      /* the next value is the one at path */
+        bool                            expect_object = false; /* the next value should contain the rest of path */
+
+        KeyExtractor(const std::vector<std::string>& p, std::string& k)
+        : path(p), key(k) {}
+
+        bool scalar(const char* str, size_t length) {
+            if(at_value) {
+                key.assign(str, length);
+                found = true;
+            }
+            return !(at_value || expect_object);
+        }
+
+        bool Default() { return !(at_value || expect_object); }
+        bool Null() { return scalar("null", 4); }
+        bool Bool(bool b) { return b ? scalar("true", 4) : scalar("false", 5); }
+        bool RawNumber(const char* str, rapidjson::SizeType length, bool) {
+            return scalar(str, length);
+        }
+        bool String(const char* str, rapidjson::SizeType length, bool) {
+            return scalar(str, length);
+        }
+        bool StartObject() {
+            if(at_value) return false;
+            expect_object = false;
+            depth += 1;
+            return true;
+        }
+        bool Key(const char* str, rapidjson::SizeType length, bool) {
+            if(depth == matched + 1 && matched < path.size()
+            && path[matched].size() == length
+            && std::equal(str, str + length, path[matched].begin())) {
+                matched += 1;
+                at_value = (matched == path.size());
+                expect_object = !at_value;
+            }
+            return true;
+        }
+        bool EndObject(rapidjson::SizeType) {
+            /* leaving the object in which the next component of path was expected */
+            if(depth == matched + 1 && matched > 0) return false;
+            depth -= 1;
+            return true;
+        }
+        bool StartArray() {
+            if(at_value || expect_object) return false;
+            depth += 1;
+            return true;
+        }
+        bool EndArray(rapidjson::SizeType) {
+            depth -= 1;
+            return true;
+        }
+    };
+
+    bool extractKey(const std::string& json, std::string& key) const {
+        KeyExtractor handler{m_path, key};
+        rapidjson::Reader reader;
+        rapidjson::StringStream stream{json.c_str()};
+        reader.Parse<rapidjson::kParseNumbersAsStringsFlag
+                   | rapidjson::kParseStopWhenDoneFlag>(stream, handler);
+        return handler.found;
+    }
+
+    std::string                          m_key;
+    std::vector<std::string>             m_path;
+    size_t                               m_virtual_nodes;
+    std::vector<PartitionTargetInfo>     m_targets;
+    std::vector<std::pair<uint64_t, size_t>> m_ring; /* sorted points of the ring and index of their target */
+    std::atomic<size_t>                  m_next_index = 0;
+};
+
+}
+
+#endif
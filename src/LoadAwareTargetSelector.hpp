@@ -0,0 +1,195 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_LOAD_AWARE_TARGET_SELECTOR_H
+#define MOFKA_LOAD_AWARE_TARGET_SELECTOR_H
+
+#include "mofka/Metadata.hpp"
+#include "mofka/TargetSelector.hpp"
+#include "mofka/Json.hpp"
+#include "MetadataImpl.hpp"
+#include "PartitionTargetInfoImpl.hpp"
+#include "RapidJsonUtil.hpp"
+
+#include <fmt/format.h>
+#include <unistd.h>
+#include <limits.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief TargetSelector sending each event to the target with the
+ * smallest expected delay, estimated from the feedback of the producers:
+ * (number of events sent to the target and not yet acknowledged + 1)
+ * x (moving average of the round-trip time of its batches). A slow or
+ * overloaded provider thus receives less traffic.
+ *
+ * With "prefer_local", the delay of targets that are not on the local
+ * node is multiplied by "remote_penalty". A target is considered local
+ * if its address uses shared memory (e.g. na+sm), or if its host is the
+ * loopback interface or the hostname of the node.
+ *
+ * Example of Metadata:
+ * { "__type__": "load_aware", "prefer_local": true, "remote_penalty": 4.0 }
+ */
+class LoadAwareTargetSelector : public TargetSelectorInterface {
+
+    public:
+
+    static constexpr double DefaultRemotePenalty = 4.0;
+
+    LoadAwareTargetSelector(bool prefer_local, double remote_penalty)
+    : m_prefer_local(prefer_local)
+    , m_remote_penalty(remote_penalty) {}
+
+    void setTargets(const std::vector<PartitionTargetInfo>& targets) override {
+        m_targets = targets;
+        m_stats = std::make_unique<Stats[]>(targets.size());
+        m_indices.clear();
+        for(size_t i = 0; i < targets.size(); ++i) {
+            m_indices[targets[i]] = i;
+            m_stats[i].penalty = (m_prefer_local && !isLocal(targets[i]))
+                               ? m_remote_penalty : 1.0;
+        }
+    }
+
+    PartitionTargetInfo selectTargetFor(const Metadata& metadata) override {
+        (void)metadata;
+        if(m_targets.size() == 0)
+            throw Exception("TargetSelector has no target to select from");
+        /* start from a rotating index so that ties are broken in round-robin */
+        auto n = m_targets.size();
+        auto start = m_next_start++ % n;
+        auto best = start;
+        auto best_delay = m_stats[start].expectedDelay();
+        for(size_t k = 1; k < n; ++k) {
+            auto i = (start + k) % n;
+            auto delay = m_stats[i].expectedDelay();
+            if(delay < best_delay) {
+                best = i;
+                best_delay = delay;
+            }
+        }
+        m_stats[best].outstanding += 1;
+        return m_targets[best];
+    }
+
+    void onBatchCompleted(const PartitionTargetInfo& target,
+                          size_t count,
+                          std::chrono::microseconds rtt) override {
+        auto it = m_indices.find(target);
+        if(it == m_indices.end()) return;
+        auto& stats = m_stats[it->second];
+        stats.release(count);
+        /* moving average with a weight of 1/8 for the new sample;
+         * concurrent updates may lose a sample, which is harmless */
+        double sample = std::max<double>(rtt.count(), 1.0);
+        double avg = stats.avg_rtt_us.load(std::memory_order_relaxed);
+        stats.avg_rtt_us.store(avg == 0.0 ? sample : avg + (sample - avg)/8,
+                               std::memory_order_relaxed);
+    }
+
+    void onSelectionCancelled(const PartitionTargetInfo& target) override {
+        auto it = m_indices.find(target);
+        if(it == m_indices.end()) return;
+        m_stats[it->second].release(1);
+    }
+
+    Metadata metadata() const override {
+        return Metadata{fmt::format(
+            "{{\"__type__\":\"load_aware\",\"prefer_local\":{},\"remote_penalty\":{}}}",
+            m_prefer_local, m_remote_penalty)};
+    }
+
+    static std::unique_ptr<TargetSelectorInterface> create(const Metadata& metadata) {
+        auto& json = metadata.json();
+        bool prefer_local = false;
+        double remote_penalty = DefaultRemotePenalty;
+        if(json.HasMember("prefer_local")) {
+            if(!json["prefer_local"].IsBool())
+                throw Exception{"Invalid \"prefer_local\" for load_aware TargetSelector (expected boolean)"};
+            prefer_local = json["prefer_local"].GetBool();
+        }
+        if(json.HasMember("remote_penalty")) {
+            auto& p = json["remote_penalty"];
+            if(!p.IsNumber() || p.GetDouble() < 1.0)
+                throw Exception{"Invalid \"remote_penalty\" for load_aware TargetSelector (expected number >= 1)"};
+            remote_penalty = p.GetDouble();
+        }
+        return std::make_unique<LoadAwareTargetSelector>(prefer_local, remote_penalty);
+    }
+
+    /**
+     * @brief Checks whether a Mercury address designates the local node:
+     * it uses shared memory, or its host is the loopback interface or
+     * the hostname of the node.
+     */
+    static bool IsLocalAddress(std::string_view address) {
+        auto sep = address.find("://");
+        if(sep == std::string_view::npos) return false;
+        auto protocol = address.substr(0, sep);
+        if(protocol == "sm" || protocol.find("+sm") != std::string_view::npos)
+            return true;
+        auto host = address.substr(sep + 3);
+        host = host.substr(0, host.rfind(':'));
+        if(host == "localhost" || host.substr(0, 4) == "127.")
+            return true;
+        char hostname[HOST_NAME_MAX + 1] = {};
+        if(gethostname(hostname, sizeof(hostname)) != 0)
+            return false;
+        return host == std::string_view{hostname};
+    }
+
+    protected:
+
+    /**
+     * @brief Checks whether the target is on the local node.
+     */
+    virtual bool isLocal(const PartitionTargetInfo& target) const {
+        return IsLocalAddress(target.address());
+    }
+
+    private:
+
+    struct Stats {
+
+        std::atomic<size_t> outstanding = 0;  /* events selected and not acknowledged */
+        std::atomic<double> avg_rtt_us  = 0;  /* moving average of the RTT of batches (0 if unknown) */
+        double              penalty     = 1.0;
+
+        void release(size_t count) {
+            /* events selected by another selector (e.g. after setTargets)
+             * must not make the counter wrap around */
+            auto n = outstanding.load();
+            while(!outstanding.compare_exchange_weak(n, n >= count ? n - count : 0)) {}
+        }
+
+        double expectedDelay() const {
+            auto rtt = avg_rtt_us.load(std::memory_order_relaxed);
+            /* until a batch completes, only the number of outstanding events matters */
+            if(rtt == 0.0) rtt = 1.0;
+            return (outstanding.load(std::memory_order_relaxed) + 1) * rtt * penalty;
+        }
+    };
+
+    bool                                           m_prefer_local;
+    double                                         m_remote_penalty;
+    std::vector<PartitionTargetInfo>               m_targets;
+    std::unique_ptr<Stats[]>                       m_stats;      /* statistics of each target in m_targets */
+    std::unordered_map<PartitionTargetInfo, size_t> m_indices;   /* index of each target in m_targets */
+    std::atomic<size_t>                            m_next_start = 0;
+};
+
+}
+
+#endif
@@ -4,8 +4,11 @@
  * See COPYRIGHT in top-level directory.
  */
 #include "MemoryTopicManager.hpp"
+#include "TopicManagerUtil.hpp"
 #include "mofka/DataDescriptor.hpp"
 #include "mofka/BufferWrapperArchive.hpp"
+#include <fmt/format.h>
+#include <cstring>
 #include <numeric>
 #include <iostream>
 
@@ -25,9 +28,34 @@ Metadata MemoryTopicManager::getTargetSelectorMetadata() const {
     return m_selector;
 }
 
+Metadata MemoryTopicManager::getCompressorMetadata() const {
+    return m_compressor.metadata();
+}
+
+void MemoryTopicManager::appendDataDescriptors(EventID first_id) {
+    size_t data_desc_offset = 0;
+    if(!m_events_data_desc_offsets.empty())
+        data_desc_offset = m_events_data_desc_offsets.back() + m_events_data_desc_sizes.back();
+    m_events_data_desc_sizes.resize(m_events_data_sizes.size());
+    m_events_data_desc_offsets.resize(m_events_data_sizes.size());
+    BufferWrapperOutputArchive output_archive{m_events_data_desc};
+    for(size_t i = first_id; i < m_events_data_desc_sizes.size(); ++i) {
+        auto offset_size = OffsetSize{m_events_data_offsets[i], m_events_data_sizes[i]};
+        auto data_descriptor = DataDescriptor::From(offset_size.toString(), offset_size.size);
+        size_t m_events_data_desc_size = m_events_data_desc.size();
+        data_descriptor.save(output_archive);
+        auto data_descriptor_size = m_events_data_desc.size() - m_events_data_desc_size;
+        m_events_data_desc_sizes[i] = data_descriptor_size;
+        m_events_data_desc_offsets[i] = data_desc_offset;
+        data_desc_offset += data_descriptor_size;
+    }
+}
+
 Result<EventID> MemoryTopicManager::receiveBatch(
           const thallium::endpoint& sender,
           const std::string& producer_name,
+          const UUID& producer_id,
+          uint64_t batch_seq,
           size_t num_events,
           const BulkRef& metadata_bulk,
           const BulkRef& data_bulk)
@@ -35,56 +63,58 @@ Result<EventID> MemoryTopicManager::receiveBatch(
     (void)producer_name;
     Result<EventID> result;
     EventID first_id;
+    // --------- transfer and decompress the metadata, if compressed
+    std::vector<char> decompressed_metadata;
+    if(!m_compressor.isPassThrough()) {
+        std::vector<char> compressed_metadata(metadata_bulk.size);
+        auto local_compressed_bulk = m_engine.expose(
+            {{compressed_metadata.data(), compressed_metadata.size()}},
+            thallium::bulk_mode::write_only);
+        local_compressed_bulk << metadata_bulk.handle.on(sender).select(
+            metadata_bulk.offset, metadata_bulk.size);
+        auto decompressed = DecompressBatchMetadata(
+            m_compressor, num_events, {compressed_metadata.data(), compressed_metadata.size()},
+            decompressed_metadata);
+        if(!decompressed.success()) {
+            result.success() = false;
+            result.error() = decompressed.error();
+            return result;
+        }
+    }
     {
         auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
         first_id = m_events_metadata_sizes.size();
-        // --------- transfer the metadata
-        auto metadata_size = metadata_bulk.size - num_events*sizeof(size_t);
-        // resize the sizes and offsets arrays, and metadata array
-        if(m_events_metadata_sizes.capacity() < first_id + num_events) {
-            m_events_metadata_sizes.reserve(2*(first_id + num_events));
+        // --------- skip the batch if it was already appended
+        if(m_deduplicator.find(producer_id, batch_seq, first_id)) {
+            result.value() = first_id;
+            return result;
         }
-        if(m_events_metadata_offsets.capacity() < first_id + num_events) {
-            m_events_metadata_offsets.reserve(2*(first_id + num_events));
-        }
-        m_events_metadata_sizes.resize(first_id + num_events);
-        m_events_metadata_offsets.resize(first_id + num_events);
-        size_t first_metadata_offset = m_events_metadata.size();
-        if(m_events_metadata.capacity() < first_metadata_offset + metadata_size) {
-            m_events_metadata.reserve(2*(first_metadata_offset + metadata_size));
-        }
-        m_events_metadata.resize(first_metadata_offset + metadata_size);
-        // transfer the metadata sizes and content
-        auto local_metadata_bulk = m_engine.expose(
-            {{(char*)(m_events_metadata_sizes.data() + first_id), num_events*sizeof(size_t)},
-             {m_events_metadata.data() + first_metadata_offset, metadata_size}},
-            thallium::bulk_mode::write_only);
-        local_metadata_bulk << metadata_bulk.handle.on(sender).select(
-            metadata_bulk.offset, metadata_bulk.size);
-        // TODO check that metadata_size = sum of m_events_metadata_sizes recveived
-        // update the metadata offsets vector
-        auto metadata_offset = first_metadata_offset;
-        for(size_t i = first_id; i < m_events_metadata_sizes.size(); ++i) {
-            m_events_metadata_offsets[i] = metadata_offset;
-            metadata_offset += m_events_metadata_sizes[i];
+        if(m_compressor.isPassThrough()) {
+            // --------- transfer the metadata
+            auto metadata_size = metadata_bulk.size - num_events*sizeof(size_t);
+            auto first_metadata_offset = GrowPackedEvents(
+                m_events_metadata_sizes, m_events_metadata_offsets, m_events_metadata,
+                num_events, metadata_size);
+            // transfer the metadata sizes and content
+            auto local_metadata_bulk = m_engine.expose(
+                {{(char*)(m_events_metadata_sizes.data() + first_id), num_events*sizeof(size_t)},
+                 {m_events_metadata.data() + first_metadata_offset, metadata_size}},
+                thallium::bulk_mode::write_only);
+            local_metadata_bulk << metadata_bulk.handle.on(sender).select(
+                metadata_bulk.offset, metadata_bulk.size);
+            UpdatePackedOffsets(m_events_metadata_sizes, m_events_metadata_offsets,
+                                first_id, first_metadata_offset);
+        } else {
+            // --------- copy the decompressed metadata
+            AppendPackedEvents(m_events_metadata_sizes, m_events_metadata_offsets, m_events_metadata,
+                               num_events, {decompressed_metadata.data(), decompressed_metadata.size()});
         }
         // --------- transfer the data
         std::unique_lock<thallium::mutex> data_lock{m_events_data_mtx};
         auto data_size = data_bulk.size - num_events*sizeof(size_t);
-        // resize the sizes and offsets arrays, and data array
-        if(m_events_data_sizes.capacity() < first_id + num_events) {
-            m_events_data_sizes.reserve(2*(first_id + num_events));
-        }
-        if(m_events_data_offsets.capacity() < first_id + num_events) {
-            m_events_data_offsets.reserve(2*(first_id + num_events));
-        }
-        m_events_data_sizes.resize(first_id + num_events);
-        m_events_data_offsets.resize(first_id + num_events);
-        size_t first_data_offset = m_events_data.size();
-        if(m_events_data.capacity() < first_data_offset + data_size) {
-            m_events_data.reserve(2*(first_data_offset + data_size));
-        }
-        m_events_data.resize(first_data_offset + data_size);
+        auto first_data_offset = GrowPackedEvents(
+            m_events_data_sizes, m_events_data_offsets, m_events_data,
+            num_events, data_size);
         // transfer the data sizes and content
         auto local_data_bulk = m_engine.expose(
             {{(char*)(m_events_data_sizes.data() + first_id), num_events*sizeof(size_t)},
@@ -92,30 +122,54 @@ Result<EventID> MemoryTopicManager::receiveBatch(
             thallium::bulk_mode::write_only);
         local_data_bulk << data_bulk.handle.on(sender).select(
             data_bulk.offset, data_bulk.size);
-        // TODO check that data_size = sum of m_events_data_sizes recveived
-        // update the data offsets vector
-        auto data_offset = first_data_offset;
-        for(size_t i = first_id; i < m_events_data_sizes.size(); ++i) {
-            m_events_data_offsets[i] = data_offset;
-            data_offset += m_events_data_sizes[i];
-        }
-        // update the DataDescriptor information
-        size_t data_desc_offset = 0;
-        if(!m_events_data_desc_offsets.empty())
-            data_desc_offset = m_events_data_desc_offsets.back() + m_events_data_desc_sizes.back();
-        m_events_data_desc_sizes.resize(first_id + num_events);
-        m_events_data_desc_offsets.resize(first_id + num_events);
-        BufferWrapperOutputArchive output_archive{m_events_data_desc};
-        for(size_t i = first_id; i < m_events_data_desc_sizes.size(); ++i) {
-            auto offset_size = OffsetSize{m_events_data_offsets[i], m_events_data_sizes[i]};
-            auto data_descriptor = DataDescriptor::From(offset_size.toString(), offset_size.size);
-            size_t m_events_data_desc_size = m_events_data_desc.size();
-            data_descriptor.save(output_archive);
-            auto data_descriptor_size = m_events_data_desc.size() - m_events_data_desc_size;
-            m_events_data_desc_sizes[i] = data_descriptor_size;
-            m_events_data_desc_offsets[i] = data_desc_offset;
-            data_desc_offset += data_descriptor_size;
+        UpdatePackedOffsets(m_events_data_sizes, m_events_data_offsets,
+                            first_id, first_data_offset);
+        appendDataDescriptors(first_id);
+        m_deduplicator.record(producer_id, batch_seq, first_id);
+    }
+    m_events_cv.notify_all();
+    result.value() = first_id;
+    return result;
+}
+
+Result<EventID> MemoryTopicManager::receiveEagerBatch(
+          const thallium::endpoint& sender,
+          const std::string& producer_name,
+          const UUID& producer_id,
+          uint64_t batch_seq,
+          size_t num_events,
+          std::string_view metadata,
+          std::string_view data)
+{
+    (void)sender;
+    (void)producer_name;
+    Result<EventID> result;
+    EventID first_id;
+    // --------- decompress the metadata, if compressed, and check the sizes
+    std::vector<char> decompressed_metadata;
+    auto unpacked = UnpackEagerBatch(m_compressor, num_events, metadata, data, decompressed_metadata);
+    if(!unpacked.success()) {
+        result.success() = false;
+        result.error() = unpacked.error();
+        return result;
+    }
+    {
+        auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
+        first_id = m_events_metadata_sizes.size();
+        // --------- skip the batch if it was already appended
+        if(m_deduplicator.find(producer_id, batch_seq, first_id)) {
+            result.value() = first_id;
+            return result;
         }
+        // --------- copy the metadata
+        AppendPackedEvents(m_events_metadata_sizes, m_events_metadata_offsets, m_events_metadata,
+                           num_events, metadata);
+        // --------- copy the data
+        std::unique_lock<thallium::mutex> data_lock{m_events_data_mtx};
+        AppendPackedEvents(m_events_data_sizes, m_events_data_offsets, m_events_data,
+                           num_events, data);
+        appendDataDescriptors(first_id);
+        m_deduplicator.record(producer_id, batch_seq, first_id);
     }
     m_events_cv.notify_all();
     result.value() = first_id;
@@ -123,6 +177,9 @@ Result<EventID> MemoryTopicManager::receiveBatch(
 }
 
 void MemoryTopicManager::wakeUp() {
+    // holding the mutex ensures that a feedConsumer about to
+    // wait on m_events_cv does not miss the notification
+    auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
     m_events_cv.notify_all();
 }
 
@@ -140,6 +197,7 @@ Result<void> MemoryTopicManager::feedConsumer(
     }
 
     auto self_addr = static_cast<std::string>(m_engine.self());
+    std::vector<char> compressed_metadata;
     {
         auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
         while(!consumerHandle.shouldStop()) {
@@ -149,6 +207,10 @@ Result<void> MemoryTopicManager::feedConsumer(
                 // find the number of events we can send
                 size_t max_available_events = m_events_metadata_sizes.size() - first_id;
                 num_events_to_send = std::min(batchSize.value, max_available_events);
+                // limit it to the credits of the consumer
+                if(num_events_to_send != 0)
+                    num_events_to_send = consumerHandle.takeCredits(
+                        m_events_metadata_sizes.data() + first_id, num_events_to_send);
                 should_stop = consumerHandle.shouldStop();
                 if(num_events_to_send != 0 || should_stop) break;
                 m_events_cv.wait(g);
@@ -162,16 +224,35 @@ Result<void> MemoryTopicManager::feedConsumer(
             const auto metadata_size = std::accumulate(
                     metadata_sizes_ptr, metadata_sizes_ptr + num_events_to_send, (size_t)0);
             // create the BulkRefs for the metadata sizes and contents
-            auto metadata_bulk = m_engine.expose(
-                    {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
-                     {metadata_ptr, metadata_size}},
-                    thallium::bulk_mode::read_only);
-            auto metadata_size_bulk_ref = BulkRef{
-                metadata_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
-            };
-            auto metadata_bulk_ref = BulkRef{
-                metadata_bulk, num_events_to_send*sizeof(size_t), metadata_size, self_addr
-            };
+            thallium::bulk metadata_bulk;
+            BulkRef metadata_size_bulk_ref, metadata_bulk_ref;
+            if(m_compressor.isPassThrough()) {
+                metadata_bulk = m_engine.expose(
+                        {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
+                         {metadata_ptr, metadata_size}},
+                        thallium::bulk_mode::read_only);
+                metadata_size_bulk_ref = BulkRef{
+                    metadata_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
+                };
+                metadata_bulk_ref = BulkRef{
+                    metadata_bulk, num_events_to_send*sizeof(size_t), metadata_size, self_addr
+                };
+            } else {
+                // compress the metadata sizes and contents together
+                m_compressor.compress(
+                        {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
+                         {metadata_ptr, metadata_size}},
+                        compressed_metadata);
+                metadata_bulk = m_engine.expose(
+                        {{compressed_metadata.data(), compressed_metadata.size()}},
+                        thallium::bulk_mode::read_only);
+                metadata_size_bulk_ref = BulkRef{
+                    metadata_bulk, 0, 0, self_addr
+                };
+                metadata_bulk_ref = BulkRef{
+                    metadata_bulk, 0, compressed_metadata.size(), self_addr
+                };
+            }
 
             // find the range of descriptor sizes
             const auto descriptors_sizes_ptr = m_events_data_desc_sizes.data() + first_id;
@@ -223,21 +304,29 @@ Result<std::vector<Result<void>>> MemoryTopicManager::getData(
     Result<std::vector<Result<void>>> result;
     result.value().resize(descriptors.size());
 
-    OffsetSize location;
-    location.fromDataDescriptor(descriptors[0]);
-
     auto client = m_engine.lookup(bulk.address);
 
     std::unique_lock<thallium::mutex> lock{m_events_data_mtx};
+    if(m_events_data.empty()) return result;
     auto local_data_bulk = m_engine.expose(
-        {{m_events_data.data() + location.offset, location.size}},
+        {{m_events_data.data(), m_events_data.size()}},
         thallium::bulk_mode::read_only);
-    bulk.handle.on(client) << local_data_bulk;
 
-    if(descriptors.size() != 1) {
-        result.error() = "Expected 1 descriptor";
-        result.success() = false;
-        return result;
+    // the data of the descriptors are written one after the other
+    auto remote_offset = bulk.offset;
+    for(size_t i = 0; i < descriptors.size(); ++i) {
+        OffsetSize location;
+        location.fromDataDescriptor(descriptors[i]);
+        auto size = descriptors[i].size();
+        if(size == 0) continue;
+        try {
+            bulk.handle.on(client)(remote_offset, size)
+                << local_data_bulk(location.offset, size);
+        } catch(const std::exception& ex) {
+            result.value()[i].success() = false;
+            result.value()[i].error() = ex.what();
+        }
+        remote_offset += size;
     }
     return result;
 }
@@ -254,9 +343,11 @@ std::unique_ptr<mofka::TopicManager> MemoryTopicManager::create(
         const Metadata& config,
         const Metadata& validator,
         const Metadata& selector,
-        const Metadata& serializer) {
+        const Metadata& serializer,
+        const Metadata& compressor) {
     return std::unique_ptr<mofka::TopicManager>(
-        new MemoryTopicManager(config, validator, selector, serializer, engine));
+        new MemoryTopicManager(config, validator, selector, serializer,
+                               Compressor::FromMetadata(compressor), engine));
 }
 
 }
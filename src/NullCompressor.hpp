@@ -0,0 +1,48 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_NULL_COMPRESSOR_H
+#define MOFKA_NULL_COMPRESSOR_H
+
+#include "mofka/Compressor.hpp"
+#include <cstring>
+
+namespace mofka {
+
+class NullCompressor : public CompressorInterface {
+
+    public:
+
+    void compress(const std::vector<Data::Segment>& segments,
+                  std::vector<char>& output) const override {
+        size_t size = 0;
+        for(const auto& seg : segments) size += seg.size;
+        output.resize(size);
+        size_t offset = 0;
+        for(const auto& seg : segments) {
+            if(!seg.size) continue;
+            std::memcpy(output.data() + offset, seg.ptr, seg.size);
+            offset += seg.size;
+        }
+    }
+
+    void decompress(const char* input, size_t size,
+                    std::vector<char>& output) const override {
+        output.assign(input, input + size);
+    }
+
+    Metadata metadata() const override {
+        return Metadata{"{\"__type__\":\"null\"}"};
+    }
+
+    static std::unique_ptr<CompressorInterface> create(const Metadata& metadata) {
+        (void)metadata;
+        return std::make_unique<NullCompressor>();
+    }
+};
+
+}
+
+#endif
@@ -13,6 +13,8 @@ namespace mofka {
 
 PIMPL_DEFINE_COMMON_FUNCTIONS_NO_CTOR(PartitionTargetInfo);
 
+PartitionTargetInfo::PartitionTargetInfo() = default;
+
 const std::string& PartitionTargetInfo::address() const {
     return self->m_addr;
 }
@@ -25,4 +27,12 @@ UUID PartitionTargetInfo::uuid() const {
     return self->m_uuid;
 }
 
+bool PartitionTargetInfo::operator==(const PartitionTargetInfo& other) const {
+    return self == other.self;
+}
+
+bool PartitionTargetInfo::operator!=(const PartitionTargetInfo& other) const {
+    return self != other.self;
+}
+
 }
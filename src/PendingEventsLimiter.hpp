@@ -0,0 +1,145 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_PENDING_EVENTS_LIMITER_H
+#define MOFKA_PENDING_EVENTS_LIMITER_H
+
+#include "mofka/MaxPendingEvents.hpp"
+#include "mofka/MaxPendingBytes.hpp"
+
+#include <thallium.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace mofka {
+
+/**
+ * @brief The PendingEventsLimiter counts the events a Producer holds
+ * (and their size in bytes) from the moment they are pushed to the
+ * moment their promise is set, and bounds them by a MaxPendingEvents
+ * and a MaxPendingBytes.
+ *
+ * A group of events is admitted if it fits within both limits, or if
+ * nothing is pending, so that a group larger than the limits does not
+ * block forever.
+ */
+class PendingEventsLimiter {
+
+    public:
+
+    PendingEventsLimiter(MaxPendingEvents max_events, MaxPendingBytes max_bytes)
+    : m_max_events(max_events)
+    , m_max_bytes(max_bytes) {}
+
+    /**
+     * @brief Returns false if both limits are unlimited, in which case
+     * the Producer does not need to count its pending events.
+     */
+    bool enabled() const {
+        return m_max_events != MaxPendingEvents::Unlimited()
+            || m_max_bytes != MaxPendingBytes::Unlimited();
+    }
+
+    /**
+     * @brief Returns true if the size of the events needs to be
+     * computed and passed to the functions below.
+     */
+    bool limitsBytes() const {
+        return m_max_bytes != MaxPendingBytes::Unlimited();
+    }
+
+    /**
+     * @brief Admits the events if they fit, without blocking.
+     * Otherwise counts them as refused and returns false.
+     */
+    bool tryAcquire(size_t events, size_t bytes) {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        if(!fits(events, bytes)) {
+            m_num_refused += events;
+            return false;
+        }
+        m_events += events;
+        m_bytes  += bytes;
+        return true;
+    }
+
+    /**
+     * @brief Blocks until the events fit, then admits them. The on_block
+     * function is called (without the lock held) before blocking, so that
+     * the caller can make the pending events progress.
+     */
+    void acquire(size_t events, size_t bytes, const std::function<void()>& on_block) {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        if(!fits(events, bytes)) {
+            m_num_waiters += 1;
+            guard.unlock();
+            if(on_block) on_block();
+            guard.lock();
+            m_cv.wait(guard, [&]() { return fits(events, bytes); });
+            m_num_waiters -= 1;
+        }
+        m_events += events;
+        m_bytes  += bytes;
+    }
+
+    /**
+     * @brief Releases events that have completed.
+     */
+    void release(size_t events, size_t bytes) {
+        {
+            std::unique_lock<thallium::mutex> guard{m_mutex};
+            m_events -= events;
+            m_bytes  -= bytes;
+            if(m_num_waiters == 0) return;
+        }
+        m_cv.notify_all();
+    }
+
+    /**
+     * @brief Returns true if a push is blocked waiting for events to
+     * complete. Batches should then be sent without waiting to fill up.
+     */
+    bool hasWaiters() const {
+        return m_num_waiters != 0;
+    }
+
+    size_t pendingEvents() const {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        return m_events;
+    }
+
+    size_t pendingBytes() const {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        return m_bytes;
+    }
+
+    size_t numRefusedEvents() const {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        return m_num_refused;
+    }
+
+    private:
+
+    bool fits(size_t events, size_t bytes) const {
+        if(m_events == 0) return true;
+        return m_events <= m_max_events.value && events <= m_max_events.value - m_events
+            && m_bytes <= m_max_bytes.value && bytes <= m_max_bytes.value - m_bytes;
+    }
+
+    const MaxPendingEvents               m_max_events;
+    const MaxPendingBytes                m_max_bytes;
+    size_t                               m_events = 0;
+    size_t                               m_bytes = 0;
+    std::atomic<size_t>                  m_num_waiters = 0;
+    size_t                               m_num_refused = 0;
+    mutable thallium::mutex              m_mutex;
+    mutable thallium::condition_variable m_cv;
+};
+
+}
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_PROCESSING_ENGINE_H
+#define MOFKA_PROCESSING_ENGINE_H
+
+#include "PimplUtil.hpp"
+#include "ThreadPoolImpl.hpp"
+#include "ConsumerImpl.hpp"
+
+#include "mofka/Consumer.hpp"
+#include "mofka/Event.hpp"
+#include "mofka/EventProcessor.hpp"
+#include "mofka/Exception.hpp"
+#include "mofka/Ordering.hpp"
+#include "mofka/TargetSelector.hpp"
+
+#include <thallium.hpp>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief The ProcessingEngine implements Consumer::process. The calling
+ * thread pulls events and hands them to ULTs of the ThreadPool, keeping
+ * at most max_in_flight events between the pull and the end of their
+ * processing. With Ordering::PerPartition (resp. Strict), events go
+ * through a lane per partition (resp. a single lane) that a ULT drains
+ * in order, so that the events of a lane are processed one at a time.
+ *
+ * Acknowledgements follow the order of the events in each partition: the
+ * last event of the processed prefix is acknowledged, by one ULT at a time
+ * per partition so that the acknowledged EventID never goes backward.
+ * Completions that occur during an acknowledgement are coalesced into the
+ * next one.
+ *
+ * The calling thread waits for the pulled event or for the processor to
+ * stop, whichever comes first, so that run returns as soon as the processor
+ * stops even if no event arrives anymore, cancelling its pending pull().
+ * Events pulled but not processed are given back to the consumer, so that
+ * its next pull() returns them.
+ */
+class ProcessingEngine : public std::enable_shared_from_this<ProcessingEngine> {
+
+    public:
+
+    ProcessingEngine(EventProcessor processor, Ordering ordering, size_t max_in_flight)
+    : m_processor(std::move(processor))
+    , m_ordering(ordering)
+    , m_max_in_flight(max_in_flight == 0 ? 1 : max_in_flight) {}
+
+    /**
+     * @brief Pulls up to max_events events from the consumer and processes
+     * them in thread_pool. Returns when the events given to the processor
+     * have completed, rethrowing the first error encountered.
+     */
+    void run(const SP<ConsumerImpl>& consumer, ThreadPoolImpl& thread_pool, size_t max_events) {
+        auto self = shared_from_this();
+        for(size_t n = 0; n < max_events; ++n) {
+            std::optional<Event> event;
+            {
+                std::unique_lock<thallium::mutex> guard{m_mtx};
+                m_cv.wait(guard, [this]() {
+                    return m_stop || m_in_flight < m_max_in_flight;
+                });
+                if(m_stop) break;
+            }
+            uint64_t pull_id = 0;
+            try {
+                auto future = consumer->pull(&pull_id);
+                {
+                    std::unique_lock<thallium::mutex> guard{m_mtx};
+                    m_pulling = true;
+                }
+                future.then(
+                    [self](Event pulled) { self->onPulled(std::move(pulled)); },
+                    [self](const Exception& ex) { self->onPullFailed(ex); });
+            } catch(const Exception&) {
+                fail(std::current_exception());
+                break;
+            }
+            {
+                std::unique_lock<thallium::mutex> guard{m_mtx};
+                m_cv.wait(guard, [this]() { return m_stop || m_pulled; });
+                if(m_pulled) {
+                    event = std::move(m_pulled);
+                    m_pulled.reset();
+                }
+            }
+            if(!event) {
+                /* stopped while pulling: if an event was already assigned
+                 * to the pull, wait for it so that it can be given back */
+                if(consumer->cancelPull(pull_id)) break;
+                std::unique_lock<thallium::mutex> guard{m_mtx};
+                m_cv.wait(guard, [this]() { return !m_pulling; });
+                break;
+            }
+            /* events pulled after the processor asked to stop are not processed */
+            if(!dispatch(std::move(*event), thread_pool)) break;
+        }
+        std::vector<Event> unprocessed;
+        {
+            std::unique_lock<thallium::mutex> guard{m_mtx};
+            m_cv.wait(guard, [this]() { return m_in_flight == 0; });
+            unprocessed.swap(m_unprocessed);
+        }
+        GiveBack(consumer, std::move(unprocessed));
+        std::unique_lock<thallium::mutex> guard{m_mtx};
+        if(m_error) std::rethrow_exception(m_error);
+    }
+
+    private:
+
+    /**
+     * @brief Events waiting to be processed one at a time.
+     */
+    struct Lane {
+        std::deque<Event> queue;
+        bool              busy = false; /* a ULT is draining the lane */
+    };
+
+    struct Partition {
+        std::deque<std::pair<Event, bool>> pending;        /* events pulled and not acknowledged, in order,
+                                                              and whether they have been processed */
+        std::optional<Event>               to_acknowledge; /* last event of the processed prefix */
+        bool                               acknowledging = false;
+        Lane                               lane;           /* used with Ordering::PerPartition */
+    };
+
+    /* must be called with m_mtx held */
+    Partition& partitionOf(const Event& event) {
+        return m_partitions[event.partition()];
+    }
+
+    /**
+     * @brief Gives unprocessed events back to the consumer. Their order
+     * across partitions doesn't matter, but the events of a partition
+     * should be pulled again in the order of their EventIDs.
+     */
+    static void GiveBack(const SP<ConsumerImpl>& consumer, std::vector<Event> events) {
+        if(events.empty()) return;
+        std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+            return a.id() < b.id();
+        });
+        consumer->unpull(std::move(events));
+    }
+
+    void onPulled(Event event) {
+        {
+            std::unique_lock<thallium::mutex> guard{m_mtx};
+            m_pulling = false;
+            if(m_stop) m_unprocessed.push_back(std::move(event));
+            else m_pulled = std::move(event);
+        }
+        m_cv.notify_all();
+    }
+
+    void onPullFailed(const Exception& ex) {
+        fail(std::make_exception_ptr(ex));
+        {
+            std::unique_lock<thallium::mutex> guard{m_mtx};
+            m_pulling = false;
+        }
+        m_cv.notify_all();
+    }
+
+    bool dispatch(Event event, ThreadPoolImpl& thread_pool) {
+        Lane* lane = nullptr;
+        {
+            std::unique_lock<thallium::mutex> guard{m_mtx};
+            if(m_stop) {
+                m_unprocessed.push_back(std::move(event));
+                return false;
+            }
+            auto& partition = partitionOf(event);
+            partition.pending.emplace_back(event, false);
+            m_in_flight += 1;
+            if(m_ordering == Ordering::Strict) lane = &m_lane;
+            else if(m_ordering == Ordering::PerPartition) lane = &partition.lane;
+            if(lane) {
+                lane->queue.push_back(std::move(event));
+                if(lane->busy) return true;
+                lane->busy = true;
+            }
+        }
+        auto self = shared_from_this();
+        if(lane)
+            thread_pool.pushWork([self, lane]() { self->drain(*lane); });
+        else
+            thread_pool.pushWork([self, event=std::move(event)]() { self->processOne(event); });
+        return true;
+    }
+
+    void drain(Lane& lane) {
+        while(true) {
+            Event event;
+            {
+                std::unique_lock<thallium::mutex> guard{m_mtx};
+                if(lane.queue.empty()) {
+                    lane.busy = false;
+                    return;
+                }
+                event = std::move(lane.queue.front());
+                lane.queue.pop_front();
+            }
+            processOne(event);
+        }
+    }
+
+    void processOne(const Event& event) {
+        bool stopped;
+        {
+            std::unique_lock<thallium::mutex> guard{m_mtx};
+            stopped = m_stop;
+        }
+        bool processed = false;
+        if(!stopped) {
+            try {
+                m_processor(event);
+                processed = true;
+            } catch(const StopEventProcessor&) {
+                processed = true;
+                std::unique_lock<thallium::mutex> guard{m_mtx};
+                m_stop = true;
+            } catch(...) {
+                fail(std::current_exception());
+            }
+        }
+        complete(event, processed);
+    }
+
+    void complete(const Event& event, bool processed) {
+        Partition* partition;
+        bool acknowledge = false;
+        {
+            std::unique_lock<thallium::mutex> guard{m_mtx};
+            partition = &partitionOf(event);
+            auto& pending = partition->pending;
+            if(processed) {
+                for(auto& p : pending) {
+                    if(p.first.id() != event.id()) continue;
+                    p.second = true;
+                    break;
+                }
+            } else {
+                m_unprocessed.push_back(event);
+            }
+            while(!pending.empty() && pending.front().second) {
+                partition->to_acknowledge = std::move(pending.front().first);
+                pending.pop_front();
+            }
+            if(partition->to_acknowledge && !partition->acknowledging) {
+                partition->acknowledging = true;
+                acknowledge = true;
+            }
+        }
+        while(acknowledge) {
+            Event last;
+            {
+                std::unique_lock<thallium::mutex> guard{m_mtx};
+                if(!partition->to_acknowledge) {
+                    partition->acknowledging = false;
+                    break;
+                }
+                last = std::move(*partition->to_acknowledge);
+                partition->to_acknowledge.reset();
+            }
+            try {
+                last.acknowledge();
+            } catch(const Exception&) {
+                fail(std::current_exception());
+            }
+        }
+        {
+            std::unique_lock<thallium::mutex> guard{m_mtx};
+            m_in_flight -= 1;
+        }
+        m_cv.notify_all();
+    }
+
+    void fail(std::exception_ptr error) {
+        std::unique_lock<thallium::mutex> guard{m_mtx};
+        if(!m_error) m_error = std::move(error);
+        m_stop = true;
+    }
+
+    EventProcessor                                   m_processor;
+    Ordering                                         m_ordering;
+    size_t                                           m_max_in_flight;
+    thallium::mutex                                  m_mtx;
+    thallium::condition_variable                     m_cv;
+    size_t                                           m_in_flight = 0;
+    bool                                             m_stop = false;
+    bool                                             m_pulling = false; /* a pull() is pending */
+    std::optional<Event>                             m_pulled;      /* event pulled, for run to dispatch */
+    std::vector<Event>                               m_unprocessed; /* events pulled and not processed */
+    std::exception_ptr                               m_error;
+    std::unordered_map<PartitionTargetInfo, Partition> m_partitions;
+    Lane                                             m_lane; /* used with Ordering::Strict */
+};
+
+}
+
+#endif
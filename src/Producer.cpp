@@ -9,7 +9,7 @@
 #include "mofka/TopicHandle.hpp"
 #include "mofka/Future.hpp"
 
-#include "Promise.hpp"
+#include "CompletionGroup.hpp"
 #include "ClientImpl.hpp"
 #include "ProducerImpl.hpp"
 #include "PimplUtil.hpp"
@@ -39,110 +39,427 @@ BatchSize Producer::batchSize() const {
     return self->m_batch_size;
 }
 
+BatchingGoal Producer::batchingGoal() const {
+    return self->m_batching_goal;
+}
+
+MaxBatchBytes Producer::maxBatchBytes() const {
+    return self->m_max_batch_bytes;
+}
+
+Linger Producer::linger() const {
+    return self->m_linger;
+}
+
+MaxInFlightBatches Producer::maxInFlightBatches() const {
+    return self->m_max_in_flight;
+}
+
+EagerThreshold Producer::eagerThreshold() const {
+    return self->m_eager_threshold;
+}
+
+StagingThreshold Producer::stagingThreshold() const {
+    return self->m_staging_threshold;
+}
+
+MaxPendingEvents Producer::maxPendingEvents() const {
+    return self->m_max_pending_events;
+}
+
+MaxPendingBytes Producer::maxPendingBytes() const {
+    return self->m_max_pending_bytes;
+}
+
+BackpressurePolicy Producer::backpressurePolicy() const {
+    return self->m_backpressure_policy;
+}
+
+MaxBatchRetries Producer::maxBatchRetries() const {
+    return self->m_max_retries;
+}
+
+size_t Producer::pendingEvents() const {
+    return self->m_pending->pendingEvents();
+}
+
+size_t Producer::pendingBytes() const {
+    return self->m_pending->pendingBytes();
+}
+
+size_t Producer::numRejectedEvents() const {
+    return self->m_pending->numRefusedEvents();
+}
+
+size_t Producer::effectiveBatchSize(const PartitionTargetInfo& target) const {
+    if(self->m_batch_size != BatchSize::Adaptive())
+        return self->m_batch_size.value;
+    std::lock_guard<thallium::mutex> guard{self->m_batch_queues_mtx};
+    auto it = self->m_batch_queues.find(target);
+    if(it == self->m_batch_queues.end())
+        return AdaptiveBatchController::MinBatchSize;
+    return it->second->batchSize();
+}
+
 ThreadPool Producer::threadPool() const {
     return self->m_thread_pool;
 }
 
-Future<EventID> Producer::push(Metadata metadata, Data data) const {
-    /* Step 1: create a future/promise pair for this operation */
-    Future<EventID> future;
-    Promise<EventID> promise;
+/**
+ * @brief Creates a CompletionGroup for events pushed by the producer.
+ */
+static SP<CompletionGroup> CreateCompletionGroup(
+        const SP<ProducerImpl>& self,
+        size_t capacity) {
     // if the batch size is not adaptive, wait() calls on futures should trigger a flush
-    auto on_wait = [producer=*this]() mutable { producer.flush(); };
-    std::tie(future, promise) = self->m_batch_size != BatchSize::Adaptive() ?
-        Promise<EventID>::CreateFutureAndPromise(std::move(on_wait))
-        : Promise<EventID>::CreateFutureAndPromise();
-    /* Step 2: get a local ID for this push operation */
-    size_t local_event_id = self->m_num_pushed_events++;
-    /* Step 3: create a ULT that will validate, select the target, and serialize */
-    auto ult = [this,
-                local_event_id,
-                promise=std::move(promise),
-                metadata=std::move(metadata),
-                data=std::move(data)]() mutable {
-        auto topic = self->m_topic;
-        /* Metadata validation */
-        try {
-            /* Step 3.1: validate the metadata */
-            topic->m_validator.validate(metadata, data);
-            /* Step 3.2: select the target for this metadata */
-            auto target = topic->m_selector.selectTargetFor(metadata);
-            {
-                /* Step 3.3: wait for our turn pushing the event into the batch */
-                std::unique_lock<thallium::mutex> guard{self->m_batch_queues_mtx};
-                if(self->m_ordering == Ordering::Strict) {
-                    while(local_event_id != self->m_num_ready_events) {
-                        self->m_batch_queues_cv.wait(guard);
-                    }
-                }
-                /* Step 3.4: find/create the ActiveBatchQueue to send to */
-                auto& queue = self->m_batch_queues[target];
-                if(!queue) {
-                    queue.reset(new ActiveProducerBatchQueue{
-                        self->m_topic->m_name,
-                        self->m_name,
-                        self->m_topic->m_service->m_client,
-                        target.self,
-                        self->m_thread_pool,
-                        batchSize()});
-                }
-                if(self->m_ordering != Ordering::Strict)
-                    guard.unlock();
-                /* Step 3.5: push the data and metadata to the batch */
-                queue->push(metadata, topic->m_serializer, data, promise);
-                /* Step 3.6: increase the number of events that are ready */
-                self->m_num_ready_events += 1;
-                /* Step 3.7: now the ActiveBatchQueue ULT will automatically
-                 * pick up the batch and send it when needed */
-            }
-        } catch(const Exception& ex) {
-            /* Increase the number of events that are ready
-             * (because it wasn't done in the normal path) */
-            self->m_num_ready_events += 1;
-            promise.setException(ex);
-        }
-        /* Step 3.8: notify ULTs blocked waiting for their turn */
-        self->m_batch_queues_cv.notify_all();
-        /* Step 3.9: decrease the number of posted ULTs */
-        bool notify_no_posted_ults = false;
+    std::function<void()> on_wait;
+    if(self->m_batch_size != BatchSize::Adaptive()) {
+        // the producer holds a group, which should not keep it alive
+        on_wait = [producer=WP<ProducerImpl>{self}]() {
+            auto p = producer.lock();
+            if(p) p->flush();
+        };
+    }
+    return CompletionGroup::Create(
+        capacity, self->m_thread_pool, std::move(on_wait), self.get());
+}
+
+/**
+ * @brief Returns the promise of the next event pushed one by one, taking
+ * a slot in the current CompletionGroup of the producer.
+ */
+static EventPromise NextEventPromise(const SP<ProducerImpl>& self) {
+    std::lock_guard<thallium::mutex> guard{self->m_completion_group_mtx};
+    auto& group = self->m_completion_group;
+    if(!group || self->m_completion_group_next == group->capacity()) {
+        group = CreateCompletionGroup(self, CompletionGroup::DefaultCapacity);
+        self->m_completion_group_next = 0;
+    }
+    return group->promise(self->m_completion_group_next++);
+}
+
+/**
+ * @brief Creates a future that has already completed, for an event
+ * refused with BackpressurePolicy::Reject.
+ */
+static Future<EventID> CreateRejectedFuture() {
+    static const char* error = "Event rejected: the producer has reached its limit of pending events";
+    return Future<EventID>{
+        []() -> EventID { throw BackpressureException{error}; },
+        []() { return true; },
+        [](std::function<void(const Future<EventID>::Outcome&)> callback) {
+            callback(std::make_exception_ptr(BackpressureException{error}));
+            return FutureState<EventID>::NoSubscription;
+        }};
+}
+
+/**
+ * @brief Returns the size of an event, as counted by the PendingEventsLimiter.
+ */
+static size_t PendingBytes(
+        const SP<ProducerImpl>& self,
+        const Metadata& metadata,
+        const Data& data) {
+    if(!self->m_pending->limitsBytes()) return 0;
+    return metadata.string().size() + data.size();
+}
+
+bool ProducerImpl::admit(size_t events, size_t bytes) {
+    if(!m_pending->enabled()) return true;
+    switch(m_backpressure_policy) {
+    case BackpressurePolicy::Block:
+        /* partially filled batches must be sent for pending events to complete */
+        m_pending->acquire(events, bytes, [this]() { requestFlush(); });
+        return true;
+    case BackpressurePolicy::Throw:
+        if(m_pending->tryAcquire(events, bytes)) return true;
+        throw BackpressureException{
+            "Producer::push: the producer has reached its limit of pending events"};
+    default:
+        return m_pending->tryAcquire(events, bytes);
+    }
+}
+
+void ProducerImpl::requestFlush() {
+    std::lock_guard<thallium::mutex> guard{m_batch_queues_mtx};
+    for(auto& p : m_batch_queues) {
+        p.second->flush();
+    }
+}
+
+ProducerImpl::Ticket ProducerImpl::takeTicket(
+        size_t local_event_id,
+        const PartitionTargetInfo& target) {
+    switch(m_ordering) {
+    case Ordering::Strict:
+        return Ticket{&m_sequencer, local_event_id};
+    case Ordering::PerPartition:
         {
-            std::lock_guard<thallium::mutex> guard_posted_ults{self->m_num_posted_ults_mtx};
-            self->m_num_posted_ults -= 1;
-            if(self->m_num_posted_ults == 0) notify_no_posted_ults = true;
+            std::lock_guard<thallium::mutex> guard{m_partition_sequencers_mtx};
+            auto& ps = m_partition_sequencers[target];
+            if(!ps) ps = std::make_unique<PartitionSequencer>();
+            return Ticket{&ps->sequencer, ps->next_ticket++};
         }
-        if(notify_no_posted_ults) {
-            self->m_num_posted_ults_cv.notify_all();
+    default:
+        return Ticket{};
+    }
+}
+
+void ProducerImpl::pushEvent(
+        Metadata& metadata,
+        Data& data,
+        EventPromise& promise,
+        PartitionTargetInfo target,
+        Ticket ticket,
+        size_t pending_bytes) {
+    auto topic = m_topic;
+    auto has_turn = false;
+    /* Metadata validation */
+    try {
+        /* Step 1: validate the metadata */
+        topic->m_validator.validate(metadata, data);
+        /* Step 2: select the target for this metadata,
+         * unless it was selected when the event was pushed */
+        if(!target) target = topic->m_selector.selectTargetFor(metadata);
+        /* Step 3: wait for our turn pushing the event into the batch */
+        if(ticket.sequencer) {
+            ticket.sequencer->waitForTurn(ticket.number);
+            has_turn = true;
         }
-    };
-    /* Step 4: increase the number of posted ULTs */
+        /* Step 4: find/create the ActiveBatchQueue to send to */
+        SP<ActiveProducerBatchQueue> queue;
+        {
+            std::unique_lock<thallium::mutex> guard{m_batch_queues_mtx};
+            auto& q = m_batch_queues[target];
+            if(!q) {
+                q.reset(new ActiveProducerBatchQueue{
+                    m_topic->m_name,
+                    m_name,
+                    m_uuid,
+                    m_topic->m_service->m_client,
+                    target.self,
+                    m_thread_pool,
+                    m_batch_pool,
+                    m_pending,
+                    [selector=topic->m_selector, target]() mutable {
+                        selector.onBatchClosed(target);
+                    },
+                    [selector=topic->m_selector, target](
+                            size_t count, AdaptiveBatchController::duration rtt) mutable {
+                        selector.onBatchCompleted(target, count,
+                            std::chrono::duration_cast<std::chrono::microseconds>(rtt));
+                    },
+                    [selector=topic->m_selector, target](size_t count) mutable {
+                        for(size_t i = 0; i < count; ++i)
+                            selector.onSelectionCancelled(target);
+                    },
+                    m_topic->m_compressor,
+                    m_batch_size,
+                    m_batching_goal,
+                    m_max_batch_bytes,
+                    m_linger,
+                    m_max_in_flight,
+                    m_eager_threshold,
+                    m_max_retries});
+            }
+            queue = q;
+        }
+        /* Step 5: push the data and metadata to the batch */
+        queue->push(metadata, topic->m_serializer, data, promise, pending_bytes);
+        /* Step 6: now the ActiveBatchQueue ULT will automatically
+         * pick up the batch and send it when needed */
+    } catch(const Exception&) {
+        /* the selector counted the event against its target */
+        if(target) topic->m_selector.onSelectionCancelled(target);
+        promise.setException(std::current_exception());
+        release(1, pending_bytes);
+    }
+    /* Step 7: let the next event in. An event that failed before its turn
+     * still needs to wait for it, otherwise the next one would overtake
+     * events that are still being pushed */
+    if(ticket.sequencer) {
+        if(!has_turn) ticket.sequencer->waitForTurn(ticket.number);
+        ticket.sequencer->advance();
+    }
+}
+
+/**
+ * @brief Increase the number of ULTs posted by the producer.
+ */
+static void IncrementPostedULTs(const SP<ProducerImpl>& self) {
+    std::lock_guard<thallium::mutex> guard{self->m_num_posted_ults_mtx};
+    self->m_num_posted_ults += 1;
+}
+
+/**
+ * @brief Decrease the number of ULTs posted by the producer,
+ * notifying Producer::flush() if it reaches 0.
+ */
+static void DecrementPostedULTs(const SP<ProducerImpl>& self) {
+    bool notify_no_posted_ults = false;
     {
-        std::lock_guard<thallium::mutex> guard{self->m_num_posted_ults_mtx};
-        self->m_num_posted_ults += 1;
+        std::lock_guard<thallium::mutex> guard_posted_ults{self->m_num_posted_ults_mtx};
+        self->m_num_posted_ults -= 1;
+        if(self->m_num_posted_ults == 0) notify_no_posted_ults = true;
+    }
+    if(notify_no_posted_ults) {
+        self->m_num_posted_ults_cv.notify_all();
+    }
+}
+
+/**
+ * @brief With Ordering::PerPartition, the target of an event must be known
+ * when it is pushed, so that its ticket follows the order of the calls to
+ * Producer::push. Returns an invalid PartitionTargetInfo otherwise.
+ */
+static PartitionTargetInfo SelectTargetOnPush(
+        const SP<ProducerImpl>& self,
+        const Metadata& metadata) {
+    if(self->m_ordering != Ordering::PerPartition)
+        return PartitionTargetInfo{};
+    return self->m_topic->m_selector.selectTargetFor(metadata);
+}
+
+Future<EventID> Producer::push(Metadata metadata, Data data) const {
+    /* Step 1: count the event as pending, if the producer has limits */
+    size_t pending_bytes = PendingBytes(self, metadata, data);
+    if(!self->admit(1, pending_bytes))
+        return CreateRejectedFuture();
+    /* Step 2: create a future/promise pair for this operation */
+    auto promise = NextEventPromise(self);
+    auto future = promise.group->future(promise.index);
+    /* Step 3: get a local ID and a ticket for this push operation */
+    size_t local_event_id = self->m_num_pushed_events++;
+    PartitionTargetInfo target;
+    ProducerImpl::Ticket ticket;
+    try {
+        target = SelectTargetOnPush(self, metadata);
+        ticket = self->takeTicket(local_event_id, target);
+    } catch(const Exception&) {
+        if(target) self->m_topic->m_selector.onSelectionCancelled(target);
+        promise.setException(std::current_exception());
+        self->release(1, pending_bytes);
+        return future;
     }
-    /* Step 3: submit the ULT */
+    /* Step 4: create a ULT that will validate, select the target, and serialize */
+    auto ult = [self=self,
+                promise=std::move(promise),
+                metadata=std::move(metadata),
+                data=std::move(data),
+                target=std::move(target),
+                ticket,
+                pending_bytes]() mutable {
+        self->pushEvent(metadata, data, promise, std::move(target), ticket, pending_bytes);
+        DecrementPostedULTs(self);
+    };
+    /* Step 5: increase the number of posted ULTs */
+    IncrementPostedULTs(self);
+    /* Step 6: submit the ULT */
     self->m_thread_pool->pushWork(std::move(ult), local_event_id);
-    /* Step 4: return the future */
+    /* Step 7: return the future */
     return future;
 }
 
+std::vector<Future<EventID>> Producer::push(
+        std::vector<Metadata> metadata,
+        std::vector<Data> data) const {
+    const auto count = metadata.size();
+    if(!data.empty() && data.size() != count)
+        throw Exception{"Producer::push: metadata and data vectors should have the same size"};
+    if(count == 0) return {};
+    data.resize(count);
+    /* Step 1: count the events as pending, as a group */
+    std::vector<size_t> pending_bytes(count, 0);
+    size_t total_pending_bytes = 0;
+    for(size_t i = 0; i < count; ++i) {
+        pending_bytes[i] = PendingBytes(self, metadata[i], data[i]);
+        total_pending_bytes += pending_bytes[i];
+    }
+    if(!self->admit(count, total_pending_bytes))
+        return std::vector<Future<EventID>>(count, CreateRejectedFuture());
+    /* Step 2: create a future/promise pair for each event, sharing a CompletionGroup */
+    auto group = CreateCompletionGroup(self, count);
+    std::vector<Future<EventID>> futures;
+    std::vector<EventPromise> promises;
+    futures.reserve(count);
+    promises.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        futures.push_back(group->future(i));
+        promises.push_back(group->promise(i));
+    }
+    /* Step 3: reserve a range of consecutive local IDs and take the tickets */
+    size_t first_local_event_id = self->m_num_pushed_events.fetch_add(count);
+    std::vector<PartitionTargetInfo> targets(count);
+    std::vector<ProducerImpl::Ticket> tickets(count);
+    std::vector<bool> failed(count, false);
+    for(size_t i = 0; i < count; ++i) {
+        try {
+            targets[i] = SelectTargetOnPush(self, metadata[i]);
+            tickets[i] = self->takeTicket(first_local_event_id + i, targets[i]);
+        } catch(const Exception&) {
+            if(targets[i]) self->m_topic->m_selector.onSelectionCancelled(targets[i]);
+            promises[i].setException(std::current_exception());
+            self->release(1, pending_bytes[i]);
+            failed[i] = true;
+        }
+    }
+    /* Step 4: create a single ULT that will process all the events in order */
+    auto ult = [self=self,
+                promises=std::move(promises),
+                metadata=std::move(metadata),
+                data=std::move(data),
+                targets=std::move(targets),
+                tickets=std::move(tickets),
+                failed=std::move(failed),
+                pending_bytes=std::move(pending_bytes)]() mutable {
+        for(size_t i = 0; i < promises.size(); ++i) {
+            if(failed[i]) continue;
+            self->pushEvent(metadata[i], data[i], promises[i],
+                            std::move(targets[i]), tickets[i], pending_bytes[i]);
+        }
+        DecrementPostedULTs(self);
+    };
+    /* Step 5: increase the number of posted ULTs */
+    IncrementPostedULTs(self);
+    /* Step 6: submit the ULT */
+    self->m_thread_pool->pushWork(std::move(ult), first_local_event_id);
+    /* Step 7: return the futures */
+    return futures;
+}
+
 void Producer::flush() {
     if(!self) return;
+    self->flush();
+}
+
+void ProducerImpl::flush() {
     {
-        std::unique_lock<thallium::mutex> guard_posted_ults{self->m_num_posted_ults_mtx};
-        self->m_num_posted_ults_cv.wait(
+        std::unique_lock<thallium::mutex> guard_posted_ults{m_num_posted_ults_mtx};
+        m_num_posted_ults_cv.wait(
             guard_posted_ults,
-            [this]() { return self->m_num_posted_ults == 0; });
-    }
-    {
-        std::lock_guard<thallium::mutex> guard{self->m_batch_queues_mtx};
-        for(auto& p : self->m_batch_queues) {
-            p.second->flush();
-        }
+            [this]() { return m_num_posted_ults == 0; });
     }
+    requestFlush();
 }
 
 BatchSize BatchSize::Adaptive() {
     return BatchSize{std::numeric_limits<std::size_t>::max()};
 }
 
+MaxBatchBytes MaxBatchBytes::Unlimited() {
+    return MaxBatchBytes{std::numeric_limits<std::size_t>::max()};
+}
+
+MaxPendingEvents MaxPendingEvents::Unlimited() {
+    return MaxPendingEvents{std::numeric_limits<std::size_t>::max()};
+}
+
+MaxPendingBytes MaxPendingBytes::Unlimited() {
+    return MaxPendingBytes{std::numeric_limits<std::size_t>::max()};
+}
+
+Linger Linger::Infinite() {
+    return Linger{std::chrono::microseconds::max()};
+}
+
 }
@@ -9,93 +9,274 @@
 #include "PartitionTargetInfoImpl.hpp"
 #include "ThreadPoolImpl.hpp"
 #include "ProducerImpl.hpp"
-#include "Promise.hpp"
+#include "CompletionGroup.hpp"
 #include "DataImpl.hpp"
 #include "PimplUtil.hpp"
+#include "AdaptiveBatchController.hpp"
+#include "InlineContent.hpp"
+#include "PendingEventsLimiter.hpp"
 
 #include "mofka/BulkRef.hpp"
 #include "mofka/Result.hpp"
 #include "mofka/EventID.hpp"
+#include "mofka/UUID.hpp"
 #include "mofka/Metadata.hpp"
 #include "mofka/Archive.hpp"
 #include "mofka/Serializer.hpp"
+#include "mofka/Compressor.hpp"
 #include "mofka/Data.hpp"
 #include "mofka/Future.hpp"
 #include "mofka/Producer.hpp"
 #include "mofka/BufferWrapperArchive.hpp"
+#include "mofka/BatchingGoal.hpp"
+#include "mofka/MaxBatchBytes.hpp"
+#include "mofka/Linger.hpp"
+#include "mofka/MaxInFlightBatches.hpp"
+#include "mofka/MaxBatchRetries.hpp"
+#include "mofka/EagerThreshold.hpp"
+#include "mofka/StagingThreshold.hpp"
 
 #include <thallium.hpp>
+#include <chrono>
+#include <ctime>
+#include <deque>
 #include <mutex>
 #include <queue>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
 
 namespace mofka {
 
+/**
+ * @brief A ProducerBatchImpl accumulates events before they are sent.
+ *
+ * Serialized metadata objects are packed into m_meta_buffer, after a
+ * header of m_reserved_slots size_t slots. When the batch is sent,
+ * the sizes of the metadata objects are copied at the end of this
+ * header, right before the packed metadata, so that a single
+ * contiguous region of m_meta_buffer has the layout the server
+ * expects. This region stays registered for RDMA as long as the
+ * buffer does not need to grow, so a batch recycled through a
+ * ProducerBatchPool does not need to allocate or re-register memory
+ * for its metadata. When the topic has a Compressor, this region is
+ * compressed into m_compressed_meta_buffer, which is kept registered
+ * in the same way.
+ *
+ * Data segments of at most StagingThreshold bytes are copied into
+ * m_data_buffer, which uses the same header layout as m_meta_buffer
+ * for the data sizes and is kept registered in the same way. Larger
+ * segments are exposed zero-copy. If no segment is exposed zero-copy,
+ * the data of the batch is transferred from a single pre-registered
+ * region; otherwise a bulk handle is created for the batch, in which
+ * consecutive staged segments form a single bulk segment.
+ */
 class ProducerBatchImpl {
 
-    std::vector<size_t>        m_meta_sizes;      /* size of each serialized metadata object */
-    std::vector<char>          m_meta_buffer;     /* packed serialized metadata objects */
-    std::vector<size_t>        m_data_sizes;      /* size of the data associated with each metadata */
-    std::vector<Data::Segment> m_data_segments;   /* list of data segments */
-    size_t                     m_total_data_size; /* sum of sizes in the m_data_segments */
+    private:
+
+    StagingThreshold           m_staging_threshold;   /* data segments up to this size are staged */
+    std::vector<size_t>        m_meta_sizes;          /* size of each serialized metadata object */
+    std::vector<char>          m_meta_buffer;         /* header + packed serialized metadata objects */
+    size_t                     m_reserved_slots = 0;  /* number of size_t slots in the header */
+    std::vector<size_t>        m_data_sizes;          /* size of the data associated with each metadata */
+    std::vector<char>          m_data_buffer;         /* header + staged data segments */
+    size_t                     m_total_data_size = 0; /* sum of the sizes in m_data_sizes */
 
-    std::vector<Promise<EventID>> m_promises; /* promise associated with each event */
+    /**
+     * @brief Segment of data of the batch, either staged in m_data_buffer
+     * (ptr is null and offset is relative to the end of the header) or
+     * exposed zero-copy (ptr points to the user's memory). Consecutive
+     * staged segments are merged into a single DataPiece.
+     */
+    struct DataPiece {
+        const void* ptr;
+        size_t      offset;
+        size_t      size;
+    };
+
+    std::vector<DataPiece>     m_data_pieces;              /* staged and zero-copy segments, in order */
+    size_t                     m_num_zero_copy_pieces = 0; /* number of pieces with a non-null ptr */
+
+    /**
+     * @brief Bulk handle exposing a std::vector<char>, registered again
+     * only if the vector moved or if its capacity changed.
+     */
+    struct ExposedBuffer {
+
+        thallium::bulk bulk;               /* registered buffer */
+        const char*    ptr = nullptr;      /* address registered in bulk */
+        size_t         capacity = 0;       /* size registered in bulk */
+
+        const thallium::bulk& expose(thallium::engine& engine, std::vector<char>& buffer) {
+            if(ptr != buffer.data() || capacity != buffer.capacity()) {
+                std::vector<std::pair<void *, size_t>> segments{
+                    {buffer.data(), buffer.capacity()}};
+                bulk = engine.expose(segments, thallium::bulk_mode::read_only);
+                ptr = buffer.data();
+                capacity = buffer.capacity();
+            }
+            return bulk;
+        }
+    };
+
+    ExposedBuffer              m_meta_bulk;              /* registered m_meta_buffer */
+    std::vector<char>          m_compressed_meta_buffer; /* compressed metadata sizes and metadata */
+    ExposedBuffer              m_compressed_meta_bulk;   /* registered m_compressed_meta_buffer */
+    ExposedBuffer              m_data_bulk;              /* registered m_data_buffer */
+
+    std::vector<EventPromise> m_promises; /* promise associated with each event */
+    size_t m_pending_bytes = 0; /* bytes counted by the PendingEventsLimiter for the events */
+
+    AdaptiveBatchController::clock::time_point m_creation_time = AdaptiveBatchController::clock::now();
+
+    size_t headerSize() const {
+        return m_reserved_slots*sizeof(size_t);
+    }
+
+    size_t packedMetadataSize() const {
+        return m_meta_buffer.size() - headerSize();
+    }
 
     public:
 
+    ProducerBatchImpl(StagingThreshold staging_threshold, size_t reserved_slots = 0)
+    : m_staging_threshold(staging_threshold) {
+        reset(reserved_slots);
+    }
+
+    /**
+     * @brief Empties the batch, keeping the capacity of its buffers
+     * and its registered memory.
+     *
+     * @param reserved_slots Hint for the expected number of events.
+     */
+    void reset(size_t reserved_slots) {
+        m_reserved_slots = std::max(m_reserved_slots, reserved_slots);
+        m_meta_sizes.clear();
+        m_meta_buffer.resize(headerSize());
+        m_data_sizes.clear();
+        m_data_buffer.resize(headerSize());
+        m_data_pieces.clear();
+        m_num_zero_copy_pieces = 0;
+        m_total_data_size = 0;
+        m_promises.clear();
+        m_pending_bytes = 0;
+        m_creation_time = AdaptiveBatchController::clock::now();
+    }
+
     void setPromises(EventID firstID) {
-        auto id = firstID;
-        for(auto& promise : m_promises) {
-            promise.setValue(id);
-            ++id;
-        }
+        EventPromise::SetValues(m_promises, firstID);
     }
 
     void setPromises(Exception ex) {
-        for(auto& promise : m_promises) {
-            promise.setException(std::move(ex));
-        }
+        EventPromise::SetExceptions(m_promises, ex);
     }
 
-    void push(
+    /**
+     * @brief Serializes the event into the batch. If the batch is not
+     * empty and adding the event would make it exceed max_bytes, the
+     * batch is left unchanged and the function returns false.
+     * pending_bytes is the size counted for the event by the
+     * PendingEventsLimiter of the producer, if any.
+     */
+    bool push(
             const Metadata& metadata,
             const Serializer& serializer,
             const Data& data,
-            Promise<EventID> promise) {
+            EventPromise& promise,
+            size_t pending_bytes,
+            size_t max_bytes = std::numeric_limits<size_t>::max()) {
+        size_t data_size = 0;
+        for(const auto& seg : data.self->m_segments)
+            data_size += seg.size;
         size_t meta_buffer_size = m_meta_buffer.size();
         BufferWrapperOutputArchive archive(m_meta_buffer);
         serializer.serialize(archive, metadata);
         size_t meta_size = m_meta_buffer.size() - meta_buffer_size;
-        m_meta_sizes.push_back(meta_size);
-        size_t data_size = 0;
-        for(const auto& seg : data.self->m_segments) {
-            m_data_segments.push_back(seg);
-            data_size += seg.size;
+        // totalBulkSize() already counts the serialized metadata
+        if(count() != 0 && totalBulkSize() + 2*sizeof(size_t) + data_size > max_bytes) {
+            m_meta_buffer.resize(meta_buffer_size);
+            return false;
         }
+        m_meta_sizes.push_back(meta_size);
+        for(const auto& seg : data.self->m_segments)
+            appendDataSegment(seg);
         m_data_sizes.push_back(data_size);
         m_total_data_size += data_size;
         m_promises.push_back(std::move(promise));
+        m_pending_bytes += pending_bytes;
+        return true;
     }
 
-    thallium::bulk exposeMetadata(thallium::engine engine) {
-        if(count() == 0) return thallium::bulk{};
-        std::vector<std::pair<void *, size_t>> segments;
-        segments.reserve(2);
-        segments.emplace_back(m_meta_sizes.data(), m_meta_sizes.size()*sizeof(m_meta_sizes[0]));
-        segments.emplace_back(m_meta_buffer.data(), m_meta_buffer.size()*sizeof(m_meta_buffer[0]));
-        return engine.expose(segments, thallium::bulk_mode::read_only);
+    /**
+     * @brief Writes the metadata sizes in front of the packed metadata
+     * and returns the bulk handle exposing m_meta_buffer. The region to
+     * transfer starts at metadataBulkOffset() and has metadataBulkSize()
+     * bytes. The memory is registered again only if the buffer moved
+     * or if it grew since the last call.
+     */
+    const thallium::bulk& exposeMetadata(thallium::engine engine) {
+        writeMetadataSizes();
+        return m_meta_bulk.expose(engine, m_meta_buffer);
+    }
+
+    /**
+     * @brief Same as exposeMetadata but the region is first compressed
+     * using the provided Compressor. The region to transfer then starts
+     * at offset 0 and has compressedMetadataBulkSize() bytes.
+     */
+    const thallium::bulk& exposeCompressedMetadata(
+            thallium::engine engine, const Compressor& compressor) {
+        writeMetadataSizes();
+        compressor.compress(
+            {{m_meta_buffer.data() + metadataBulkOffset(), metadataBulkSize()}},
+            m_compressed_meta_buffer);
+        return m_compressed_meta_bulk.expose(engine, m_compressed_meta_buffer);
+    }
+
+    /**
+     * @brief Returns the metadata sizes followed by the packed metadata,
+     * compressed unless the Compressor is pass-through, for the batch to
+     * be sent inline in the arguments of an RPC.
+     */
+    Data::Segment inlineMetadata(const Compressor& compressor) {
+        writeMetadataSizes();
+        if(compressor.isPassThrough())
+            return {m_meta_buffer.data() + metadataBulkOffset(), metadataBulkSize()};
+        compressor.compress(
+            {{m_meta_buffer.data() + metadataBulkOffset(), metadataBulkSize()}},
+            m_compressed_meta_buffer);
+        return {m_compressed_meta_buffer.data(), m_compressed_meta_buffer.size()};
+    }
+
+    /**
+     * @brief Returns the segments holding the data sizes followed by the
+     * data, for the batch to be sent inline in the arguments of an RPC.
+     */
+    std::vector<Data::Segment> inlineData() {
+        return dataSegments();
     }
 
+    /**
+     * @brief Returns a bulk handle exposing the data sizes followed by
+     * the data. The region to transfer starts at dataBulkOffset() and
+     * has dataBulkSize() bytes. If all the data is staged, the handle
+     * is the one registered for m_data_buffer.
+     */
     thallium::bulk exposeData(thallium::engine engine) {
         if(count() == 0) return thallium::bulk{};
+        if(m_num_zero_copy_pieces == 0) {
+            writeDataSizes();
+            return m_data_bulk.expose(engine, m_data_buffer);
+        }
+        auto data_segments = dataSegments();
         std::vector<std::pair<void *, size_t>> segments;
-        segments.reserve(1 + m_data_segments.size());
-        segments.emplace_back(m_data_sizes.data(), m_data_sizes.size()*sizeof(m_data_sizes[0]));
-        for(const auto& seg : m_data_segments) {
-            if(!seg.size) continue;
+        segments.reserve(data_segments.size());
+        for(const auto& seg : data_segments)
             segments.emplace_back(const_cast<void*>(seg.ptr), seg.size);
-        }
         return engine.expose(segments, thallium::bulk_mode::read_only);
     }
 
@@ -103,13 +284,142 @@ class ProducerBatchImpl {
         return m_meta_sizes.size();
     }
 
+    size_t pendingBytes() const {
+        return m_pending_bytes;
+    }
+
+    size_t metadataBulkOffset() const {
+        return sizesOffset();
+    }
+
     size_t metadataBulkSize() const {
-        return count()*sizeof(size_t) + m_meta_buffer.size();
+        return count()*sizeof(size_t) + packedMetadataSize();
+    }
+
+    size_t compressedMetadataBulkSize() const {
+        return m_compressed_meta_buffer.size();
+    }
+
+    size_t dataBulkOffset() const {
+        return m_num_zero_copy_pieces == 0 ? sizesOffset() : 0;
     }
 
     size_t dataBulkSize() const {
         return count()*sizeof(size_t) + m_total_data_size;
     }
+
+    size_t totalBulkSize() const {
+        return metadataBulkSize() + dataBulkSize();
+    }
+
+    AdaptiveBatchController::clock::time_point creationTime() const {
+        return m_creation_time;
+    }
+
+    private:
+
+    /* offset of the sizes in the header of m_meta_buffer and m_data_buffer */
+    size_t sizesOffset() const {
+        return (m_reserved_slots - std::min(count(), m_reserved_slots))*sizeof(size_t);
+    }
+
+    void growHeaders() {
+        if(count() > m_reserved_slots) {
+            /* more events than anticipated, grow the headers */
+            auto extra = (count() - m_reserved_slots)*sizeof(size_t);
+            m_meta_buffer.insert(m_meta_buffer.begin(), extra, 0);
+            m_data_buffer.insert(m_data_buffer.begin(), extra, 0);
+            m_reserved_slots = count();
+        }
+    }
+
+    void writeMetadataSizes() {
+        growHeaders();
+        std::memcpy(m_meta_buffer.data() + sizesOffset(),
+                    m_meta_sizes.data(), count()*sizeof(size_t));
+    }
+
+    void writeDataSizes() {
+        growHeaders();
+        std::memcpy(m_data_buffer.data() + sizesOffset(),
+                    m_data_sizes.data(), count()*sizeof(size_t));
+    }
+
+    void appendDataSegment(const Data::Segment& seg) {
+        if(seg.size == 0) return;
+        if(seg.size > m_staging_threshold.value) {
+            m_data_pieces.push_back({seg.ptr, 0, seg.size});
+            ++m_num_zero_copy_pieces;
+            return;
+        }
+        auto offset = m_data_buffer.size() - headerSize();
+        auto ptr = static_cast<const char*>(seg.ptr);
+        m_data_buffer.insert(m_data_buffer.end(), ptr, ptr + seg.size);
+        if(!m_data_pieces.empty() && m_data_pieces.back().ptr == nullptr)
+            m_data_pieces.back().size += seg.size;
+        else
+            m_data_pieces.push_back({nullptr, offset, seg.size});
+    }
+
+    /* writes the data sizes and returns the data sizes and data as a
+     * list of segments, merging segments that are contiguous in memory */
+    std::vector<Data::Segment> dataSegments() {
+        writeDataSizes();
+        const char* staged = m_data_buffer.data() + headerSize();
+        std::vector<Data::Segment> segments;
+        segments.reserve(1 + m_data_pieces.size());
+        segments.push_back({m_data_buffer.data() + sizesOffset(), count()*sizeof(size_t)});
+        for(const auto& piece : m_data_pieces) {
+            const void* ptr = piece.ptr ? piece.ptr : staged + piece.offset;
+            auto& last = segments.back();
+            if(static_cast<const char*>(last.ptr) + last.size == ptr)
+                last.size += piece.size;
+            else
+                segments.push_back({ptr, piece.size});
+        }
+        return segments;
+    }
+};
+
+/**
+ * @brief Pool of ProducerBatchImpl shared by the ActiveProducerBatchQueues
+ * of a Producer. Batches are returned to the pool once their promises
+ * have been set, so that their buffers and registered memory are reused.
+ */
+class ProducerBatchPool {
+
+    public:
+
+    static constexpr size_t MaxPooledBatches = 64;
+
+    ProducerBatchPool(StagingThreshold staging_threshold)
+    : m_staging_threshold(staging_threshold) {}
+
+    SP<ProducerBatchImpl> acquire(size_t reserved_slots) {
+        {
+            std::unique_lock<thallium::mutex> guard{m_mutex};
+            if(!m_batches.empty()) {
+                auto batch = std::move(m_batches.back());
+                m_batches.pop_back();
+                guard.unlock();
+                batch->reset(reserved_slots);
+                return batch;
+            }
+        }
+        return std::make_shared<ProducerBatchImpl>(m_staging_threshold, reserved_slots);
+    }
+
+    void release(SP<ProducerBatchImpl> batch) {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        if(m_batches.size() < MaxPooledBatches)
+            m_batches.push_back(std::move(batch));
+    }
+
+    private:
+
+    StagingThreshold                   m_staging_threshold;
+    std::vector<SP<ProducerBatchImpl>> m_batches;
+    thallium::mutex                    m_mutex;
 };
 
 class ActiveProducerBatchQueue {
@@ -119,16 +429,43 @@ class ActiveProducerBatchQueue {
     ActiveProducerBatchQueue(
         std::string topic_name,
         std::string producer_name,
+        UUID producer_id,
         SP<ClientImpl> client,
         SP<PartitionTargetInfoImpl> target,
         SP<ThreadPoolImpl> thread_pool,
-        BatchSize batch_size)
+        SP<ProducerBatchPool> batch_pool,
+        SP<PendingEventsLimiter> pending,
+        std::function<void()> on_batch_closed,
+        std::function<void(size_t, AdaptiveBatchController::duration)> on_batch_completed,
+        std::function<void(size_t)> on_batch_cancelled,
+        Compressor compressor,
+        BatchSize batch_size,
+        BatchingGoal batching_goal,
+        MaxBatchBytes max_batch_bytes,
+        Linger linger,
+        MaxInFlightBatches max_in_flight,
+        EagerThreshold eager_threshold,
+        MaxBatchRetries max_retries)
     : m_topic_name(std::move(topic_name))
     , m_producer_name(std::move(producer_name))
+    , m_producer_id(std::move(producer_id))
     , m_client(std::move(client))
     , m_target(std::move(target))
     , m_thread_pool{std::move(thread_pool)}
-    , m_batch_size{batch_size} {
+    , m_batch_pool{std::move(batch_pool)}
+    , m_pending{std::move(pending)}
+    , m_on_batch_closed{std::move(on_batch_closed)}
+    , m_on_batch_completed{std::move(on_batch_completed)}
+    , m_on_batch_cancelled{std::move(on_batch_cancelled)}
+    , m_compressor{std::move(compressor)}
+    , m_batch_size{batch_size}
+    , m_adaptive{batch_size == BatchSize::Adaptive()}
+    , m_controller{batching_goal}
+    , m_max_batch_bytes{max_batch_bytes}
+    , m_linger{linger}
+    , m_max_in_flight{max_in_flight}
+    , m_eager_threshold{eager_threshold}
+    , m_max_retries{max_retries} {
         start();
     }
 
@@ -140,24 +477,38 @@ class ActiveProducerBatchQueue {
             const Metadata& metadata,
             const Serializer& serializer,
             const Data& data,
-            Promise<EventID> promise) {
-        bool need_notification;
+            EventPromise promise,
+            size_t pending_bytes) {
+        bool need_notification = false;
+        bool batch_closed = false;
         {
-            auto adaptive = m_batch_size == BatchSize::Adaptive();
-            need_notification = adaptive;
             std::unique_lock<thallium::mutex> guard{m_mutex};
-            if(m_batch_queue.empty())
-                m_batch_queue.push(std::make_shared<ProducerBatchImpl>());
+            if(m_adaptive) m_controller.recordArrival();
+            if(m_batch_queue.empty()) {
+                m_batch_queue.push(newBatch());
+                /* wake up the sender so it can arm the deadline of the new batch */
+                need_notification = hasDeadline();
+            }
             auto last_batch = m_batch_queue.back();
-            if(!adaptive && last_batch->count() == m_batch_size.value) {
-                m_batch_queue.push(std::make_shared<ProducerBatchImpl>());
+            if(last_batch->count() >= targetBatchSize()
+            || !last_batch->push(metadata, serializer, data, promise,
+                                 pending_bytes, m_max_batch_bytes.value)) {
+                m_batch_queue.push(newBatch());
                 last_batch = m_batch_queue.back();
+                last_batch->push(metadata, serializer, data, promise, pending_bytes);
+                need_notification = true;
+            }
+            if(isFull(*last_batch)) {
                 need_notification = true;
+                batch_closed = true;
             }
-            last_batch->push(metadata, serializer, data, std::move(promise));
+            if(m_pending->hasWaiters())
+                need_notification = true;
         }
         if(need_notification)
             m_cv.notify_one();
+        if(batch_closed && m_on_batch_closed)
+            m_on_batch_closed();
     }
 
     void stop() {
@@ -173,7 +524,9 @@ class ActiveProducerBatchQueue {
 
     void start() {
         if(m_running) return;
+        m_sender_done = false;
         m_thread_pool->pushWork([this]() { loop(); });
+        m_thread_pool->pushWork([this]() { completionLoop(); });
     }
 
     void flush() {
@@ -185,72 +538,323 @@ class ActiveProducerBatchQueue {
         m_cv.notify_one();
     }
 
+    /**
+     * @brief Returns the number of events the queue currently
+     * tries to put in each batch.
+     */
+    size_t batchSize() {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        return targetBatchSize();
+    }
+
     private:
 
+    SP<ProducerBatchImpl> newBatch() {
+        static constexpr size_t MaxReservedSlots = 1024;
+        return m_batch_pool->acquire(std::min(targetBatchSize(), MaxReservedSlots));
+    }
+
+    size_t targetBatchSize() const {
+        return m_adaptive ? m_controller.batchSize() : m_batch_size.value;
+    }
+
+    bool isFull(const ProducerBatchImpl& batch) const {
+        return batch.count() >= targetBatchSize()
+            || batch.totalBulkSize() >= m_max_batch_bytes.value;
+    }
+
+    bool hasDeadline() const {
+        return m_adaptive || m_linger != Linger::Infinite();
+    }
+
+    /**
+     * @brief Maximum time the front batch may wait for more events:
+     * the linger duration, further bounded by the adaptive controller
+     * when the batch size is adaptive.
+     */
+    AdaptiveBatchController::clock::duration maxWait() const {
+        using clock = AdaptiveBatchController::clock;
+        auto max_wait = clock::duration::max();
+        if(m_linger != Linger::Infinite())
+            max_wait = std::chrono::duration_cast<clock::duration>(m_linger.value);
+        if(m_adaptive)
+            max_wait = std::min(max_wait,
+                std::chrono::duration_cast<clock::duration>(m_controller.maxWait()));
+        return max_wait;
+    }
+
+    bool readyToSend() const {
+        if(m_need_stop || m_request_flush) return true;
+        if(m_batch_queue.empty())          return false;
+        if(m_batch_queue.size() > 1)       return true;
+        /* a push is blocked until pending events complete */
+        if(m_pending->hasWaiters())        return true;
+        return isFull(*m_batch_queue.front());
+    }
+
+    /**
+     * @brief Blocks until the front batch is ready to be sent.
+     * A batch that does not fill up is sent anyway once it has
+     * waited for maxWait().
+     */
+    void waitForBatch(std::unique_lock<thallium::mutex>& guard) {
+        using clock = AdaptiveBatchController::clock;
+        while(!readyToSend()) {
+            if(!hasDeadline() || m_batch_queue.empty()) {
+                m_cv.wait(guard);
+                continue;
+            }
+            auto elapsed = clock::now() - m_batch_queue.front()->creationTime();
+            auto remaining = maxWait() - elapsed;
+            if(remaining <= clock::duration::zero()) return;
+            /* Argobots expects an absolute time based on the real-time clock */
+            auto abs_time = std::chrono::system_clock::now().time_since_epoch() + remaining;
+            auto abs_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(abs_time).count();
+            struct timespec ts;
+            ts.tv_sec  = abs_ns / 1000000000;
+            ts.tv_nsec = abs_ns % 1000000000;
+            m_cv.wait_until(guard, &ts);
+        }
+    }
+
     void loop() {
         m_running = true;
         std::unique_lock<thallium::mutex> guard{m_mutex};
         while(!m_need_stop || !m_batch_queue.empty()) {
-            m_cv.wait(guard, [this]() {
-                if(m_need_stop || m_request_flush)        return true;
-                if(m_batch_queue.empty())                 return false;
-                if(m_batch_size == BatchSize::Adaptive()) return true;
-                auto batch = m_batch_queue.front();
-                if(batch->count() == m_batch_size.value)  return true;
-                return false;
-            });
+            waitForBatch(guard);
             if(m_batch_queue.empty()) {
                 m_request_flush = false;
                 continue;
             }
+            /* wait for a slot in the in-flight window */
+            m_in_flight_cv.wait(guard, [this]() {
+                return m_in_flight.size() < m_max_in_flight.value;
+            });
             auto batch = m_batch_queue.front();
             m_batch_queue.pop();
+            /* a full batch was reported closed when it filled up */
+            auto batch_closed = !isFull(*batch);
             guard.unlock();
-            sendBatch(batch);
+            if(batch_closed && m_on_batch_closed)
+                m_on_batch_closed();
+            auto in_flight = sendBatch(batch);
             guard.lock();
+            if(in_flight) {
+                m_in_flight.push_back(std::move(in_flight));
+                m_in_flight_cv.notify_all();
+            }
             m_request_flush = false;
         }
+        m_sender_done = true;
+        m_in_flight_cv.notify_all();
+        guard.unlock();
+        m_completion_terminated.wait();
+        m_completion_terminated.reset();
         m_running = false;
         m_terminated.set_value();
     }
 
-    void sendBatch(const std::shared_ptr<ProducerBatchImpl>& batch) {
-        thallium::bulk metadata_content, data_content;
+    /**
+     * @brief Waits for the responses of in-flight batches and sets
+     * their promises. Batches are completed in the order they were
+     * sent, so futures complete in the order events were pushed.
+     */
+    void completionLoop() {
+        std::unique_lock<thallium::mutex> guard{m_mutex};
+        while(true) {
+            m_in_flight_cv.wait(guard, [this]() {
+                return !m_in_flight.empty() || m_sender_done;
+            });
+            if(m_in_flight.empty()) break;
+            auto in_flight = m_in_flight.front();
+            guard.unlock();
+            completeBatch(*in_flight);
+            auto rtt = AdaptiveBatchController::clock::now() - in_flight->start_time;
+            auto count = in_flight->batch->count();
+            retire(in_flight->batch);
+            if(m_on_batch_completed)
+                m_on_batch_completed(count, AdaptiveBatchController::duration{rtt});
+            guard.lock();
+            m_in_flight.pop_front();
+            if(m_adaptive)
+                m_controller.recordCompletion(
+                    count, AdaptiveBatchController::duration{rtt});
+            m_in_flight_cv.notify_all();
+        }
+        guard.unlock();
+        m_completion_terminated.set_value();
+    }
+
+    struct InFlightBatch {
+        SP<ProducerBatchImpl>                      batch;
+        uint64_t                                   seq = 0;       /* sequence number of the batch */
+        bool                                       eager = false; /* sent inline */
+        BulkRef                                    metadata_content;
+        BulkRef                                    data_content;
+        InlineContent                              inline_metadata;
+        InlineContent                              inline_data;
+        std::optional<thallium::async_response>    response;      /* empty if the RPC could not be sent */
+        std::string                                error;         /* last error when sending the batch */
+        AdaptiveBatchController::clock::time_point start_time;
+    };
+
+    SP<InFlightBatch> sendBatch(const SP<ProducerBatchImpl>& batch) {
+        auto in_flight = std::make_shared<InFlightBatch>();
+        in_flight->batch = batch;
+        in_flight->seq = m_next_batch_seq++;
+        in_flight->eager = batch->totalBulkSize() <= m_eager_threshold.value;
         try {
-            metadata_content = batch->exposeMetadata(m_client->m_engine);
-            data_content = batch->exposeData(m_client->m_engine);
+            if(in_flight->eager)
+                prepareEagerBatch(*in_flight);
+            else
+                prepareBatch(*in_flight);
         } catch(const std::exception& ex) {
             batch->setPromises(
                 Exception{fmt::format(
-                    "Unexpected error when registering batch for RDMA: {}", ex.what())});
-            return;
+                    "Unexpected error when preparing batch: {}", ex.what())});
+            auto count = batch->count();
+            retire(batch);
+            if(m_on_batch_cancelled) m_on_batch_cancelled(count);
+            return nullptr;
         }
+        in_flight->start_time = AdaptiveBatchController::clock::now();
+        issue(*in_flight);
+        return in_flight;
+    }
+
+    /**
+     * @brief Exposes the metadata and data of the batch for the server
+     * to pull them with RDMA.
+     */
+    void prepareBatch(InFlightBatch& in_flight) {
+        auto& batch = in_flight.batch;
+        auto self_addr = static_cast<std::string>(m_client->m_engine.self());
+        if(m_compressor.isPassThrough()) {
+            in_flight.metadata_content = BulkRef{
+                batch->exposeMetadata(m_client->m_engine),
+                batch->metadataBulkOffset(), batch->metadataBulkSize(), self_addr};
+        } else {
+            in_flight.metadata_content = BulkRef{
+                batch->exposeCompressedMetadata(m_client->m_engine, m_compressor),
+                0, batch->compressedMetadataBulkSize(), self_addr};
+        }
+        in_flight.data_content = BulkRef{
+            batch->exposeData(m_client->m_engine),
+            batch->dataBulkOffset(), batch->dataBulkSize(), self_addr};
+    }
+
+    /**
+     * @brief Prepares a small batch to be sent inline in the arguments of
+     * the RPC, sparing the server the RDMA transfers of metadata and data.
+     */
+    void prepareEagerBatch(InFlightBatch& in_flight) {
+        in_flight.inline_metadata.segments.push_back(
+            in_flight.batch->inlineMetadata(m_compressor));
+        in_flight.inline_data.segments = in_flight.batch->inlineData();
+    }
+
+    /**
+     * @brief Sends the RPC of a prepared batch. An error is kept in the
+     * InFlightBatch for completeBatch to send the batch again.
+     */
+    void issue(InFlightBatch& in_flight) {
+        in_flight.response.reset();
         try {
             auto ph = m_target->m_ph;
-            auto rpc = m_client->m_producer_send_batch;
-            auto self_addr = static_cast<std::string>(m_client->m_engine.self());
-            Result<EventID> result = rpc.on(ph)(
-                m_topic_name,
-                m_producer_name,
-                batch->count(),
-                BulkRef{metadata_content, 0, batch->metadataBulkSize(), self_addr},
-                BulkRef{data_content, 0, batch->dataBulkSize(), self_addr});
-            if(result.success())
-                batch->setPromises(result.value());
-            else
-                batch->setPromises(Exception{result.error()});
+            if(in_flight.eager) {
+                auto rpc = m_client->m_producer_send_eager_batch;
+                in_flight.response.emplace(rpc.on(ph).async(
+                    m_topic_name,
+                    m_producer_name,
+                    m_producer_id,
+                    in_flight.seq,
+                    in_flight.batch->count(),
+                    in_flight.inline_metadata,
+                    in_flight.inline_data));
+            } else {
+                auto rpc = m_client->m_producer_send_batch;
+                in_flight.response.emplace(rpc.on(ph).async(
+                    m_topic_name,
+                    m_producer_name,
+                    m_producer_id,
+                    in_flight.seq,
+                    in_flight.batch->count(),
+                    in_flight.metadata_content,
+                    in_flight.data_content));
+            }
         } catch(const std::exception& ex) {
-            batch->setPromises(
-                Exception{fmt::format("Unexpected error when sending batch: {}", ex.what())});
+            in_flight.error = ex.what();
         }
     }
 
+    /**
+     * @brief Releases the events of a batch whose promises have been set
+     * and returns the batch to the pool.
+     */
+    void retire(const SP<ProducerBatchImpl>& batch) {
+        if(m_pending->enabled())
+            m_pending->release(batch->count(), batch->pendingBytes());
+        m_batch_pool->release(batch);
+    }
+
+    /**
+     * @brief Waits for the response of the batch and sets its promises.
+     * If the RPC failed, the batch is sent again with an exponential
+     * backoff, up to MaxBatchRetries times. The server recognizes a batch
+     * it already appended from its sequence number, so sending it again
+     * does not duplicate its events. Errors reported by the server are
+     * not retried.
+     */
+    void completeBatch(InFlightBatch& in_flight) {
+        auto& batch = in_flight.batch;
+        auto backoff = InitialRetryBackoff;
+        for(size_t attempt = 0; ; ++attempt) {
+            if(in_flight.response) {
+                try {
+                    Result<EventID> result = in_flight.response->wait();
+                    if(result.success())
+                        batch->setPromises(result.value());
+                    else
+                        batch->setPromises(Exception{result.error()});
+                    return;
+                } catch(const std::exception& ex) {
+                    in_flight.error = ex.what();
+                }
+            }
+            if(attempt >= m_max_retries.value) break;
+            thallium::thread::sleep(m_client->m_engine, backoff.count());
+            backoff = std::min(2*backoff, MaxRetryBackoff);
+            issue(in_flight);
+        }
+        batch->setPromises(
+            Exception{fmt::format("Unexpected error when sending batch: {}", in_flight.error)});
+    }
+
+    static constexpr std::chrono::milliseconds InitialRetryBackoff{10};
+    static constexpr std::chrono::milliseconds MaxRetryBackoff{1000};
+
     std::string                         m_topic_name;
     std::string                         m_producer_name;
+    UUID                                m_producer_id;
     SP<ClientImpl>                      m_client;
     SP<PartitionTargetInfoImpl>         m_target;
     SP<ThreadPoolImpl>                  m_thread_pool;
+    SP<ProducerBatchPool>               m_batch_pool;
+    SP<PendingEventsLimiter>            m_pending;
+    std::function<void()>               m_on_batch_closed; /* called when a batch stops accepting events */
+    std::function<void(size_t, AdaptiveBatchController::duration)>
+                                        m_on_batch_completed; /* called with the size and RTT of completed batches */
+    std::function<void(size_t)>         m_on_batch_cancelled; /* called with the size of batches that were never sent */
+    Compressor                          m_compressor;
     BatchSize                           m_batch_size;
+    bool                                m_adaptive;
+    AdaptiveBatchController             m_controller;
+    MaxBatchBytes                       m_max_batch_bytes;
+    Linger                              m_linger;
+    MaxInFlightBatches                  m_max_in_flight;
+    EagerThreshold                      m_eager_threshold;
+    MaxBatchRetries                     m_max_retries;
+    uint64_t                            m_next_batch_seq = 0; /* only accessed by the sender ULT */
     std::queue<SP<ProducerBatchImpl>>   m_batch_queue;
     thallium::managed<thallium::thread> m_sender_ult;
     bool                                m_need_stop = false;
@@ -259,6 +863,10 @@ class ActiveProducerBatchQueue {
     thallium::mutex                     m_mutex;
     thallium::condition_variable        m_cv;
     thallium::eventual<void>            m_terminated;
+    std::deque<SP<InFlightBatch>>       m_in_flight;
+    bool                                m_sender_done = false;
+    thallium::condition_variable        m_in_flight_cv;
+    thallium::eventual<void>            m_completion_terminated;
 
 };
 
@@ -10,10 +10,23 @@
 #include "TopicHandleImpl.hpp"
 #include "PartitionTargetInfoImpl.hpp"
 #include "ProducerBatchImpl.hpp"
+#include "Sequencer.hpp"
+#include "PendingEventsLimiter.hpp"
+#include "CompletionGroup.hpp"
 
 #include "mofka/Producer.hpp"
 #include "mofka/UUID.hpp"
 #include "mofka/Ordering.hpp"
+#include "mofka/BatchingGoal.hpp"
+#include "mofka/MaxBatchBytes.hpp"
+#include "mofka/Linger.hpp"
+#include "mofka/MaxInFlightBatches.hpp"
+#include "mofka/EagerThreshold.hpp"
+#include "mofka/StagingThreshold.hpp"
+#include "mofka/MaxPendingEvents.hpp"
+#include "mofka/MaxPendingBytes.hpp"
+#include "mofka/BackpressurePolicy.hpp"
+#include "mofka/MaxBatchRetries.hpp"
 
 #include <thallium.hpp>
 #include <string_view>
@@ -26,34 +39,141 @@ class ProducerImpl {
     public:
 
     std::string         m_name;
+    const UUID          m_uuid;
     BatchSize           m_batch_size;
+    BatchingGoal        m_batching_goal;
+    MaxBatchBytes       m_max_batch_bytes;
+    Linger              m_linger;
+    MaxInFlightBatches  m_max_in_flight;
+    EagerThreshold      m_eager_threshold;
+    StagingThreshold    m_staging_threshold;
+    MaxPendingEvents    m_max_pending_events;
+    MaxPendingBytes     m_max_pending_bytes;
+    BackpressurePolicy  m_backpressure_policy;
+    MaxBatchRetries     m_max_retries;
     SP<ThreadPoolImpl>  m_thread_pool;
     Ordering            m_ordering;
     SP<TopicHandleImpl> m_topic;
 
+    SP<ProducerBatchPool> m_batch_pool;
+    SP<PendingEventsLimiter> m_pending;
+
     std::unordered_map<
         PartitionTargetInfo,
         SP<ActiveProducerBatchQueue>> m_batch_queues;
     thallium::mutex                   m_batch_queues_mtx;
-    thallium::condition_variable      m_batch_queues_cv;
 
     size_t                       m_num_posted_ults = 0;
     thallium::mutex              m_num_posted_ults_mtx;
     thallium::condition_variable m_num_posted_ults_cv;
 
+    SP<CompletionGroup> m_completion_group;          /* group of the next events pushed one by one */
+    size_t              m_completion_group_next = 0; /* next free slot in m_completion_group */
+    thallium::mutex     m_completion_group_mtx;
+
     std::atomic<size_t> m_num_pushed_events = 0;
-    std::atomic<size_t> m_num_ready_events = 0;
+    Sequencer           m_sequencer; /* admits events in order with Ordering::Strict */
+
+    struct PartitionSequencer {
+        uint64_t  next_ticket = 0;
+        Sequencer sequencer;
+    };
+
+    std::unordered_map<
+        PartitionTargetInfo,
+        std::unique_ptr<PartitionSequencer>> m_partition_sequencers; /* with Ordering::PerPartition */
+    thallium::mutex                          m_partition_sequencers_mtx;
+
+    /**
+     * @brief Turn of an event in the Sequencer ordering it, if any.
+     */
+    struct Ticket {
+        Sequencer* sequencer = nullptr;
+        uint64_t   number    = 0;
+    };
 
     ProducerImpl(std::string_view name,
                  BatchSize batch_size,
+                 BatchingGoal batching_goal,
+                 MaxBatchBytes max_batch_bytes,
+                 Linger linger,
+                 MaxInFlightBatches max_in_flight,
+                 EagerThreshold eager_threshold,
+                 StagingThreshold staging_threshold,
+                 MaxPendingEvents max_pending_events,
+                 MaxPendingBytes max_pending_bytes,
+                 BackpressurePolicy backpressure_policy,
+                 MaxBatchRetries max_retries,
                  SP<ThreadPoolImpl> thread_pool,
                  Ordering ordering,
                  SP<TopicHandleImpl> topic)
     : m_name(name)
+    , m_uuid(UUID::generate())
     , m_batch_size(batch_size)
+    , m_batching_goal(batching_goal)
+    , m_max_batch_bytes(max_batch_bytes)
+    , m_linger(linger)
+    , m_max_in_flight(max_in_flight)
+    , m_eager_threshold(eager_threshold)
+    , m_staging_threshold(staging_threshold)
+    , m_max_pending_events(max_pending_events)
+    , m_max_pending_bytes(max_pending_bytes)
+    , m_backpressure_policy(backpressure_policy)
+    , m_max_retries(max_retries)
     , m_thread_pool(std::move(thread_pool))
     , m_ordering(ordering)
-    , m_topic(std::move(topic)) {}
+    , m_topic(std::move(topic)) {
+        m_batch_pool = std::make_shared<ProducerBatchPool>(m_staging_threshold);
+        m_pending = std::make_shared<PendingEventsLimiter>(
+            m_max_pending_events, m_max_pending_bytes);
+    }
+
+    /**
+     * @brief Counts the events as pending, applying the BackpressurePolicy
+     * if they don't fit within the limits. Returns false if the events
+     * are rejected, and throws a BackpressureException with
+     * BackpressurePolicy::Throw.
+     */
+    bool admit(size_t events, size_t bytes);
+
+    /**
+     * @brief Releases events that did not make it into a batch.
+     */
+    void release(size_t events, size_t bytes) {
+        if(m_pending->enabled()) m_pending->release(events, bytes);
+    }
+
+    /**
+     * @brief Waits for the ULTs posted by the producer to complete,
+     * then sends all the pending batches.
+     */
+    void flush();
+
+    /**
+     * @brief Asks all the ActiveProducerBatchQueues to send their
+     * batches without waiting for them to fill up.
+     */
+    void requestFlush();
+
+    /**
+     * @brief Returns the Ticket of an event given its local ID and, with
+     * Ordering::PerPartition, the target selected for it. Must be called
+     * in the order the events were pushed.
+     */
+    Ticket takeTicket(size_t local_event_id, const PartitionTargetInfo& target);
+
+    /**
+     * @brief Validates the event, selects its target if not already
+     * selected, and pushes it into the corresponding ActiveProducerBatchQueue
+     * once its ticket's turn has come. Must be called from a ULT posted by
+     * the producer.
+     */
+    void pushEvent(Metadata& metadata,
+                   Data& data,
+                   EventPromise& promise,
+                   PartitionTargetInfo target,
+                   Ticket ticket,
+                   size_t pending_bytes);
 
 };
 
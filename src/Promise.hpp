@@ -10,7 +10,10 @@
 #include "mofka/EventID.hpp"
 #include "mofka/Exception.hpp"
 #include <thallium.hpp>
+#include <exception>
+#include <mutex>
 #include <variant>
+#include <vector>
 
 namespace mofka {
 
@@ -26,39 +29,106 @@ struct Promise {
     void setValue(Type value) {
         auto state = m_state.lock();
         if(state)
-            state->set_value(std::move(value));
+            state->set(std::move(value));
     }
 
     void setException(Exception ex) {
         auto state = m_state.lock();
         if(state)
-            state->set_value(std::move(ex));
+            state->set(std::make_exception_ptr(std::move(ex)));
     }
 
+    /**
+     * @brief Creates a Future/Promise pair.
+     *
+     * @param on_wait Function called by Future::wait before blocking.
+     * @param on_wait_key Identifies the object on_wait acts upon.
+     * @param execute Function submitting the callbacks of Future::then
+     * to a ThreadPool.
+     * @param on_test Function called by Future::completed.
+     */
     static inline std::pair<Future<Type>, Promise<Type>> CreateFutureAndPromise(
         std::function<void()> on_wait = std::function<void()>{},
+        const void* on_wait_key = nullptr,
+        typename Future<Type>::ExecuteFn execute = typename Future<Type>::ExecuteFn{},
         std::function<void(bool)> on_test = std::function<void(bool)>{}) {
         auto state = std::make_shared<State>();
-        auto wait_fn = [state, on_wait=std::move(on_wait)]() mutable -> Type {
-            if(on_wait) on_wait();
-            auto v = state->wait();
-            if(std::holds_alternative<Exception>(v))
-                throw std::get<Exception>(v);
+        auto wait_fn = [state]() -> Type {
+            auto v = state->eventual.wait();
+            if(std::holds_alternative<std::exception_ptr>(v))
+                std::rethrow_exception(std::get<std::exception_ptr>(v));
             return std::get<Type>(v);
         };
         auto complete_fn = [state, on_test=std::move(on_test)]() mutable -> bool {
-            auto is_ready = state->test();
+            auto is_ready = state->eventual.test();
             if(on_test) on_test(is_ready);
             return is_ready;
         };
+        auto subscribe_fn = [state](std::function<void(const Outcome&)> callback) {
+            return state->subscribe(std::move(callback));
+        };
+        auto unsubscribe_fn = [state](Subscription subscription) {
+            state->unsubscribe(subscription);
+        };
         return std::make_pair(
-            Future<Type>{std::move(wait_fn), std::move(complete_fn)},
+            Future<Type>{std::move(wait_fn), std::move(complete_fn),
+                         std::move(subscribe_fn), std::move(execute),
+                         std::move(on_wait), on_wait_key,
+                         std::move(unsubscribe_fn)},
             Promise<Type>{std::move(state)});
     }
 
     private:
 
-    using State = thallium::eventual<std::variant<Type, Exception>>;
+    using Outcome = typename Future<Type>::Outcome;
+    using Subscription = typename Future<Type>::Subscription;
+
+    /**
+     * @brief Shared state of a Future/Promise pair. Callbacks registered
+     * with subscribe are invoked by the ULT setting the outcome.
+     */
+    struct State {
+
+        using Callback = std::function<void(const Outcome&)>;
+
+        thallium::eventual<Outcome>                   eventual;
+        thallium::mutex                               mutex;
+        bool                                          is_set = false;
+        Subscription                                  last_subscription = 0;
+        std::vector<std::pair<Subscription, Callback>> callbacks;
+
+        void set(Outcome outcome) {
+            decltype(callbacks) to_invoke;
+            {
+                std::lock_guard<thallium::mutex> guard{mutex};
+                is_set = true;
+                to_invoke.swap(callbacks);
+            }
+            for(auto& p : to_invoke) p.second(outcome);
+            eventual.set_value(std::move(outcome));
+        }
+
+        Subscription subscribe(Callback callback) {
+            {
+                std::lock_guard<thallium::mutex> guard{mutex};
+                if(!is_set) {
+                    callbacks.emplace_back(++last_subscription, std::move(callback));
+                    return last_subscription;
+                }
+            }
+            callback(eventual.wait());
+            return FutureState<Type>::NoSubscription;
+        }
+
+        void unsubscribe(Subscription subscription) {
+            std::lock_guard<thallium::mutex> guard{mutex};
+            for(auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+                if(it->first != subscription) continue;
+                callbacks.erase(it);
+                return;
+            }
+        }
+    };
 
     Promise(std::shared_ptr<State> state)
     : m_state(std::move(state)) {}
@@ -11,6 +11,7 @@
 #include "CerealArchiveAdaptor.hpp"
 #include "ConsumerHandleImpl.hpp"
 #include "MetadataImpl.hpp"
+#include "InlineContent.hpp"
 
 #include <thallium.hpp>
 #include <thallium/serialization/stl/string.hpp>
@@ -55,9 +56,11 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
     tl::auto_remote_procedure m_open_topic;
     // RPCs for TopicManagers
     tl::auto_remote_procedure m_producer_send_batch;
+    tl::auto_remote_procedure m_producer_send_eager_batch;
     tl::auto_remote_procedure m_consumer_request_events;
     tl::auto_remote_procedure m_consumer_ack_event;
     tl::auto_remote_procedure m_consumer_remove_consumer;
+    tl::auto_remote_procedure m_consumer_grant_credits;
     tl::auto_remote_procedure m_consumer_request_data;
     /* RPC for Consumers */
     thallium::remote_procedure m_consumer_recv_batch;
@@ -77,9 +80,11 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
     , m_create_topic(define("mofka_create_topic", &ProviderImpl::createTopic, pool))
     , m_open_topic(define("mofka_open_topic", &ProviderImpl::openTopic, pool))
     , m_producer_send_batch(define("mofka_producer_send_batch",  &ProviderImpl::receiveBatch, pool))
+    , m_producer_send_eager_batch(define("mofka_producer_send_eager_batch",  &ProviderImpl::receiveEagerBatch, pool))
     , m_consumer_request_events(define("mofka_consumer_request_events", &ProviderImpl::requestEvents, pool))
     , m_consumer_ack_event(define("mofka_consumer_ack_event", &ProviderImpl::acknowledge, pool))
     , m_consumer_remove_consumer(define("mofka_consumer_remove_consumer", &ProviderImpl::removeConsumer, pool))
+    , m_consumer_grant_credits(define("mofka_consumer_grant_credits", &ProviderImpl::grantCredits, pool))
     , m_consumer_request_data(define("mofka_consumer_request_data", &ProviderImpl::requestData, pool))
     , m_consumer_recv_batch(m_engine.define("mofka_consumer_recv_batch"))
     {
@@ -101,12 +106,13 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
                      Metadata backend_config,
                      Metadata validator_meta,
                      Metadata selector_meta,
-                     Metadata serializer_meta) {
+                     Metadata serializer_meta,
+                     Metadata compressor_meta) {
 
         spdlog::trace("[mofka:{}] Received createTopic request", id());
         spdlog::trace("[mofka:{}] => name       = {}", id(), topic_name);
 
-        using ResultType = std::tuple<Metadata, Metadata, Metadata>;
+        using ResultType = std::tuple<Metadata, Metadata, Metadata, Metadata>;
         Result<ResultType> result;
         tl::auto_respond<decltype(result)> ensureResponse(req, result);
 
@@ -141,7 +147,8 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
                 backend_config,
                 validator_meta,
                 selector_meta,
-                serializer_meta);
+                serializer_meta,
+                compressor_meta);
         } catch(const std::exception& ex) {
             result.success() = false;
             result.error() = fmt::format("Error when creating topic \"{}\": {}", topic_name, ex.what());
@@ -160,7 +167,8 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
             result.value() = std::make_tuple(
                 topic->getValidatorMetadata(),
                 topic->getTargetSelectorMetadata(),
-                topic->getSerializerMetadata());
+                topic->getSerializerMetadata(),
+                topic->getCompressorMetadata());
         }
 
         spdlog::trace("[mofka:{}] Successfully created topic \"{}\" of type {}",
@@ -170,7 +178,7 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
     void openTopic(const tl::request& req,
                    const std::string& topic_name) {
         spdlog::trace("[mofka:{}] Received openTopic request for topic {}", id(), topic_name);
-        using ResultType = std::tuple<Metadata, Metadata, Metadata>;
+        using ResultType = std::tuple<Metadata, Metadata, Metadata, Metadata>;
         Result<ResultType> result;
         tl::auto_respond<decltype(result)> ensureResponse(req, result);
 
@@ -179,13 +187,16 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
         result.value() = std::make_tuple(
                 topic->getValidatorMetadata(),
                 topic->getTargetSelectorMetadata(),
-                topic->getSerializerMetadata());
+                topic->getSerializerMetadata(),
+                topic->getCompressorMetadata());
         spdlog::trace("[mofka:{}] Code successfully executed on topic {}", id(), topic_name);
     }
 
     void receiveBatch(const tl::request& req,
                       const std::string& topic_name,
                       const std::string& producer_name,
+                      const UUID& producer_id,
+                      uint64_t batch_seq,
                       size_t count,
                       const BulkRef& metadata,
                       const BulkRef& data) {
@@ -194,17 +205,38 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
         tl::auto_respond<decltype(result)> ensureResponse(req, result);
         FIND_TOPIC_BY_NAME(topic, topic_name);
         result = topic->receiveBatch(
-            req.get_endpoint(), producer_name, count, metadata, data);
+            req.get_endpoint(), producer_name, producer_id, batch_seq,
+            count, metadata, data);
         spdlog::trace("[mofka:{}] Successfully executed receiveBatch on topic {}", id(), topic_name);
     }
 
+    void receiveEagerBatch(const tl::request& req,
+                           const std::string& topic_name,
+                           const std::string& producer_name,
+                           const UUID& producer_id,
+                           uint64_t batch_seq,
+                           size_t count,
+                           const InlineContent& metadata,
+                           const InlineContent& data) {
+        spdlog::trace("[mofka:{}] Received receiveEagerBatch request for topic {}", id(), topic_name);
+        Result<EventID> result;
+        tl::auto_respond<decltype(result)> ensureResponse(req, result);
+        FIND_TOPIC_BY_NAME(topic, topic_name);
+        result = topic->receiveEagerBatch(
+            req.get_endpoint(), producer_name, producer_id, batch_seq, count,
+            std::string_view{metadata.buffer.data(), metadata.buffer.size()},
+            std::string_view{data.buffer.data(), data.buffer.size()});
+        spdlog::trace("[mofka:{}] Successfully executed receiveEagerBatch on topic {}", id(), topic_name);
+    }
+
     void requestEvents(const tl::request& req,
                        const std::string& topic_name,
                        intptr_t consumer_ctx,
                        size_t target_info_index,
                        const UUID& consumer_id,
                        const std::string& consumer_name,
-                       size_t count,
+                       size_t max_events,
+                       size_t max_bytes,
                        size_t batch_size) {
         spdlog::trace("[mofka:{}] Received requestEvents request for topic {}", id(), topic_name);
         Result<void> result;
@@ -212,7 +244,7 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
         FIND_TOPIC_BY_NAME(topic, topic_name);
         auto consumer_handle_impl = std::make_shared<ConsumerHandleImpl>(
             consumer_ctx, target_info_index,
-            consumer_name, count, topic,
+            consumer_name, max_events, max_bytes, topic,
             req.get_endpoint(),
             m_consumer_recv_batch);
         {
@@ -260,15 +292,41 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
         spdlog::trace("[mofka:{}] Successfully executed removeConsumer", id());
     }
 
+    void grantCredits(const tl::request& req,
+                      const UUID& consumer_id,
+                      size_t target_info_index,
+                      size_t events,
+                      size_t bytes) {
+        spdlog::trace("[mofka:{}] Received grantCredits request", id());
+        Result<void> result;
+        tl::auto_respond<decltype(result)> ensureResponse(req, result);
+        std::shared_ptr<ConsumerHandleImpl> consumer_handle_impl;
+        {
+            auto g = std::unique_lock<tl::mutex>{m_consumers_mtx};
+            auto it = m_consumers.find(consumer_id);
+            if(it != m_consumers.end())
+                consumer_handle_impl = it->second;
+        }
+        // the consumer may have been removed in the meantime
+        if(consumer_handle_impl
+        && consumer_handle_impl->m_target_info_index == target_info_index)
+            consumer_handle_impl->grantCredits(events, bytes);
+        spdlog::trace("[mofka:{}] Successfully executed grantCredits", id());
+    }
+
     void requestData(const tl::request& req,
                      const std::string& topic_name,
-                     const Cerealized<DataDescriptor>& descriptor,
+                     const std::vector<Cerealized<DataDescriptor>>& descriptors,
                      const BulkRef& remote_bulk) {
         spdlog::trace("[mofka:{}] Received requestData request", id());
         Result<std::vector<Result<void>>> result;
         tl::auto_respond<decltype(result)> ensureResponse(req, result);
         FIND_TOPIC_BY_NAME(topic, topic_name);
-        result = topic->getData({descriptor.content}, remote_bulk);
+        std::vector<DataDescriptor> content;
+        content.reserve(descriptors.size());
+        for(auto& descriptor : descriptors)
+            content.push_back(descriptor.content);
+        result = topic->getData(content, remote_bulk);
         spdlog::trace("[mofka:{}] Successfully executed requestData", id());
     }
 
@@ -8,10 +8,10 @@
 
 #include <valijson/adapters/rapidjson_adapter.hpp>
 #include "mofka/Data.hpp"
+#include "JsonScanner.hpp"
 #include <valijson/schema.hpp>
 #include <valijson/schema_parser.hpp>
 #include <valijson/validator.hpp>
-#include <stack>
 #include <string>
 #include <string_view>
 
@@ -64,41 +64,7 @@ class ArchiveWrapper {
 };
 
 static inline bool ValidateIsJson(std::string_view json) {
-    std::stack<char> brackets;
-    bool insideString = false;
-    bool escaped = false;
-
-    for (char c : json) {
-        if (!escaped) {
-            if (c == '"') {
-                insideString = !insideString;
-            } else if (!insideString) {
-                if (c == '{' || c == '[') {
-                    brackets.push(c);
-                } else if (c == '}' || c == ']') {
-                    if (brackets.empty()) {
-                        // Extra closing bracket encountered
-                        return false;
-                    }
-                    char top = brackets.top();
-                    brackets.pop();
-
-                    if ((c == '}' && top != '{') || (c == ']' && top != '[')) {
-                        // Mismatched brackets
-                        return false;
-                    }
-                }
-            }
-        }
-
-        if (c == '\\') {
-            escaped = !escaped;
-        } else {
-            escaped = false;
-        }
-    }
-
-    return brackets.empty();
+    return JsonScanner::ValidateStructure(json);
 }
 
 struct RapidJsonValidator {
@@ -0,0 +1,502 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_SCHEMA_SERIALIZER_H
+#define MOFKA_SCHEMA_SERIALIZER_H
+
+#include "RapidJsonUtil.hpp"
+#include "mofka/Serializer.hpp"
+#include "mofka/Exception.hpp"
+#include "mofka/Json.hpp"
+
+#include <fmt/format.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief Serializer encoding metadata in a compact binary form driven
+ * by a schema, and decoding it directly into a rapidjson Document
+ * without parsing any JSON text.
+ *
+ * The schema lists the expected fields of the metadata object, with their
+ * type ("bool", "int64", "uint64", "double", "string", "object" with its
+ * own "fields", or "any"). Fields of the schema are encoded by their
+ * position (a bitmap tells which ones are present), so their names are
+ * not transferred. Fields that are not in the schema, or whose value does
+ * not match the type of the schema, are encoded with their name after the
+ * fields of the schema, using a self-describing binary form. Any metadata
+ * therefore round-trips, although the fields of the schema come first in
+ * the decoded object.
+ *
+ * Integers are encoded as (zigzag) varints, doubles as 8 bytes, strings as
+ * a varint length followed by their content. Field names that are not in
+ * the schema go through a dictionary local to the event: the first
+ * occurrence of a name is written in full, the next ones (e.g. in an
+ * array of objects) as the index of the first one. Events are decoded
+ * independently of one another, so the dictionary is not shared across
+ * events.
+ *
+ * Decoding rejects values nested more than MaxDepth levels deep, so that
+ * corrupted or malicious metadata cannot exhaust the stack.
+ *
+ * Example of Metadata:
+ * { "__type__": "schema",
+ *   "fields": [ { "name": "time", "type": "double" },
+ *               { "name": "host", "type": "string" },
+ *               { "name": "cpu",  "type": "object",
+ *                 "fields": [ { "name": "load", "type": "double" } ] } ] }
+ */
+class SchemaSerializer : public SerializerInterface {
+
+    enum class Type : uint8_t {
+        Null, False, True, Int64, Uint64, Double, String, Array, Object, /* tags of self-describing values */
+        Bool, Any /* only in schemas */
+    };
+
+    struct Schema;
+
+    struct Field {
+        std::string             name;
+        Type                    type;
+        std::unique_ptr<Schema> nested; /* for Type::Object */
+    };
+
+    struct Schema {
+        std::vector<Field>                           fields;
+        std::unordered_map<std::string_view, size_t> indices; /* index of each field by name */
+    };
+
+    /* encoded records start with this byte */
+    enum RecordKind : uint8_t { ObjectRecord = 0, ValueRecord = 1 };
+
+    Metadata m_config;
+    Schema   m_schema;
+
+    public:
+
+    /* Maximum nesting depth of the values that can be decoded. */
+    static constexpr size_t MaxDepth = 128;
+
+    SchemaSerializer(const Metadata& config)
+    : m_config(config) {
+        const auto& json = config.json();
+        if(!json.IsObject() || !json.HasMember("fields"))
+            throw Exception{"Missing \"fields\" for schema Serializer"};
+        ParseSchema(json["fields"], m_schema);
+    }
+
+    void serialize(Archive& archive, const Metadata& metadata) const override {
+        thread_local std::vector<char> buffer;
+        buffer.clear();
+        EncodedNames().clear();
+        const auto& json = metadata.json();
+        if(json.IsObject()) {
+            buffer.push_back(ObjectRecord);
+            EncodeObject(m_schema, json, buffer);
+        } else {
+            buffer.push_back(ValueRecord);
+            EncodeAny(json, buffer);
+        }
+        size_t s = buffer.size();
+        archive.write(&s, sizeof(s));
+        archive.write(buffer.data(), s);
+    }
+
+    void deserialize(Archive& archive, Metadata& metadata) const override {
+        thread_local std::vector<char> buffer;
+        size_t s = 0;
+        archive.read(&s, sizeof(s));
+        buffer.resize(s);
+        archive.read(buffer.data(), s);
+        Reader reader{buffer.data(), buffer.data() + s};
+        DecodedNames().clear();
+        auto& doc = metadata.json();
+        auto& allocator = doc.GetAllocator();
+        if(reader.byte() == ObjectRecord) {
+            doc.SetObject();
+            DecodeObject(m_schema, reader, doc, allocator, 1);
+        } else {
+            DecodeAny(reader, doc, allocator, 1);
+        }
+        if(reader.ptr != reader.end)
+            throw Exception{"Invalid binary metadata (trailing bytes)"};
+    }
+
+    Metadata metadata() const override {
+        return m_config;
+    }
+
+    static std::unique_ptr<SerializerInterface> create(const Metadata& metadata) {
+        return std::make_unique<SchemaSerializer>(metadata);
+    }
+
+    private:
+
+    static void ParseSchema(const rapidjson::Value& fields, Schema& schema) {
+        if(!fields.IsArray())
+            throw Exception{"Invalid \"fields\" for schema Serializer (expected array)"};
+        static const std::unordered_map<std::string_view, Type> types = {
+            {"bool", Type::Bool}, {"int64", Type::Int64}, {"uint64", Type::Uint64},
+            {"double", Type::Double}, {"string", Type::String},
+            {"object", Type::Object}, {"any", Type::Any}
+        };
+        schema.fields.reserve(fields.Size());
+        for(auto& f : fields.GetArray()) {
+            if(!f.IsObject() || !f.HasMember("name") || !f["name"].IsString()
+            || !f.HasMember("type") || !f["type"].IsString())
+                throw Exception{"Invalid field for schema Serializer (expected object with \"name\" and \"type\" strings)"};
+            auto type = types.find(f["type"].GetString());
+            if(type == types.end())
+                throw Exception{fmt::format(
+                    "Invalid type \"{}\" for field \"{}\" of schema Serializer",
+                    f["type"].GetString(), f["name"].GetString())};
+            Field field{std::string{f["name"].GetString(), f["name"].GetStringLength()},
+                        type->second, nullptr};
+            if(field.type == Type::Object) {
+                if(!f.HasMember("fields"))
+                    throw Exception{fmt::format(
+                        "Missing \"fields\" for object field \"{}\" of schema Serializer", field.name)};
+                field.nested = std::make_unique<Schema>();
+                ParseSchema(f["fields"], *field.nested);
+            }
+            schema.fields.push_back(std::move(field));
+        }
+        /* string_views refer to the names, which don't move anymore */
+        for(size_t i = 0; i < schema.fields.size(); ++i)
+            schema.indices.emplace(schema.fields[i].name, i);
+    }
+
+    /* ---------------------------------------------------------------- */
+    /* Encoding                                                          */
+    /* ---------------------------------------------------------------- */
+
+    static void WriteVarint(uint64_t v, std::vector<char>& out) {
+        while(v >= 0x80) {
+            out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<char>(v));
+    }
+
+    static void WriteString(const char* str, size_t size, std::vector<char>& out) {
+        WriteVarint(size, out);
+        out.insert(out.end(), str, str + size);
+    }
+
+    /* names written so far in the current event, with their index */
+    static std::unordered_map<std::string_view, size_t>& EncodedNames() {
+        thread_local std::unordered_map<std::string_view, size_t> names;
+        return names;
+    }
+
+    /* a name seen before is written as (index << 1) | 1,
+     * a new one as (length << 1) followed by its content */
+    static void WriteName(const rapidjson::Value& name, std::vector<char>& out) {
+        auto& names = EncodedNames();
+        std::string_view s{name.GetString(), name.GetStringLength()};
+        auto it = names.find(s);
+        if(it != names.end()) {
+            WriteVarint((it->second << 1) | 1, out);
+            return;
+        }
+        names.emplace(s, names.size());
+        WriteVarint(s.size() << 1, out);
+        out.insert(out.end(), s.begin(), s.end());
+    }
+
+    static void WriteDouble(double d, std::vector<char>& out) {
+        char bytes[sizeof(d)];
+        std::memcpy(bytes, &d, sizeof(d));
+        out.insert(out.end(), bytes, bytes + sizeof(d));
+    }
+
+    static uint64_t ZigZag(int64_t v) {
+        return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    }
+
+    static bool Matches(const Field& field, const rapidjson::Value& value) {
+        switch(field.type) {
+        case Type::Bool:   return value.IsBool();
+        case Type::Int64:  return value.IsInt64();
+        case Type::Uint64: return value.IsUint64();
+        case Type::Double: return value.IsDouble();
+        case Type::String: return value.IsString();
+        case Type::Object: return value.IsObject();
+        default:           return true;
+        }
+    }
+
+    static void EncodeTyped(const Field& field, const rapidjson::Value& value, std::vector<char>& out) {
+        switch(field.type) {
+        case Type::Bool:   out.push_back(value.GetBool() ? 1 : 0); break;
+        case Type::Int64:  WriteVarint(ZigZag(value.GetInt64()), out); break;
+        case Type::Uint64: WriteVarint(value.GetUint64(), out); break;
+        case Type::Double: WriteDouble(value.GetDouble(), out); break;
+        case Type::String: WriteString(value.GetString(), value.GetStringLength(), out); break;
+        case Type::Object: EncodeObject(*field.nested, value, out); break;
+        default:           EncodeAny(value, out); break;
+        }
+    }
+
+    static void EncodeObject(const Schema& schema, const rapidjson::Value& object, std::vector<char>& out) {
+        thread_local std::vector<const rapidjson::Value*> slots_storage;
+        /* nested objects are encoded recursively, so each level
+         * uses its own part of the thread-local storage */
+        auto base = slots_storage.size();
+        slots_storage.resize(base + schema.fields.size(), nullptr);
+        size_t num_extras = object.MemberCount();
+        for(auto& member : object.GetObject()) {
+            auto it = schema.indices.find(
+                std::string_view{member.name.GetString(), member.name.GetStringLength()});
+            if(it == schema.indices.end()) continue;
+            auto& slot = slots_storage[base + it->second];
+            if(slot || !Matches(schema.fields[it->second], member.value)) continue;
+            slot = &member.value;
+            num_extras -= 1;
+        }
+        /* bitmap of the fields of the schema that are present */
+        auto bitmap_offset = out.size();
+        out.resize(out.size() + (schema.fields.size() + 7)/8, 0);
+        for(size_t i = 0; i < schema.fields.size(); ++i) {
+            auto value = slots_storage[base + i];
+            if(!value) continue;
+            out[bitmap_offset + i/8] |= static_cast<char>(1 << (i % 8));
+            EncodeTyped(schema.fields[i], *value, out);
+        }
+        /* other fields, with their name */
+        WriteVarint(num_extras, out);
+        for(auto& member : object.GetObject()) {
+            auto it = schema.indices.find(
+                std::string_view{member.name.GetString(), member.name.GetStringLength()});
+            if(it != schema.indices.end() && slots_storage[base + it->second] == &member.value)
+                continue;
+            WriteName(member.name, out);
+            EncodeAny(member.value, out);
+        }
+        slots_storage.resize(base);
+    }
+
+    static void EncodeAny(const rapidjson::Value& value, std::vector<char>& out) {
+        switch(value.GetType()) {
+        case rapidjson::kNullType:
+            out.push_back(static_cast<char>(Type::Null));
+            break;
+        case rapidjson::kFalseType:
+            out.push_back(static_cast<char>(Type::False));
+            break;
+        case rapidjson::kTrueType:
+            out.push_back(static_cast<char>(Type::True));
+            break;
+        case rapidjson::kNumberType:
+            if(value.IsInt64()) {
+                out.push_back(static_cast<char>(Type::Int64));
+                WriteVarint(ZigZag(value.GetInt64()), out);
+            } else if(value.IsUint64()) {
+                out.push_back(static_cast<char>(Type::Uint64));
+                WriteVarint(value.GetUint64(), out);
+            } else {
+                out.push_back(static_cast<char>(Type::Double));
+                WriteDouble(value.GetDouble(), out);
+            }
+            break;
+        case rapidjson::kStringType:
+            out.push_back(static_cast<char>(Type::String));
+            WriteString(value.GetString(), value.GetStringLength(), out);
+            break;
+        case rapidjson::kArrayType:
+            out.push_back(static_cast<char>(Type::Array));
+            WriteVarint(value.Size(), out);
+            for(auto& v : value.GetArray()) EncodeAny(v, out);
+            break;
+        case rapidjson::kObjectType:
+            out.push_back(static_cast<char>(Type::Object));
+            WriteVarint(value.MemberCount(), out);
+            for(auto& m : value.GetObject()) {
+                WriteName(m.name, out);
+                EncodeAny(m.value, out);
+            }
+            break;
+        }
+    }
+
+    /* ---------------------------------------------------------------- */
+    /* Decoding                                                          */
+    /* ---------------------------------------------------------------- */
+
+    using Allocator = rapidjson::Document::AllocatorType;
+
+    struct Reader {
+
+        const char* ptr;
+        const char* end;
+
+        void check(size_t size) const {
+            if(static_cast<size_t>(end - ptr) < size)
+                throw Exception{"Invalid binary metadata (truncated)"};
+        }
+
+        uint8_t byte() {
+            check(1);
+            return static_cast<uint8_t>(*ptr++);
+        }
+
+        uint64_t varint() {
+            uint64_t v = 0;
+            for(unsigned shift = 0; shift < 64; shift += 7) {
+                auto b = byte();
+                v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                if(!(b & 0x80)) return v;
+            }
+            throw Exception{"Invalid binary metadata (varint too long)"};
+        }
+
+        int64_t zigzag() {
+            auto v = varint();
+            return static_cast<int64_t>((v >> 1) ^ (~(v & 1) + 1));
+        }
+
+        double dbl() {
+            double d;
+            check(sizeof(d));
+            std::memcpy(&d, ptr, sizeof(d));
+            ptr += sizeof(d);
+            return d;
+        }
+
+        std::string_view string() {
+            auto size = varint();
+            check(size);
+            std::string_view s{ptr, size};
+            ptr += size;
+            return s;
+        }
+    };
+
+    static void DecodeString(Reader& reader, rapidjson::Value& value, Allocator& allocator) {
+        auto s = reader.string();
+        value.SetString(s.data(), static_cast<rapidjson::SizeType>(s.size()), allocator);
+    }
+
+    /* names read so far in the current event, pointing into its buffer */
+    static std::vector<std::string_view>& DecodedNames() {
+        thread_local std::vector<std::string_view> names;
+        return names;
+    }
+
+    static void DecodeName(Reader& reader, rapidjson::Value& name, Allocator& allocator) {
+        auto& names = DecodedNames();
+        auto v = reader.varint();
+        std::string_view s;
+        if(v & 1) {
+            if((v >> 1) >= names.size())
+                throw Exception{"Invalid binary metadata (unknown field name)"};
+            s = names[v >> 1];
+        } else {
+            auto size = v >> 1;
+            reader.check(size);
+            s = std::string_view{reader.ptr, size};
+            reader.ptr += size;
+            names.push_back(s);
+        }
+        name.SetString(s.data(), static_cast<rapidjson::SizeType>(s.size()), allocator);
+    }
+
+    static void DecodeTyped(const Field& field, Reader& reader,
+                            rapidjson::Value& value, Allocator& allocator,
+                            size_t depth) {
+        switch(field.type) {
+        case Type::Bool:   value.SetBool(reader.byte() != 0); break;
+        case Type::Int64:  value.SetInt64(reader.zigzag()); break;
+        case Type::Uint64: value.SetUint64(reader.varint()); break;
+        case Type::Double: value.SetDouble(reader.dbl()); break;
+        case Type::String: DecodeString(reader, value, allocator); break;
+        case Type::Object:
+            value.SetObject();
+            DecodeObject(*field.nested, reader, value, allocator, depth + 1);
+            break;
+        default:           DecodeAny(reader, value, allocator, depth + 1); break;
+        }
+    }
+
+    static void DecodeObject(const Schema& schema, Reader& reader,
+                             rapidjson::Value& object, Allocator& allocator,
+                             size_t depth) {
+        auto bitmap_size = (schema.fields.size() + 7)/8;
+        reader.check(bitmap_size);
+        auto bitmap = reader.ptr;
+        reader.ptr += bitmap_size;
+        for(size_t i = 0; i < schema.fields.size(); ++i) {
+            if(!(bitmap[i/8] & (1 << (i % 8)))) continue;
+            auto& field = schema.fields[i];
+            rapidjson::Value name{field.name.data(),
+                                  static_cast<rapidjson::SizeType>(field.name.size()),
+                                  allocator};
+            rapidjson::Value value;
+            DecodeTyped(field, reader, value, allocator, depth);
+            object.AddMember(name, value, allocator);
+        }
+        auto num_extras = reader.varint();
+        for(uint64_t i = 0; i < num_extras; ++i) {
+            rapidjson::Value name;
+            DecodeName(reader, name, allocator);
+            rapidjson::Value value;
+            DecodeAny(reader, value, allocator, depth + 1);
+            object.AddMember(name, value, allocator);
+        }
+    }
+
+    static void DecodeAny(Reader& reader, rapidjson::Value& value, Allocator& allocator,
+                          size_t depth) {
+        if(depth > MaxDepth)
+            throw Exception{fmt::format(
+                "Invalid binary metadata (nested more than {} levels deep)", MaxDepth)};
+        switch(static_cast<Type>(reader.byte())) {
+        case Type::Null:   value.SetNull(); break;
+        case Type::False:  value.SetBool(false); break;
+        case Type::True:   value.SetBool(true); break;
+        case Type::Int64:  value.SetInt64(reader.zigzag()); break;
+        case Type::Uint64: value.SetUint64(reader.varint()); break;
+        case Type::Double: value.SetDouble(reader.dbl()); break;
+        case Type::String: DecodeString(reader, value, allocator); break;
+        case Type::Array:
+            {
+                auto size = reader.varint();
+                value.SetArray();
+                for(uint64_t i = 0; i < size; ++i) {
+                    rapidjson::Value element;
+                    DecodeAny(reader, element, allocator, depth + 1);
+                    value.PushBack(element, allocator);
+                }
+            }
+            break;
+        case Type::Object:
+            {
+                auto size = reader.varint();
+                value.SetObject();
+                for(uint64_t i = 0; i < size; ++i) {
+                    rapidjson::Value name;
+                    DecodeName(reader, name, allocator);
+                    rapidjson::Value member;
+                    DecodeAny(reader, member, allocator, depth + 1);
+                    value.AddMember(name, member, allocator);
+                }
+            }
+            break;
+        default:
+            throw Exception{"Invalid binary metadata (unknown value tag)"};
+        }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_SEQUENCER_H
+#define MOFKA_SEQUENCER_H
+
+#include <thallium.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace mofka {
+
+/**
+ * @brief The Sequencer admits ULTs one at a time in the order of
+ * the tickets they were given (0, 1, 2, ...). A ULT calls waitForTurn
+ * with its ticket, does its work, then calls advance to let the ULT
+ * holding the next ticket in.
+ *
+ * Contrary to a condition variable on which every waiting ULT is woken
+ * up to check whether it is its turn, advance only wakes up the ULT
+ * holding the next ticket, if it is already waiting.
+ */
+class Sequencer {
+
+    public:
+
+    /**
+     * @brief Blocks until all the tickets before the given one
+     * have called advance.
+     */
+    void waitForTurn(uint64_t ticket) {
+        std::shared_ptr<thallium::eventual<void>> turn;
+        {
+            std::unique_lock<thallium::mutex> guard{m_mutex};
+            if(ticket == m_next) return;
+            turn = std::make_shared<thallium::eventual<void>>();
+            m_waiters.emplace(ticket, turn);
+        }
+        turn->wait();
+    }
+
+    /**
+     * @brief Ends the turn of the current ticket, waking up the ULT
+     * holding the next ticket if it is waiting.
+     */
+    void advance() {
+        std::shared_ptr<thallium::eventual<void>> next_turn;
+        {
+            std::unique_lock<thallium::mutex> guard{m_mutex};
+            m_next += 1;
+            auto it = m_waiters.find(m_next);
+            if(it == m_waiters.end()) return;
+            next_turn = std::move(it->second);
+            m_waiters.erase(it);
+        }
+        next_turn->set_value();
+    }
+
+    private:
+
+    uint64_t        m_next = 0;
+    thallium::mutex m_mutex;
+    std::unordered_map<
+        uint64_t,
+        std::shared_ptr<thallium::eventual<void>>> m_waiters;
+};
+
+}
+
+#endif
@@ -28,40 +28,45 @@ TopicHandle ServiceHandle::createTopic(
         TopicBackendConfig config,
         Validator validator,
         TargetSelector selector,
-        Serializer serializer) {
+        Serializer serializer,
+        Compressor compressor) {
     const auto hash   = std::hash<decltype(name)>()(name);
     const auto target = self->m_mofka_targets[hash % self->m_mofka_targets.size()];
     const auto ph = target.self->m_ph;
-    using ResultType = std::tuple<Metadata, Metadata, Metadata>;
+    using ResultType = std::tuple<Metadata, Metadata, Metadata, Metadata>;
     Result<ResultType> response =
         self->m_client->m_create_topic.on(ph)(
             std::string{name},
             static_cast<Metadata&>(config),
             validator.metadata(),
             selector.metadata(),
-            serializer.metadata());
+            serializer.metadata(),
+            compressor.metadata());
     if(!response.success())
         throw Exception(response.error());
 
     Metadata validator_meta;
     Metadata selector_meta;
     Metadata serializer_meta;
-    std::tie(validator_meta, selector_meta, serializer_meta) = response.value();
+    Metadata compressor_meta;
+    std::tie(validator_meta, selector_meta, serializer_meta, compressor_meta) = response.value();
     validator = Validator::FromMetadata(validator_meta);
     selector = TargetSelector::FromMetadata(selector_meta);
     serializer = Serializer::FromMetadata(serializer_meta);
+    compressor = Compressor::FromMetadata(compressor_meta);
     return std::make_shared<TopicHandleImpl>(
         name, self,
         std::move(validator),
         std::move(selector),
-        std::move(serializer));
+        std::move(serializer),
+        std::move(compressor));
 }
 
 TopicHandle ServiceHandle::openTopic(std::string_view name) {
     const auto hash = std::hash<decltype(name)>()(name);
     const auto target = self->m_mofka_targets[hash % self->m_mofka_targets.size()];
     const auto ph = target.self->m_ph;
-    using ResultType = std::tuple<Metadata, Metadata, Metadata>;
+    using ResultType = std::tuple<Metadata, Metadata, Metadata, Metadata>;
     Result<ResultType> response =
         self->m_client->m_open_topic.on(ph)(std::string{name});
     if(!response.success())
@@ -70,15 +75,18 @@ TopicHandle ServiceHandle::openTopic(std::string_view name) {
     Metadata validator_meta;
     Metadata selector_meta;
     Metadata serializer_meta;
-    std::tie(validator_meta, selector_meta, serializer_meta) = response.value();
+    Metadata compressor_meta;
+    std::tie(validator_meta, selector_meta, serializer_meta, compressor_meta) = response.value();
     auto validator = Validator::FromMetadata(validator_meta);
     auto selector = TargetSelector::FromMetadata(selector_meta);
     auto serializer = Serializer::FromMetadata(serializer_meta);
+    auto compressor = Compressor::FromMetadata(compressor_meta);
     return std::make_shared<TopicHandleImpl>(
         name, self,
         std::move(validator),
         std::move(selector),
-        std::move(serializer));
+        std::move(serializer),
+        std::move(compressor));
 }
 
 }
@@ -9,6 +9,8 @@
 #include "MetadataImpl.hpp"
 #include "PimplUtil.hpp"
 #include "DefaultTargetSelector.hpp"
+#include "KeyHashTargetSelector.hpp"
+#include "LoadAwareTargetSelector.hpp"
 #include <fmt/format.h>
 #include <unordered_map>
 
@@ -29,6 +31,21 @@ PartitionTargetInfo TargetSelector::selectTargetFor(const Metadata& metadata) {
     return self->selectTargetFor(metadata);
 }
 
+void TargetSelector::onBatchClosed(const PartitionTargetInfo& target) {
+    return self->onBatchClosed(target);
+}
+
+void TargetSelector::onBatchCompleted(
+        const PartitionTargetInfo& target,
+        size_t count,
+        std::chrono::microseconds rtt) {
+    return self->onBatchCompleted(target, count, rtt);
+}
+
+void TargetSelector::onSelectionCancelled(const PartitionTargetInfo& target) {
+    return self->onSelectionCancelled(target);
+}
+
 Metadata TargetSelector::metadata() const {
     return self->metadata();
 }
@@ -37,6 +54,8 @@ static std::unordered_map<std::string, std::function<std::shared_ptr<TargetSelec
     targetSelectorFactories;
 
 MOFKA_REGISTER_TARGET_SELECTOR(default, DefaultTargetSelector);
+MOFKA_REGISTER_TARGET_SELECTOR(key_hash, KeyHashTargetSelector);
+MOFKA_REGISTER_TARGET_SELECTOR(load_aware, LoadAwareTargetSelector);
 
 TargetSelector TargetSelector::FromMetadata(const Metadata& metadata) {
     auto& json = metadata.json();
@@ -31,9 +31,29 @@ ServiceHandle TopicHandle::service() const {
 Producer TopicHandle::makeProducer(
         std::string_view name,
         BatchSize batch_size,
+        BatchingGoal batching_goal,
+        MaxBatchBytes max_batch_bytes,
+        Linger linger,
+        MaxInFlightBatches max_in_flight,
+        EagerThreshold eager_threshold,
+        StagingThreshold staging_threshold,
+        MaxPendingEvents max_pending_events,
+        MaxPendingBytes max_pending_bytes,
+        BackpressurePolicy backpressure_policy,
+        MaxBatchRetries max_retries,
         ThreadPool thread_pool,
         Ordering ordering) const {
-    return std::make_shared<ProducerImpl>(name, batch_size, thread_pool.self, ordering, self);
+    if(max_in_flight.value == 0)
+        throw Exception{"MaxInFlightBatches should be at least 1"};
+    if(max_in_flight.value > 1 && ordering != Ordering::Loose)
+        throw Exception{"MaxInFlightBatches greater than 1 requires Ordering::Loose"};
+    if(max_pending_events.value == 0)
+        throw Exception{"MaxPendingEvents should be at least 1"};
+    return std::make_shared<ProducerImpl>(
+        name, batch_size, batching_goal, max_batch_bytes,
+        linger, max_in_flight, eager_threshold, staging_threshold,
+        max_pending_events, max_pending_bytes, backpressure_policy,
+        max_retries, thread_pool.self, ordering, self);
 }
 
 Consumer TopicHandle::makeConsumer(
@@ -42,11 +62,23 @@ Consumer TopicHandle::makeConsumer(
         ThreadPool thread_pool,
         DataBroker data_broker,
         DataSelector data_selector,
-        const std::vector<PartitionTargetInfo>& targets) const {
+        const std::vector<PartitionTargetInfo>& targets,
+        MaxPendingEvents max_pending_events,
+        MaxPendingBytes max_pending_bytes,
+        PrefetchDepth prefetch_depth,
+        MaxPrefetchBytes max_prefetch_bytes,
+        DataFetchMode data_fetch_mode) const {
+    if(max_pending_events.value == 0)
+        throw Exception{"MaxPendingEvents should be at least 1"};
+    if(max_pending_bytes.value == 0)
+        throw Exception{"MaxPendingBytes should be at least 1"};
     return std::make_shared<ConsumerImpl>(
             self->m_service->m_client->m_engine,
             name, batch_size, thread_pool.self,
-            data_broker, data_selector, targets, self);
+            data_broker, data_selector, targets,
+            max_pending_events, max_pending_bytes,
+            prefetch_depth, max_prefetch_bytes,
+            data_fetch_mode, self);
 }
 
 const std::vector<PartitionTargetInfo>& TopicHandle::targets() const {
@@ -11,6 +11,7 @@
 #include "mofka/Validator.hpp"
 #include "mofka/TargetSelector.hpp"
 #include "mofka/Serializer.hpp"
+#include "mofka/Compressor.hpp"
 #include <string_view>
 
 namespace mofka {
@@ -24,6 +25,7 @@ class TopicHandleImpl {
     Validator             m_validator;
     TargetSelector        m_selector;
     Serializer            m_serializer;
+    Compressor            m_compressor;
 
     TopicHandleImpl() = default;
 
@@ -31,12 +33,14 @@ class TopicHandleImpl {
                     SP<ServiceHandleImpl> service,
                     Validator validator,
                     TargetSelector selector,
-                    Serializer serializer)
+                    Serializer serializer,
+                    Compressor compressor)
     : m_name(name)
     , m_service(std::move(service))
     , m_validator(std::move(validator))
     , m_selector(std::move(selector))
-    , m_serializer(std::move(serializer)) {
+    , m_serializer(std::move(serializer))
+    , m_compressor(std::move(compressor)) {
         m_selector.setTargets(m_service->m_mofka_targets);
     }
 };
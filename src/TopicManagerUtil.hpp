@@ -0,0 +1,141 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_TOPIC_MANAGER_UTIL_H
+#define MOFKA_TOPIC_MANAGER_UTIL_H
+
+#include "InlineContent.hpp"
+#include "mofka/Compressor.hpp"
+#include "mofka/Result.hpp"
+#include <fmt/format.h>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace mofka {
+
+/*
+ * Helpers shared by the TopicManagers, which store the metadata (or data)
+ * of their events packed in a single buffer, along with the size and the
+ * offset of each event in that buffer.
+ */
+
+/**
+ * @brief Decompresses the metadata sizes and metadata of a batch.
+ */
+inline Result<void> DecompressBatchMetadata(
+        const Compressor& compressor,
+        size_t num_events,
+        std::string_view input,
+        std::vector<char>& output) {
+    Result<void> result;
+    try {
+        compressor.decompress(input.data(), input.size(), output);
+    } catch(const std::exception& ex) {
+        result.success() = false;
+        result.error() = fmt::format("Could not decompress batch metadata: {}", ex.what());
+        return result;
+    }
+    if(output.size() < num_events*sizeof(size_t)) {
+        result.success() = false;
+        result.error() = "Decompressed batch metadata is smaller than expected";
+    }
+    return result;
+}
+
+/**
+ * @brief Makes room for num_events events with content_size bytes of
+ * packed content, returning the offset of the first event's content.
+ */
+inline size_t GrowPackedEvents(
+        std::vector<size_t>& sizes,
+        std::vector<size_t>& offsets,
+        std::vector<char>& content,
+        size_t num_events,
+        size_t content_size) {
+    size_t first_id = sizes.size();
+    // resize the sizes and offsets arrays, and content array
+    if(sizes.capacity() < first_id + num_events) {
+        sizes.reserve(2*(first_id + num_events));
+    }
+    if(offsets.capacity() < first_id + num_events) {
+        offsets.reserve(2*(first_id + num_events));
+    }
+    sizes.resize(first_id + num_events);
+    offsets.resize(first_id + num_events);
+    size_t first_offset = content.size();
+    if(content.capacity() < first_offset + content_size) {
+        content.reserve(2*(first_offset + content_size));
+    }
+    content.resize(first_offset + content_size);
+    return first_offset;
+}
+
+/**
+ * @brief Updates the offsets of the events from first_id,
+ * once their sizes are known.
+ */
+inline void UpdatePackedOffsets(
+        const std::vector<size_t>& sizes,
+        std::vector<size_t>& offsets,
+        size_t first_id,
+        size_t first_offset) {
+    // TODO check that the content size = sum of the sizes received
+    auto offset = first_offset;
+    for(size_t i = first_id; i < sizes.size(); ++i) {
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+}
+
+/**
+ * @brief Appends num_events events from a buffer holding their
+ * sizes followed by their content (see ValidateSizePrefixedContent).
+ */
+inline void AppendPackedEvents(
+        std::vector<size_t>& sizes,
+        std::vector<size_t>& offsets,
+        std::vector<char>& content,
+        size_t num_events,
+        std::string_view buffer) {
+    size_t first_id = sizes.size();
+    auto content_size = buffer.size() - num_events*sizeof(size_t);
+    auto first_offset = GrowPackedEvents(sizes, offsets, content, num_events, content_size);
+    std::memcpy(sizes.data() + first_id, buffer.data(), num_events*sizeof(size_t));
+    std::memcpy(content.data() + first_offset,
+                buffer.data() + num_events*sizeof(size_t), content_size);
+    UpdatePackedOffsets(sizes, offsets, first_id, first_offset);
+}
+
+/**
+ * @brief Checks a batch received inline: its metadata is decompressed
+ * into decompressed_metadata if the compressor is not a pass-through
+ * (metadata then refers to it), and the sizes of the metadata and data
+ * must match their content.
+ */
+inline Result<void> UnpackEagerBatch(
+        const Compressor& compressor,
+        size_t num_events,
+        std::string_view& metadata,
+        std::string_view data,
+        std::vector<char>& decompressed_metadata) {
+    if(!compressor.isPassThrough()) {
+        auto decompressed = DecompressBatchMetadata(
+            compressor, num_events, metadata, decompressed_metadata);
+        if(!decompressed.success()) return decompressed;
+        metadata = std::string_view{decompressed_metadata.data(), decompressed_metadata.size()};
+    }
+    Result<void> result;
+    if(!ValidateSizePrefixedContent(num_events, metadata)
+    || !ValidateSizePrefixedContent(num_events, data)) {
+        result.success() = false;
+        result.error() = "Eager batch sizes do not match its content";
+    }
+    return result;
+}
+
+}
+
+#endif
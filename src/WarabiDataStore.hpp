@@ -7,6 +7,7 @@
 #define MOFKA_WARABI_DATA_STORE_HPP
 
 #include "RapidJsonUtil.hpp"
+#include "InlineContent.hpp"
 #include <warabi/Client.hpp>
 #include <warabi/TargetHandle.hpp>
 #include <mofka/Result.hpp>
@@ -15,6 +16,7 @@
 #include <mofka/BulkRef.hpp>
 #include <spdlog/spdlog.h>
 #include <cstddef>
+#include <cstring>
 #include <string_view>
 #include <unordered_map>
 
@@ -81,6 +83,55 @@ class WarabiDataStore {
         return result;
     }
 
+    Result<std::vector<DataDescriptor>> store(
+            size_t count,
+            std::string_view localData) {
+
+        /* prepare the result array and its content */
+        Result<std::vector<DataDescriptor>> result;
+        result.value().resize(count);
+        for(auto& descriptor : result.value()) {
+            auto& location = descriptor.location();
+            location.resize(sizeof(WarabiDataDescriptor));
+        }
+
+        auto getWarabiDataDescriptor = [&result](size_t i) {
+            return reinterpret_cast<WarabiDataDescriptor*>(
+                result.value()[i].location().data()
+            );
+        };
+
+        /* the sizes come from the producer, check them before use */
+        if(!ValidateSizePrefixedContent(count, localData)) {
+            result.success() = false;
+            result.error() = "Inline data sizes do not match the data received";
+            return result;
+        }
+
+        /* read the size of each data piece */
+        const auto dataOffset = count*sizeof(size_t);
+
+        std::vector<size_t> sizes(count);
+        std::memcpy(sizes.data(), localData.data(), dataOffset);
+
+        /* write data as region into Warabi */
+        warabi::RegionID region_id;
+        m_target.createAndWrite(
+            &region_id, localData.data() + dataOffset,
+            localData.size() - dataOffset, true);
+
+        /* update the result vector */
+        size_t currentOffset = 0;
+        for(size_t j = 0; j < count; ++j) {
+            auto descriptor = getWarabiDataDescriptor(j);
+            descriptor->region_id = region_id;
+            descriptor->offset = currentOffset;
+            currentOffset += sizes[j];
+        }
+
+        return result;
+    }
+
     std::vector<Result<void>> load(
         const std::vector<DataDescriptor>& descriptors,
         const BulkRef& remoteBulk) {
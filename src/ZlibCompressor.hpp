@@ -0,0 +1,95 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_ZLIB_COMPRESSOR_H
+#define MOFKA_ZLIB_COMPRESSOR_H
+
+#include "mofka/Compressor.hpp"
+#include "mofka/Exception.hpp"
+#include <fmt/format.h>
+#include <zlib.h>
+#include <cstring>
+#include <limits>
+
+namespace mofka {
+
+/**
+ * @brief Compressor based on zlib's deflate algorithm. The compressed
+ * content starts with the original size (as a size_t), followed by
+ * the deflate stream. The "level" field of its Metadata (0 to 9,
+ * or -1 for zlib's default) selects the compression level.
+ */
+class ZlibCompressor : public CompressorInterface {
+
+    int m_level;
+
+    public:
+
+    ZlibCompressor(int level = Z_DEFAULT_COMPRESSION)
+    : m_level(level) {}
+
+    void compress(const std::vector<Data::Segment>& segments,
+                  std::vector<char>& output) const override {
+        size_t size = 0;
+        for(const auto& seg : segments) size += seg.size;
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        int ret = deflateInit(&stream, m_level);
+        if(ret != Z_OK)
+            throw Exception{fmt::format("zlib deflateInit failed with error {}", ret)};
+        output.resize(sizeof(size) + deflateBound(&stream, size));
+        std::memcpy(output.data(), &size, sizeof(size));
+        stream.next_out  = reinterpret_cast<Bytef*>(output.data() + sizeof(size));
+        stream.avail_out = output.size() - sizeof(size);
+        for(size_t i = 0; i < segments.size(); ++i) {
+            stream.next_in  = reinterpret_cast<Bytef*>(const_cast<void*>(segments[i].ptr));
+            stream.avail_in = segments[i].size;
+            ret = deflate(&stream, i + 1 == segments.size() ? Z_FINISH : Z_NO_FLUSH);
+            if(ret == Z_STREAM_ERROR) break;
+        }
+        if(segments.empty())
+            ret = deflate(&stream, Z_FINISH);
+        deflateEnd(&stream);
+        if(ret != Z_STREAM_END)
+            throw Exception{fmt::format("zlib deflate failed with error {}", ret)};
+        output.resize(sizeof(size) + stream.total_out);
+    }
+
+    void decompress(const char* input, size_t size,
+                    std::vector<char>& output) const override {
+        size_t original_size = 0;
+        if(size < sizeof(original_size))
+            throw Exception{"Invalid zlib-compressed buffer (missing header)"};
+        std::memcpy(&original_size, input, sizeof(original_size));
+        output.resize(original_size);
+        uLongf dest_size = original_size;
+        int ret = uncompress(
+            reinterpret_cast<Bytef*>(output.data()), &dest_size,
+            reinterpret_cast<const Bytef*>(input + sizeof(original_size)),
+            size - sizeof(original_size));
+        if(ret != Z_OK || dest_size != original_size)
+            throw Exception{fmt::format("zlib uncompress failed with error {}", ret)};
+    }
+
+    Metadata metadata() const override {
+        return Metadata{fmt::format("{{\"__type__\":\"zlib\",\"level\":{}}}", m_level)};
+    }
+
+    static std::unique_ptr<CompressorInterface> create(const Metadata& metadata) {
+        auto& json = metadata.json();
+        int level = Z_DEFAULT_COMPRESSION;
+        if(json.HasMember("level")) {
+            auto& l = json["level"];
+            if(!l.IsInt() || l.GetInt() < -1 || l.GetInt() > 9)
+                throw Exception{"Invalid \"level\" for zlib compressor (expected integer in [-1, 9])"};
+            level = l.GetInt();
+        }
+        return std::make_unique<ZlibCompressor>(level);
+    }
+};
+
+}
+
+#endif
@@ -9,6 +9,74 @@
 #include <mofka/Client.hpp>
 #include <mofka/TopicHandle.hpp>
 #include "BedrockConfig.hpp"
+#include "TopicUtil.hpp"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <vector>
+
+static std::string DataOf(unsigned i) {
+    return fmt::format("This is data for event {}", i);
+}
+
+/**
+ * @brief Pushes events first to first+count-1 to the topic, the metadata
+ * of event i being {"event_num":i} and its data DataOf(i).
+ */
+static void PushEvents(const mofka::TopicHandle& topic, unsigned first, unsigned count) {
+    auto producer = topic.producer();
+    REQUIRE(static_cast<bool>(producer));
+    std::vector<std::string> data;
+    std::vector<mofka::Future<mofka::EventID>> futures;
+    for(unsigned i = first; i < first + count; ++i)
+        data.push_back(DataOf(i));
+    for(unsigned i = first; i < first + count; ++i) {
+        auto& d = data[i - first];
+        futures.push_back(producer.push(
+            mofka::Metadata{fmt::format("{{\"event_num\":{}}}", i)},
+            mofka::Data{d.data(), d.size()}));
+    }
+    producer.flush();
+    REQUIRE(futures[0].wait() == first);
+    RequireConsecutiveIDs(futures);
+}
+
+/**
+ * @brief Pulls the next event and checks that it is event i.
+ */
+static mofka::Event PullEvent(const mofka::Consumer& consumer, unsigned i) {
+    auto event = consumer.pull().wait();
+    REQUIRE(event.id() == i);
+    REQUIRE(event.metadata().json()["event_num"].GetUint64() == i);
+    return event;
+}
+
+/**
+ * @brief Checks that data, allocated by AllocateData and possibly
+ * split into several segments, is that of event i, and frees it.
+ */
+static void RequireDataOf(const mofka::Data& data, unsigned i) {
+    auto& segments = data.segments();
+    REQUIRE(!segments.empty());
+    std::string data_str;
+    for(auto& segment : segments)
+        data_str.append(static_cast<const char*>(segment.ptr), segment.size);
+    REQUIRE(data_str == DataOf(i));
+    delete[] static_cast<const char*>(segments[0].ptr);
+}
+
+/* DataSelector and DataBroker requesting all the data of the events */
+static const mofka::DataSelector SelectAll =
+    [](const mofka::Metadata&, const mofka::DataDescriptor& descriptor) {
+        return descriptor;
+    };
+
+static const mofka::DataBroker AllocateData =
+    [](const mofka::Metadata&, const mofka::DataDescriptor& descriptor) {
+        auto size = descriptor.size();
+        return mofka::Data{new char[size], size};
+    };
 
 TEST_CASE("Event consumer test", "[event-consumer]") {
 
@@ -110,6 +178,384 @@ TEST_CASE("Event consumer test", "[event-consumer]") {
                 }
             }
         }
+
+        SECTION("Consume with data in several segments")
+        {
+            /* the data of the events of a batch, some of which is not
+             * requested, is fetched at once and written one event after
+             * the other into the segments given by the broker */
+            mofka::DataSelector data_selector = [](const mofka::Metadata& metadata, const mofka::DataDescriptor& descriptor) {
+                if(metadata.json()["event_num"].GetInt64() % 3 == 1)
+                    return mofka::DataDescriptor::Null();
+                return descriptor;
+            };
+            mofka::DataBroker data_broker = [](const mofka::Metadata&, const mofka::DataDescriptor& descriptor) {
+                auto size = descriptor.size();
+                auto data = new char[size];
+                return mofka::Data{{{data, size/2}, {data + size/2, size - size/2}}};
+            };
+            /* the events of the topic were pushed one at a time,
+             * these ones are pushed together */
+            PushEvents(topic, 100, 100);
+            auto consumer = topic.consumer(
+                "myconsumer", data_selector, data_broker);
+            REQUIRE(static_cast<bool>(consumer));
+            for(unsigned i=0; i < 200; ++i) {
+                auto event = PullEvent(consumer, i);
+                if(i % 3 == 1) {
+                    REQUIRE(event.data().segments().empty());
+                } else {
+                    REQUIRE(event.data().segments().size() == 2);
+                    RequireDataOf(event.data(), i);
+                }
+            }
+        }
+
+        SECTION("Consumer prefetching data")
+        {
+            auto prefetch_depth = GENERATE(as<size_t>{}, 0, 1, 4);
+            auto max_prefetch_bytes = GENERATE(as<size_t>{}, 1, std::numeric_limits<size_t>::max());
+            /* the broker gives zeroed buffers, so that the data
+             * of an event shows in its buffer once fetched */
+            thallium::mutex buffers_mtx;
+            std::vector<const char*> buffers(100, nullptr);
+            mofka::DataBroker data_broker = [&](const mofka::Metadata& metadata, const mofka::DataDescriptor& descriptor) {
+                auto size = descriptor.size();
+                auto data = new char[size]();
+                std::unique_lock<thallium::mutex> guard{buffers_mtx};
+                buffers[metadata.json()["event_num"].GetUint64()] = data;
+                return mofka::Data{data, size};
+            };
+            auto consumer = topic.consumer(
+                "myconsumer", SelectAll, data_broker,
+                mofka::PrefetchDepth{prefetch_depth},
+                mofka::MaxPrefetchBytes{max_prefetch_bytes});
+            REQUIRE(static_cast<bool>(consumer));
+            REQUIRE(consumer.prefetchDepth().value == prefetch_depth);
+            REQUIRE(consumer.maxPrefetchBytes().value == max_prefetch_bytes);
+            RequireDataOf(PullEvent(consumer, 0).data(), 0);
+            if(max_prefetch_bytes == std::numeric_limits<size_t>::max()) {
+                /* without a limit, the data of the other events
+                 * is fetched before they are pulled */
+                auto all_fetched = [&]() {
+                    std::unique_lock<thallium::mutex> guard{buffers_mtx};
+                    return std::all_of(buffers.begin() + 1, buffers.end(),
+                        [](const char* buffer) { return buffer && buffer[0] != 0; });
+                };
+                for(unsigned t = 0; t < 1000 && !all_fetched(); ++t)
+                    thallium::thread::sleep(engine, 10);
+                REQUIRE(all_fetched());
+            }
+            for(unsigned i=1; i < 100; ++i)
+                RequireDataOf(PullEvent(consumer, i).data(), i);
+        }
+
+        SECTION("Consumer reaching its prefetch limit")
+        {
+            /* the partition keeps accepting events from producers
+             * while the consumer has reached its prefetch limit */
+            auto prefetch_depth = GENERATE(as<size_t>{}, 0, 1);
+            auto consumer = topic.consumer(
+                "myconsumer", SelectAll, AllocateData,
+                mofka::PrefetchDepth{prefetch_depth},
+                mofka::MaxPrefetchBytes{1});
+            REQUIRE(static_cast<bool>(consumer));
+            RequireDataOf(PullEvent(consumer, 0).data(), 0);
+            PushEvents(topic, 100, 100);
+            for(unsigned i=1; i < 200; ++i)
+                RequireDataOf(PullEvent(consumer, i).data(), i);
+        }
+
+        SECTION("Consumer fetching data lazily")
+        {
+            /* the broker counts the events whose data is requested */
+            std::atomic<size_t> num_allocated = 0;
+            mofka::DataBroker data_broker = [&num_allocated](const mofka::Metadata& metadata, const mofka::DataDescriptor& descriptor) {
+                num_allocated += 1;
+                return AllocateData(metadata, descriptor);
+            };
+            auto consumer = topic.consumer(
+                "myconsumer", data_broker, mofka::DataFetchMode::Lazy);
+            REQUIRE(static_cast<bool>(consumer));
+            REQUIRE(consumer.dataFetchMode() == mofka::DataFetchMode::Lazy);
+            /* fetch the data of the even events after inspecting their
+             * metadata, the concurrent fetches being sent together; the
+             * data of the other events is never requested */
+            std::vector<mofka::Event> events, skipped;
+            std::vector<mofka::Future<mofka::Data>> futures;
+            for(unsigned i=0; i < 100; ++i) {
+                auto event = PullEvent(consumer, i);
+                REQUIRE(event.dataDescriptor().size() == DataOf(i).size());
+                REQUIRE(num_allocated == futures.size());
+                if(i % 2 == 1) {
+                    skipped.push_back(std::move(event));
+                    continue;
+                }
+                futures.push_back(event.fetchData());
+                events.push_back(std::move(event));
+            }
+            for(size_t j = 0; j < events.size(); ++j) {
+                auto data = futures[j].wait();
+                REQUIRE(data.segments().size() == 1);
+                /* data() and fetchData() return the data that has been fetched */
+                REQUIRE(events[j].data().segments()[0].ptr == data.segments()[0].ptr);
+                REQUIRE(events[j].fetchData().wait().segments()[0].ptr == data.segments()[0].ptr);
+                RequireDataOf(data, events[j].id());
+            }
+            REQUIRE(num_allocated == events.size());
+            /* data() fetches the data of an event that wasn't fetched */
+            RequireDataOf(skipped[0].data(), 1);
+            REQUIRE(num_allocated == events.size() + 1);
+        }
+
+        SECTION("Consumer with a credit window")
+        {
+            /* MaxPendingBytes{1} makes the partition send
+             * one event at a time, since each exceeds the window */
+            auto max_events = GENERATE(as<size_t>{}, 1, 8, 1024);
+            auto max_bytes  = GENERATE(as<size_t>{}, 1, 64, std::numeric_limits<size_t>::max());
+            /* the DataSelector runs when the consumer receives an event,
+             * so it counts the events sent by the partition */
+            std::atomic<size_t> num_received = 0;
+            mofka::DataSelector data_selector = [&num_received](const mofka::Metadata&, const mofka::DataDescriptor&) {
+                num_received += 1;
+                return mofka::DataDescriptor::Null();
+            };
+            mofka::DataBroker data_broker = [](const mofka::Metadata&, const mofka::DataDescriptor&) {
+                return mofka::Data{};
+            };
+            auto consumer = topic.consumer(
+                "myconsumer", data_selector, data_broker,
+                mofka::MaxPendingEvents{max_events},
+                mofka::MaxPendingBytes{max_bytes});
+            REQUIRE(static_cast<bool>(consumer));
+            REQUIRE(consumer.maxPendingEvents().value == max_events);
+            REQUIRE(consumer.maxPendingBytes().value == max_bytes);
+            /* the metadata of an event takes at least 15 bytes */
+            auto window = std::min(max_events, std::max<size_t>(1, max_bytes/15));
+            for(unsigned i=0; i < 100; ++i) {
+                /* the partition never sends more than the window
+                 * ahead of the events that have been pulled */
+                REQUIRE(num_received <= i + window);
+                PullEvent(consumer, i);
+            }
+        }
+
+        SECTION("Consumer processing events in parallel")
+        {
+            auto ordering = GENERATE(mofka::Ordering::Loose,
+                                     mofka::Ordering::PerPartition,
+                                     mofka::Ordering::Strict);
+            auto consumer = topic.consumer("myconsumer");
+            REQUIRE(static_cast<bool>(consumer));
+            /* Catch2 assertions are not thread-safe, so the
+             * processor only records what it observes */
+            std::vector<char> seen(100, 0);
+            std::atomic<unsigned> in_flight = 0, max_in_flight = 0;
+            std::atomic<int64_t> last_id = -1;
+            std::atomic<bool> in_order = true, valid_metadata = true;
+            consumer.process([&](const mofka::Event& event) {
+                    auto n = ++in_flight;
+                    auto m = max_in_flight.load();
+                    while(n > m && !max_in_flight.compare_exchange_weak(m, n)) {}
+                    auto id = event.id();
+                    if(event.metadata().json()["event_num"].GetUint64() != id)
+                        valid_metadata = false;
+                    if(id < seen.size()) seen[id] = 1;
+                    if(ordering != mofka::Ordering::Loose
+                    && last_id.exchange(static_cast<int64_t>(id)) != static_cast<int64_t>(id) - 1)
+                        in_order = false;
+                    --in_flight;
+                    return mofka::Data{};
+                },
+                mofka::ThreadPool{mofka::ThreadCount{2}},
+                mofka::NumEvents{100},
+                ordering,
+                mofka::MaxInFlightEvents{8});
+            REQUIRE(std::count(seen.begin(), seen.end(), 1) == 100);
+            REQUIRE(valid_metadata);
+            REQUIRE(in_order);
+            REQUIRE(max_in_flight <= 8);
+        }
+
+        SECTION("Consumer stopping the event processor")
+        {
+            /* process returns even if the event that stops the processor
+             * is the last one of the topic, i.e. while it is pulling */
+            auto stop_at = GENERATE(as<unsigned>{}, 49, 99);
+            auto max_in_flight = GENERATE(as<size_t>{}, 1, 8);
+            {
+                auto consumer = topic.consumer("myconsumer");
+                REQUIRE(static_cast<bool>(consumer));
+                unsigned num_processed = 0;
+                consumer.process([&](const mofka::Event& event) {
+                        num_processed += 1;
+                        if(event.id() == stop_at) throw mofka::StopEventProcessor{};
+                        return mofka::Data{};
+                    },
+                    mofka::ThreadPool{mofka::ThreadCount{1}},
+                    mofka::NumEvents::Infinity(),
+                    mofka::Ordering::Strict,
+                    mofka::MaxInFlightEvents{max_in_flight});
+                REQUIRE(num_processed == stop_at + 1);
+                /* the events pulled but not processed are
+                 * pulled again from the same consumer */
+                for(unsigned i = stop_at + 1; i < 100; ++i)
+                    REQUIRE(consumer.pull().wait().id() == i);
+            }
+            /* the events up to the one that stopped the
+             * processor have been acknowledged */
+            if(stop_at < 99) {
+                auto consumer = topic.consumer("myconsumer");
+                REQUIRE(consumer.pull().wait().id() == stop_at + 1);
+            }
+        }
+    }
+
+    SECTION("Producer/consumer with compressed metadata") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto compressor = mofka::Compressor::FromMetadata(
+            mofka::Metadata{R"({"__type__":"zlib","level":9})"});
+        REQUIRE(static_cast<bool>(compressor));
+        REQUIRE(!compressor.isPassThrough());
+        auto topic = sh.createTopic(
+            "mytopic", mofka::TopicBackendConfig{},
+            mofka::Validator{}, mofka::TargetSelector{},
+            mofka::Serializer{}, compressor);
+        REQUIRE(static_cast<bool>(topic));
+
+        {
+            auto producer = topic.producer();
+            REQUIRE(static_cast<bool>(producer));
+            for(unsigned i=0; i < 100; ++i) {
+                mofka::Metadata metadata = mofka::Metadata{
+                    fmt::format("{{\"event_num\":{}}}", i)
+                };
+                std::string data = fmt::format("This is data for event {}", i);
+                auto future = producer.push(
+                    metadata,
+                    mofka::Data{data.data(), data.size()});
+                future.wait();
+            }
+        }
+
+        auto consumer = topic.consumer("myconsumer");
+        REQUIRE(static_cast<bool>(consumer));
+        for(unsigned i=0; i < 100; ++i) {
+            auto event = consumer.pull().wait();
+            REQUIRE(event.id() == i);
+            auto& doc = event.metadata().json();
+            REQUIRE(doc["event_num"].GetInt64() == i);
+        }
+    }
+
+    SECTION("Producer/consumer with schema serializer") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto serializer = mofka::Serializer::FromMetadata(mofka::Metadata{R"(
+            {"__type__":"schema",
+             "fields":[{"name":"event_num","type":"uint64"},
+                       {"name":"time","type":"double"},
+                       {"name":"host","type":"string"},
+                       {"name":"cpu","type":"object",
+                        "fields":[{"name":"load","type":"double"},
+                                  {"name":"cores","type":"int64"}]}]})"});
+        REQUIRE(static_cast<bool>(serializer));
+        auto topic = sh.createTopic(
+            "mytopic", mofka::TopicBackendConfig{},
+            mofka::Validator{}, mofka::TargetSelector{}, serializer);
+        REQUIRE(static_cast<bool>(topic));
+
+        /* some events have fields that are not in the schema (some
+         * of them repeated), are missing fields, or have fields of
+         * another type */
+        auto make_metadata = [](unsigned i) {
+            switch(i % 3) {
+            case 0:
+                return fmt::format(
+                    R"({{"event_num":{},"time":{}.5,"host":"node{}","cpu":{{"load":0.25,"cores":-{}}}}})",
+                    i, i, i, i);
+            case 1:
+                return fmt::format(
+                    R"({{"event_num":{},"tags":["a",null,true,{{"x":-1}}],"cpu":{{"load":"high"}},)"
+                    R"("samples":[{{"x":1,"y":2}},{{"x":3,"y":{{"x":4}}}}]}})", i);
+            default:
+                return fmt::format(R"({{"event_num":{},"time":{},"host":42}})", i, i);
+            }
+        };
+        {
+            auto producer = topic.producer(mofka::Ordering::Strict);
+            REQUIRE(static_cast<bool>(producer));
+            for(unsigned i=0; i < 30; ++i)
+                producer.push(mofka::Metadata{make_metadata(i)});
+            producer.flush();
+        }
+
+        auto consumer = topic.consumer("myconsumer");
+        REQUIRE(static_cast<bool>(consumer));
+        for(unsigned i=0; i < 30; ++i) {
+            auto event = consumer.pull().wait();
+            REQUIRE(event.id() == i);
+            auto& doc = event.metadata().json();
+            auto expected = mofka::Metadata{make_metadata(i)};
+            REQUIRE(doc == expected.json());
+        }
+    }
+
+    SECTION("Producer/consumer with staged and zero-copy data") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{});
+        REQUIRE(static_cast<bool>(topic));
+
+        /* each event has small segments, copied into the staging buffer
+         * of the batch, around a large one, exposed zero-copy; unless the
+         * StagingThreshold has all of them exposed, or all of them copied */
+        auto staging_threshold = GENERATE(mofka::StagingThreshold::Default(),
+                                          mofka::StagingThreshold::Disabled(),
+                                          mofka::StagingThreshold{128*1024});
+        std::vector<std::string> headers, payloads;
+        std::string trailer = "end";
+        for(unsigned i=0; i < 20; ++i) {
+            headers.push_back(fmt::format("event {}:", i));
+            payloads.push_back(std::string(64*1024 + i, 'a' + (i % 26)));
+        }
+        {
+            auto producer = topic.producer(mofka::BatchSize{8}, staging_threshold);
+            REQUIRE(static_cast<bool>(producer));
+            REQUIRE(producer.stagingThreshold() == staging_threshold);
+            std::vector<mofka::Future<mofka::EventID>> futures;
+            for(unsigned i=0; i < 20; ++i) {
+                futures.push_back(producer.push(
+                    mofka::Metadata{fmt::format("{{\"event_num\":{}}}", i)},
+                    mofka::Data{{{headers[i].data(), headers[i].size()},
+                                 {payloads[i].data(), payloads[i].size()},
+                                 {trailer.data(), trailer.size()}}}));
+            }
+            producer.flush();
+            for(auto& future : futures) future.wait();
+        }
+
+        mofka::DataSelector data_selector = [](const mofka::Metadata&, const mofka::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+        mofka::DataBroker data_broker = [](const mofka::Metadata&, const mofka::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            return mofka::Data{new char[size], size};
+        };
+        auto consumer = topic.consumer("myconsumer", data_selector, data_broker);
+        REQUIRE(static_cast<bool>(consumer));
+        for(unsigned i=0; i < 20; ++i) {
+            auto event = consumer.pull().wait();
+            REQUIRE(event.id() == i);
+            REQUIRE(event.data().segments().size() == 1);
+            auto data_str = std::string{
+                (const char*)event.data().segments()[0].ptr,
+                event.data().segments()[0].size};
+            REQUIRE(data_str == headers[i] + payloads[i] + trailer);
+            delete[] static_cast<const char*>(event.data().segments()[0].ptr);
+        }
     }
 
     server.finalize();
@@ -9,6 +9,38 @@
 #include <mofka/Client.hpp>
 #include <mofka/TopicHandle.hpp>
 #include "BedrockConfig.hpp"
+#include "TopicUtil.hpp"
+#include <mofka/Result.hpp>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/**
+ * @brief Sends a batch of one event through the eager RPC, the way a
+ * producer would. The metadata and data are each sent inline as their
+ * size followed by their content, which is serialized like a string.
+ */
+static mofka::Result<mofka::EventID> SendEagerBatch(
+        thallium::engine& engine,
+        const mofka::UUID& producer_id,
+        uint64_t batch_seq,
+        const std::string& metadata,
+        const std::string& data) {
+    auto rpc = engine.define("mofka_producer_send_eager_batch");
+    auto ph = thallium::provider_handle{engine.self(), 0};
+    auto size_prefixed = [](const std::string& content) {
+        size_t size = content.size();
+        return std::string{reinterpret_cast<const char*>(&size), sizeof(size)} + content;
+    };
+    return rpc.on(ph)(
+        std::string{"mytopic"}, std::string{"myproducer"}, producer_id,
+        batch_seq, size_t{1}, size_prefixed(metadata), size_prefixed(data));
+}
 
 TEST_CASE("Event producer test", "[event-producer]") {
 
@@ -40,7 +72,8 @@ TEST_CASE("Event producer test", "[event-producer]") {
 
         auto thread_count = GENERATE(as<mofka::ThreadCount>{}, 0, 1, 2);
         auto batch_size   = GENERATE(mofka::BatchSize::Adaptive(), mofka::BatchSize::Adaptive());
-        auto ordering     = GENERATE(mofka::Ordering::Strict, mofka::Ordering::Loose);
+        auto ordering     = GENERATE(mofka::Ordering::Strict, mofka::Ordering::Loose,
+                                     mofka::Ordering::PerPartition);
 
         auto producer = topic.producer(
             "myproducer", batch_size, thread_count, ordering);
@@ -54,6 +87,27 @@ TEST_CASE("Event producer test", "[event-producer]") {
             future.wait();
         }
 
+        SECTION("Push a group of events") {
+            std::vector<mofka::Metadata> metadata;
+            for(unsigned i = 0; i < 32; ++i)
+                metadata.emplace_back("{\"name\":\"matthieu\"}");
+            std::string someData = "This is some data";
+            std::vector<mofka::Data> data(32, mofka::Data{someData.data(), someData.size()});
+            auto futures = producer.push(std::move(metadata), std::move(data));
+            REQUIRE(futures.size() == 32);
+            producer.flush();
+            auto previous_id = futures[0].wait();
+            for(unsigned i = 1; i < futures.size(); ++i) {
+                auto id = futures[i].wait();
+                if(ordering != mofka::Ordering::Loose)
+                    REQUIRE(id == previous_id + 1);
+                previous_id = id;
+            }
+            REQUIRE_THROWS_AS(
+                producer.push(std::vector<mofka::Metadata>(2), std::vector<mofka::Data>(3)),
+                mofka::Exception);
+        }
+
         SECTION("Push events with data") {
             std::string someData = "This is some data";
             auto future = producer.push(
@@ -64,5 +118,607 @@ TEST_CASE("Event producer test", "[event-producer]") {
         }
     }
 
+    SECTION("Push events with an adaptive batch size and no flush") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{});
+        REQUIRE(static_cast<bool>(topic));
+
+        auto goal = GENERATE(
+            mofka::BatchingGoal::Latency(std::chrono::microseconds{500}),
+            mofka::BatchingGoal::Throughput(100000));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize::Adaptive(), goal, mofka::Ordering::Loose);
+        REQUIRE(static_cast<bool>(producer));
+        REQUIRE(producer.batchingGoal() == goal);
+
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        for(unsigned i = 0; i < 100; ++i) {
+            futures.push_back(producer.push(
+                mofka::Metadata("{\"name\":\"matthieu\"}"),
+                mofka::Data{nullptr, 0}));
+        }
+        /* futures must complete without an explicit flush,
+         * since partial batches are sent after a bounded wait */
+        for(auto& future : futures) future.wait();
+
+        auto batch_size = producer.effectiveBatchSize(topic.targets()[0]);
+        REQUIRE(batch_size >= 1);
+        REQUIRE(batch_size <= 16384);
+    }
+
+    SECTION("Push events with a byte limit and a linger duration") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{});
+        REQUIRE(static_cast<bool>(topic));
+
+        /* Future::wait and flush would send the partial batches, so
+         * the futures are polled until they complete or the deadline */
+        auto complete_within = [](const std::vector<mofka::Future<mofka::EventID>>& futures,
+                                  std::chrono::milliseconds deadline) {
+            auto end = std::chrono::steady_clock::now() + deadline;
+            while(true) {
+                if(std::all_of(futures.begin(), futures.end(),
+                               [](auto& future) { return future.completed(); }))
+                    return true;
+                if(std::chrono::steady_clock::now() > end) return false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+
+        /* an event takes 143 bytes in a batch: the sizes of its metadata
+         * and data (2*8), its serialized metadata (8+19) and its data (100) */
+        std::string someData(100, 'x');
+        auto metadata = mofka::Metadata("{\"name\":\"matthieu\"}");
+        constexpr size_t event_bytes = 143;
+
+        {
+            /* events span several batches because of the byte limit,
+             * the last one being partial and sent by the linger timer */
+            auto linger = std::chrono::milliseconds{20};
+            auto producer = topic.producer(
+                "myproducer", mofka::BatchSize{64},
+                mofka::MaxBatchBytes{256},
+                mofka::Linger{linger},
+                mofka::Ordering::Strict);
+            REQUIRE(static_cast<bool>(producer));
+            REQUIRE(producer.maxBatchBytes() == mofka::MaxBatchBytes{256});
+            REQUIRE(producer.linger() == mofka::Linger{linger});
+
+            std::vector<mofka::Future<mofka::EventID>> futures;
+            for(unsigned i = 0; i < 10; ++i) {
+                futures.push_back(producer.push(
+                    metadata, mofka::Data{someData.data(), someData.size()}));
+            }
+            REQUIRE(complete_within(futures, 10*linger));
+            /* strict ordering must still give them consecutive IDs */
+            auto first_id = futures[0].wait();
+            for(unsigned i = 1; i < futures.size(); ++i) {
+                REQUIRE(futures[i].wait() == first_id + i);
+            }
+        }
+        {
+            /* events that fill a batch exactly up to the byte limit
+             * go in the same batch, which is sent as soon as it is full */
+            auto producer = topic.producer(
+                "myproducer", mofka::BatchSize{64},
+                mofka::MaxBatchBytes{4*event_bytes},
+                mofka::Ordering::Strict);
+            REQUIRE(static_cast<bool>(producer));
+
+            std::vector<mofka::Future<mofka::EventID>> futures;
+            for(unsigned i = 0; i < 4; ++i) {
+                futures.push_back(producer.push(
+                    metadata, mofka::Data{someData.data(), someData.size()}));
+            }
+            REQUIRE(complete_within(futures, std::chrono::milliseconds{1000}));
+            /* one more event starts a batch that waits for more events */
+            auto pending = producer.push(
+                metadata, mofka::Data{someData.data(), someData.size()});
+            REQUIRE(!complete_within({pending}, std::chrono::milliseconds{100}));
+            producer.flush();
+            REQUIRE(pending.wait() == futures[0].wait() + 4);
+        }
+    }
+
+    SECTION("Push events with a sticky target selector") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto selector = mofka::TargetSelector::FromMetadata(
+            mofka::Metadata{R"({"__type__":"default","mode":"sticky"})"});
+        REQUIRE(static_cast<bool>(selector));
+        auto topic = sh.createTopic(
+            "mytopic", mofka::TopicBackendConfig{}, mofka::Validator{}, selector);
+        REQUIRE(static_cast<bool>(topic));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{8},
+            mofka::Linger{std::chrono::milliseconds{1}},
+            mofka::Ordering::Strict);
+        REQUIRE(static_cast<bool>(producer));
+
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        for(unsigned i = 0; i < 50; ++i) {
+            futures.push_back(producer.push(mofka::Metadata("{\"name\":\"matthieu\"}")));
+        }
+        auto first_id = futures[0].wait();
+        for(unsigned i = 1; i < futures.size(); ++i) {
+            REQUIRE(futures[i].wait() == first_id + i);
+        }
+    }
+
+    SECTION("Push events with a load-aware target selector") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto selector = mofka::TargetSelector::FromMetadata(
+            mofka::Metadata{R"({"__type__":"load_aware","prefer_local":true})"});
+        REQUIRE(static_cast<bool>(selector));
+        auto topic = sh.createTopic(
+            "mytopic", mofka::TopicBackendConfig{}, mofka::Validator{}, selector);
+        REQUIRE(static_cast<bool>(topic));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{8}, mofka::Ordering::Strict);
+        REQUIRE(static_cast<bool>(producer));
+
+        /* the feedback of the first batches drives the selection of the next ones */
+        for(unsigned j = 0; j < 5; ++j) {
+            std::vector<mofka::Future<mofka::EventID>> futures;
+            for(unsigned i = 0; i < 20; ++i) {
+                futures.push_back(producer.push(mofka::Metadata("{\"name\":\"matthieu\"}")));
+            }
+            auto first_id = futures[0].wait();
+            for(unsigned i = 1; i < futures.size(); ++i) {
+                REQUIRE(futures[i].wait() == first_id + i);
+            }
+        }
+    }
+
+    SECTION("Push events with several batches in flight") {
+        auto topic = CreateTopic(engine, gid);
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{8},
+            mofka::MaxInFlightBatches{4},
+            mofka::MaxBatchRetries{5},
+            mofka::Ordering::Loose);
+        REQUIRE(static_cast<bool>(producer));
+        REQUIRE(producer.maxInFlightBatches() == mofka::MaxInFlightBatches{4});
+        REQUIRE(producer.maxBatchRetries() == mofka::MaxBatchRetries{5});
+
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        for(unsigned i = 0; i < 100; ++i) {
+            futures.push_back(producer.push(
+                mofka::Metadata("{\"name\":\"matthieu\"}"),
+                mofka::Data{nullptr, 0}));
+        }
+        producer.flush();
+        std::set<mofka::EventID> ids;
+        for(auto& future : futures) ids.insert(future.wait());
+        REQUIRE(ids.size() == futures.size());
+
+        REQUIRE_THROWS_AS(
+            topic.producer("myproducer", mofka::MaxInFlightBatches{0}, mofka::Ordering::Loose),
+            mofka::Exception);
+        /* concurrent batches may reach the partition out of order,
+         * which the ordered modes cannot allow */
+        REQUIRE_THROWS_AS(
+            topic.producer("myproducer", mofka::MaxInFlightBatches{2}, mofka::Ordering::Strict),
+            mofka::Exception);
+        REQUIRE_THROWS_AS(
+            topic.producer("myproducer", mofka::MaxInFlightBatches{2}, mofka::Ordering::PerPartition),
+            mofka::Exception);
+        REQUIRE_NOTHROW(
+            topic.producer("myproducer", mofka::MaxInFlightBatches{1}, mofka::Ordering::Strict));
+    }
+
+    SECTION("Push small batches inline") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{});
+        REQUIRE(static_cast<bool>(topic));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{4},
+            mofka::EagerThreshold{1024},
+            mofka::Ordering::Strict);
+        REQUIRE(static_cast<bool>(producer));
+        REQUIRE(producer.eagerThreshold() == mofka::EagerThreshold{1024});
+
+        /* small events go inline, large ones through RDMA */
+        std::string smallData(16, 'x');
+        std::string largeData(4096, 'y');
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        for(unsigned i = 0; i < 20; ++i) {
+            auto& data = i < 10 ? smallData : largeData;
+            futures.push_back(producer.push(
+                mofka::Metadata(fmt::format("{{\"event_num\":{}}}", i)),
+                mofka::Data{data.data(), data.size()}));
+        }
+        producer.flush();
+        auto first_id = futures[0].wait();
+        for(unsigned i = 1; i < futures.size(); ++i) {
+            REQUIRE(futures[i].wait() == first_id + i);
+        }
+
+        /* the data of both paths reads back through a consumer */
+        mofka::DataSelector data_selector = [](const mofka::Metadata&, const mofka::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+        mofka::DataBroker data_broker = [](const mofka::Metadata&, const mofka::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            return mofka::Data{new char[size], size};
+        };
+        auto consumer = topic.consumer("myconsumer", data_selector, data_broker);
+        for(unsigned i = 0; i < 20; ++i) {
+            auto event = consumer.pull().wait();
+            REQUIRE(event.id() == futures[0].wait() + i);
+            REQUIRE(event.metadata().json()["event_num"].GetInt64() == i);
+            auto& segments = event.data().segments();
+            REQUIRE(segments.size() == 1);
+            auto& expected = i < 10 ? smallData : largeData;
+            REQUIRE(std::string{(const char*)segments[0].ptr, segments[0].size} == expected);
+            delete[] static_cast<const char*>(segments[0].ptr);
+        }
+    }
+
+    SECTION("Send the same batch twice") {
+        auto topic = CreateTopic(engine, gid);
+
+        /* a producer retrying a batch that was appended gets back the
+         * EventID of its first event and the batch isn't appended again */
+        auto producer_id = mofka::UUID::generate();
+        auto first = SendEagerBatch(engine, producer_id, 0, "{\"event_num\":0}", "first");
+        REQUIRE(first.success());
+        auto retried = SendEagerBatch(engine, producer_id, 0, "{\"event_num\":0}", "first");
+        REQUIRE(retried.success());
+        REQUIRE(retried.value() == first.value());
+        auto next = SendEagerBatch(engine, producer_id, 1, "{\"event_num\":1}", "next");
+        REQUIRE(next.success());
+        REQUIRE(next.value() == first.value() + 1);
+        /* the same sequence number from another producer is a new batch */
+        auto other_id = mofka::UUID::generate();
+        auto other = SendEagerBatch(engine, other_id, 0, "{\"event_num\":2}", "other");
+        REQUIRE(other.success());
+        REQUIRE(other.value() == first.value() + 2);
+
+        auto consumer = topic.consumer("myconsumer");
+        for(unsigned i = 0; i < 3; ++i) {
+            auto event = consumer.pull().wait();
+            REQUIRE(event.id() == first.value() + i);
+            REQUIRE(event.metadata().json()["event_num"].GetInt64() == i);
+        }
+
+        /* a partition remembers the batches of its 1024 most recently
+         * seen producers: the producer that sent "other" is forgotten
+         * after 1023 new ones, unlike the first one that keeps sending */
+        auto refreshed = SendEagerBatch(engine, producer_id, 2, "{\"event_num\":3}", "refresh");
+        REQUIRE(refreshed.success());
+        REQUIRE(refreshed.value() == first.value() + 3);
+        for(unsigned i = 0; i < 1023; ++i) {
+            auto result = SendEagerBatch(engine, mofka::UUID::generate(), 0, "{\"event_num\":4}", "filler");
+            REQUIRE(result.success());
+        }
+        retried = SendEagerBatch(engine, producer_id, 0, "{\"event_num\":0}", "first");
+        REQUIRE(retried.success());
+        REQUIRE(retried.value() == first.value());
+        auto forgotten = SendEagerBatch(engine, other_id, 0, "{\"event_num\":2}", "other");
+        REQUIRE(forgotten.success());
+        REQUIRE(forgotten.value() == first.value() + 4 + 1023);
+    }
+
+    SECTION("Push events with continuations and combinators") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{});
+        REQUIRE(static_cast<bool>(topic));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{8}, mofka::Ordering::Strict);
+        REQUIRE(static_cast<bool>(producer));
+
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        std::atomic<size_t> num_callbacks = 0;
+        for(unsigned i = 0; i < 100; ++i) {
+            futures.push_back(producer.push(mofka::Metadata("{\"name\":\"matthieu\"}")));
+            futures.back().then([&num_callbacks](mofka::EventID) { ++num_callbacks; });
+        }
+        auto index = mofka::waitAny(futures);
+        REQUIRE(index < futures.size());
+        REQUIRE(futures[index].completed());
+        mofka::waitAll(futures);
+        auto first_id = futures[0].wait();
+        for(unsigned i = 0; i < futures.size(); ++i) {
+            REQUIRE(futures[i].completed());
+            REQUIRE(futures[i].wait() == first_id + i);
+        }
+        while(num_callbacks != futures.size())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        /* drain a set of futures with waitAny, which must not
+         * leave its callbacks on the futures it didn't return */
+        std::vector<mofka::Future<mofka::EventID>> pending;
+        for(unsigned i = 0; i < 100; ++i)
+            pending.push_back(producer.push(mofka::Metadata("{\"name\":\"matthieu\"}")));
+        std::set<mofka::EventID> ids;
+        while(!pending.empty()) {
+            auto i = mofka::waitAny(pending);
+            REQUIRE(i < pending.size());
+            REQUIRE(pending[i].completed());
+            ids.insert(pending[i].wait());
+            pending.erase(pending.begin() + i);
+        }
+        REQUIRE(ids.size() == 100);
+        REQUIRE(*ids.begin() == first_id + 100);
+        REQUIRE(num_callbacks == futures.size());
+    }
+
+    SECTION("Push events across several completion groups") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto validator = mofka::Validator::FromMetadata(mofka::Metadata{
+            R"({"__type__":"json_schema","schema":{"type":"object","required":["event_num"]}})"});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{}, validator);
+        REQUIRE(static_cast<bool>(topic));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{16}, mofka::Ordering::Strict);
+        REQUIRE(static_cast<bool>(producer));
+
+        /* events pushed one by one share groups of 64 slots; every 7th
+         * event is invalid, so batches straddle the groups. In between,
+         * a vectored push of 100 events and one whose events all fail */
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        std::vector<bool> valid;
+        auto metadata_of = [&valid](unsigned i) {
+            valid.push_back(i % 7 != 3);
+            return mofka::Metadata{valid.back() ? fmt::format("{{\"event_num\":{}}}", i)
+                                                : fmt::format("{{\"bad\":{}}}", i)};
+        };
+        unsigned n = 0;
+        for(; n < 150; ++n)
+            futures.push_back(producer.push(metadata_of(n)));
+        std::vector<mofka::Metadata> group;
+        for(unsigned end = n + 100; n < end; ++n)
+            group.push_back(metadata_of(n));
+        for(auto& future : producer.push(std::move(group)))
+            futures.push_back(std::move(future));
+        std::vector<mofka::Metadata> failing;
+        for(unsigned i = 0; i < 5; ++i) {
+            valid.push_back(false);
+            failing.push_back(mofka::Metadata{"{\"bad\":true}"});
+        }
+        n += 5;
+        for(auto& future : producer.push(std::move(failing)))
+            futures.push_back(std::move(future));
+        for(unsigned end = n + 70; n < end; ++n)
+            futures.push_back(producer.push(metadata_of(n)));
+        REQUIRE(futures.size() == n);
+
+        /* continuations on every third event record what they receive */
+        std::mutex outcomes_mtx;
+        std::map<size_t, std::string> outcomes;
+        std::atomic<size_t> num_callbacks = 0;
+        for(size_t i = 0; i < futures.size(); i += 3) {
+            futures[i].then(
+                [i, &outcomes, &outcomes_mtx, &num_callbacks](mofka::EventID id) {
+                    std::lock_guard<std::mutex> guard{outcomes_mtx};
+                    outcomes[i] = std::to_string(id);
+                    ++num_callbacks;
+                },
+                [i, &outcomes, &outcomes_mtx, &num_callbacks](const mofka::Exception& ex) {
+                    std::lock_guard<std::mutex> guard{outcomes_mtx};
+                    outcomes[i] = dynamic_cast<const mofka::InvalidMetadata*>(&ex) ? "invalid" : "other";
+                    ++num_callbacks;
+                });
+        }
+
+        auto index = mofka::waitAny(futures);
+        REQUIRE(index < futures.size());
+        REQUIRE(futures[index].completed());
+        mofka::waitAll(futures);
+
+        /* valid events got consecutive IDs in the order they were pushed */
+        std::optional<mofka::EventID> next_id;
+        std::vector<std::string> expected(futures.size());
+        for(size_t i = 0; i < futures.size(); ++i) {
+            REQUIRE(futures[i].completed());
+            if(!valid[i]) {
+                REQUIRE_THROWS_AS(futures[i].wait(), mofka::InvalidMetadata);
+                expected[i] = "invalid";
+                continue;
+            }
+            auto id = futures[i].wait();
+            if(next_id) REQUIRE(id == *next_id);
+            next_id = id + 1;
+            expected[i] = std::to_string(id);
+        }
+        while(num_callbacks != (futures.size() + 2)/3)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::lock_guard<std::mutex> guard{outcomes_mtx};
+        for(auto& [i, outcome] : outcomes)
+            REQUIRE(outcome == expected[i]);
+    }
+
+    SECTION("Push events validated against a JSON schema") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto mode = GENERATE(as<std::string>{}, "sax", "dom");
+        auto validator = mofka::Validator::FromMetadata(mofka::Metadata{fmt::format(R"(
+            {{"__type__":"json_schema","mode":"{}",
+              "schema":{{"type":"object",
+                        "properties":{{"name":{{"type":"string","maxLength":16}},
+                                      "energy":{{"type":"number","minimum":0}},
+                                      "tags":{{"type":"array","items":{{"enum":["a","b"]}}}}}},
+                        "required":["name"],
+                        "additionalProperties":false}}}})", mode)});
+        REQUIRE(static_cast<bool>(validator));
+        REQUIRE(validator.metadata().json()["mode"].GetString() == mode);
+        REQUIRE_THROWS_AS(
+            mofka::Validator::FromMetadata(mofka::Metadata{
+                R"({"__type__":"json_schema","mode":"sax","schema":{"anyOf":[{"type":"string"}]}})"}),
+            mofka::Exception);
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{}, validator);
+        REQUIRE(static_cast<bool>(topic));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{4}, mofka::Ordering::Strict);
+        REQUIRE(static_cast<bool>(producer));
+
+        const char* valid[] = {
+            R"({"name":"matthieu"})",
+            R"({"name":"matthieu","energy":1.5,"tags":["a","b"]})",
+            R"({"energy":0,"name":"matthieu"})",
+            R"({"name":"matthieu","tags":[]})"
+        };
+        const char* invalid[] = {
+            R"({"energy":1.5})",
+            R"({"name":42})",
+            R"({"name":"a name that is way too long"})",
+            R"({"name":"matthieu","energy":-1})",
+            R"({"name":"matthieu","tags":["c"]})",
+            R"({"name":"matthieu","other":true})",
+            R"(["name","matthieu"])",
+            R"({"name":"matthieu")"
+        };
+        /* invalid events are rejected before reaching a batch,
+         * so the valid ones still receive consecutive IDs */
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        std::vector<mofka::Future<mofka::EventID>> failures;
+        for(unsigned i = 0; i < 4; ++i) {
+            futures.push_back(producer.push(mofka::Metadata{valid[i]}));
+            failures.push_back(producer.push(mofka::Metadata{invalid[2*i]}));
+            failures.push_back(producer.push(mofka::Metadata{invalid[2*i+1]}));
+        }
+        producer.flush();
+        for(auto& failure : failures) {
+            REQUIRE_THROWS_AS(failure.wait(), mofka::InvalidMetadata);
+        }
+        auto first_id = futures[0].wait();
+        for(unsigned i = 1; i < futures.size(); ++i) {
+            REQUIRE(futures[i].wait() == first_id + i);
+        }
+    }
+
+    SECTION("Push events with malformed JSON metadata") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{});
+        REQUIRE(static_cast<bool>(topic));
+
+        auto producer = topic.producer(
+            "myproducer", mofka::BatchSize{4}, mofka::Ordering::Strict);
+        REQUIRE(static_cast<bool>(producer));
+
+        /* strings longer than a 64-byte block of the structural scanner,
+         * with brackets, quotes, and backslashes inside strings */
+        auto padding = std::string(70, 'x');
+        std::vector<std::string> valid = {
+            "{\"name\":\"" + padding + "\",\"tags\":[\"}\",\"]\"]}",
+            "{\"msg\":\"" + padding + "\\\"{[\",\"path\":\"C:\\\\\"}",
+            "[" + padding + ",{\"a\":[[{}]]}]"
+        };
+        std::vector<std::string> invalid = {
+            "{\"name\":\"" + padding + "\",\"tags\":[\"}\"}",
+            "{\"msg\":\"" + padding + "\\\\\"{[\",\"path\":\"C\"}",
+            "[" + padding + ",{\"a\":[[{}]]}]]"
+        };
+        for(auto& str : valid)
+            REQUIRE_NOTHROW(mofka::Metadata(str, true));
+        for(auto& str : invalid)
+            REQUIRE_THROWS_AS(mofka::Metadata(str, true), mofka::Exception);
+        /* runs of backslashes and quotes across the boundary between
+         * two blocks, whose escaping state carries to the next block */
+        for(size_t n = 50; n < 80; ++n) {
+            auto prefix = "{\"k\":\"" + std::string(n, 'x');
+            REQUIRE_NOTHROW(mofka::Metadata(prefix + "\\\\\\\"]\"}", true));
+            REQUIRE_THROWS_AS(mofka::Metadata(prefix + "\\\\\"]\"}", true), mofka::Exception);
+        }
+
+        std::vector<mofka::Future<mofka::EventID>> futures;
+        std::vector<mofka::Future<mofka::EventID>> failures;
+        for(unsigned i = 0; i < valid.size(); ++i) {
+            futures.push_back(producer.push(mofka::Metadata{valid[i]}));
+            failures.push_back(producer.push(mofka::Metadata{invalid[i]}));
+        }
+        producer.flush();
+        for(auto& failure : failures) {
+            REQUIRE_THROWS_AS(failure.wait(), mofka::InvalidMetadata);
+        }
+        for(auto& future : futures) future.wait();
+    }
+
+    SECTION("Push events with a limit on pending events") {
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto topic = sh.createTopic("mytopic", mofka::TopicBackendConfig{});
+        REQUIRE(static_cast<bool>(topic));
+
+        /* the batches never fill up, so the first events stay pending */
+        auto metadata = mofka::Metadata("{\"name\":\"matthieu\"}");
+        {
+            auto producer = topic.producer(
+                "myproducer", mofka::BatchSize{100},
+                mofka::MaxPendingEvents{4},
+                mofka::BackpressurePolicy::Throw,
+                mofka::Ordering::Strict);
+            REQUIRE(producer.maxPendingEvents() == mofka::MaxPendingEvents{4});
+            REQUIRE(producer.backpressurePolicy() == mofka::BackpressurePolicy::Throw);
+            std::vector<mofka::Future<mofka::EventID>> futures;
+            for(unsigned i = 0; i < 4; ++i)
+                futures.push_back(producer.push(metadata));
+            REQUIRE(producer.pendingEvents() == 4);
+            REQUIRE_THROWS_AS(producer.push(metadata), mofka::BackpressureException);
+            REQUIRE(producer.numRejectedEvents() == 1);
+            producer.flush();
+            for(auto& future : futures) future.wait();
+        }
+        {
+            auto producer = topic.producer(
+                "myproducer", mofka::BatchSize{100},
+                mofka::MaxPendingEvents{4},
+                mofka::BackpressurePolicy::Reject,
+                mofka::Ordering::Strict);
+            std::vector<mofka::Future<mofka::EventID>> futures;
+            for(unsigned i = 0; i < 4; ++i)
+                futures.push_back(producer.push(metadata));
+            auto rejected = producer.push(metadata);
+            REQUIRE(rejected.completed());
+            REQUIRE_THROWS_AS(rejected.wait(), mofka::BackpressureException);
+            /* continuations receive the same exception */
+            bool backpressure = false;
+            rejected.then([](mofka::EventID) {},
+                          [&backpressure](const mofka::Exception& ex) {
+                              backpressure = dynamic_cast<const mofka::BackpressureException*>(&ex) != nullptr;
+                          });
+            REQUIRE(backpressure);
+            producer.flush();
+            for(auto& future : futures) future.wait();
+        }
+        {
+            /* blocked pushes send the partially filled batches */
+            auto producer = topic.producer(
+                "myproducer", mofka::BatchSize{100},
+                mofka::MaxPendingEvents{4},
+                mofka::MaxPendingBytes{256},
+                mofka::BackpressurePolicy::Block,
+                mofka::Ordering::Strict);
+            std::string data(64, 'x');
+            std::vector<mofka::Future<mofka::EventID>> futures;
+            for(unsigned i = 0; i < 20; ++i) {
+                futures.push_back(producer.push(metadata, mofka::Data{data.data(), data.size()}));
+                REQUIRE(producer.pendingEvents() <= 4);
+                REQUIRE(producer.pendingBytes() <= 256);
+            }
+            producer.flush();
+            auto first_id = futures[0].wait();
+            for(unsigned i = 1; i < futures.size(); ++i)
+                REQUIRE(futures[i].wait() == first_id + i);
+            REQUIRE(producer.numRejectedEvents() == 0);
+        }
+    }
+
     server.finalize();
 }
@@ -0,0 +1,273 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <mofka/Client.hpp>
+#include <mofka/TopicHandle.hpp>
+#include <mofka/TargetSelector.hpp>
+#include "BedrockConfig.hpp"
+#include "TopicUtil.hpp"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+/* same as BedrockConfig.hpp, with four partitions to select from */
+static inline const char* multi_partition_config = R"(
+{
+    "libraries" : {
+        "mofka" : "libmofka-bedrock-module.so"
+    },
+    "providers" : [
+        { "name" : "my_mofka_provider_0", "type" : "mofka", "provider_id" : 0 },
+        { "name" : "my_mofka_provider_1", "type" : "mofka", "provider_id" : 1 },
+        { "name" : "my_mofka_provider_2", "type" : "mofka", "provider_id" : 2 },
+        { "name" : "my_mofka_provider_3", "type" : "mofka", "provider_id" : 3 }
+    ],
+    "ssg" : [
+        {
+            "name" : "mofka_group",
+            "method" : "init",
+            "group_file" : "mofka.ssg",
+            "swim" : {
+                "period_length_ms" : 100
+            }
+        }
+    ]
+}
+)";
+
+static size_t IndexOf(const std::vector<mofka::PartitionTargetInfo>& targets,
+                      const mofka::PartitionTargetInfo& target) {
+    return std::find(targets.begin(), targets.end(), target) - targets.begin();
+}
+
+TEST_CASE("Target selector test", "[target-selector]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.ssg"};
+
+    auto server = bedrock::Server("na+sm", multi_partition_config);
+    auto gid = server.getSSGManager().getGroup("mofka_group")->getHandle<uint64_t>();
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    auto topic = CreateTopic(engine, gid);
+    auto targets = topic.targets();
+    REQUIRE(targets.size() == 4);
+    auto keyless = mofka::Metadata{"{\"name\":\"matthieu\"}"};
+
+    SECTION("Key-hash selector") {
+        auto config = mofka::Metadata{R"({"__type__":"key_hash","key":"user.id"})"};
+        auto selector = mofka::TargetSelector::FromMetadata(config);
+        REQUIRE(static_cast<bool>(selector));
+        selector.setTargets(targets);
+
+        auto keyed = [](unsigned k) {
+            return mofka::Metadata{fmt::format("{{\"name\":\"x\",\"user\":{{\"id\":{}}}}}", k)};
+        };
+        constexpr unsigned num_keys = 1000;
+        std::vector<mofka::PartitionTargetInfo> assignment;
+        std::vector<size_t> keys_per_target(targets.size(), 0);
+        for(unsigned k = 0; k < num_keys; ++k) {
+            assignment.push_back(selector.selectTargetFor(keyed(k)));
+            keys_per_target[IndexOf(targets, assignment.back())] += 1;
+        }
+        /* every target gets a share of the keys */
+        for(auto n : keys_per_target) REQUIRE(n >= num_keys/(4*targets.size()));
+
+        /* the same key always maps to the same target, including
+         * from another selector, e.g. that of another producer */
+        auto other = mofka::TargetSelector::FromMetadata(config);
+        other.setTargets(targets);
+        for(unsigned k = 0; k < num_keys; ++k) {
+            REQUIRE(selector.selectTargetFor(keyed(k)) == assignment[k]);
+            REQUIRE(other.selectTargetFor(keyed(k)) == assignment[k]);
+        }
+
+        /* removing a target only remaps the keys it had, about 1/N of them,
+         * and adding it back maps exactly these keys to it again */
+        auto removed = targets.back();
+        auto fewer = std::vector<mofka::PartitionTargetInfo>(targets.begin(), targets.end() - 1);
+        other.setTargets(fewer);
+        size_t remapped = 0;
+        for(unsigned k = 0; k < num_keys; ++k) {
+            auto target = other.selectTargetFor(keyed(k));
+            if(assignment[k] == removed) {
+                REQUIRE(target != removed);
+                remapped += 1;
+            } else {
+                REQUIRE(target == assignment[k]);
+            }
+        }
+        REQUIRE(remapped == keys_per_target.back());
+        REQUIRE(remapped <= 2*num_keys/targets.size());
+        other.setTargets(targets);
+        for(unsigned k = 0; k < num_keys; ++k)
+            REQUIRE(other.selectTargetFor(keyed(k)) == assignment[k]);
+
+        /* events without the key are sent in round-robin */
+        std::vector<size_t> counts(targets.size(), 0);
+        for(unsigned i = 0; i < 4*targets.size(); ++i)
+            counts[IndexOf(targets, selector.selectTargetFor(keyless))] += 1;
+        for(auto n : counts) REQUIRE(n == 4);
+    }
+
+    SECTION("Producer/consumer with key-hash selector") {
+        auto config = mofka::Metadata{R"({"__type__":"key_hash","key":"user.id"})"};
+        auto client = mofka::Client{engine};
+        auto sh = client.connect(mofka::SSGGroupID{gid});
+        auto keyed_topic = sh.createTopic(
+            "keyed_topic", mofka::TopicBackendConfig{},
+            mofka::Validator{}, mofka::TargetSelector::FromMetadata(config));
+        REQUIRE(static_cast<bool>(keyed_topic));
+        auto keyed_targets = keyed_topic.targets();
+        REQUIRE(keyed_targets.size() == targets.size());
+
+        /* some events don't have the key, or have it as a non-scalar */
+        auto metadata_of = [](unsigned i) {
+            return mofka::Metadata{
+                i % 10 == 0 ? fmt::format("{{\"event_num\":{}}}", i)
+              : i % 10 == 1 ? fmt::format("{{\"event_num\":{},\"user\":{{\"id\":[{}]}}}}", i, i % 7)
+              : fmt::format("{{\"event_num\":{},\"user\":{{\"name\":\"x\",\"id\":{}}}}}", i, i % 7)
+            };
+        };
+        {
+            auto producer = keyed_topic.producer(mofka::Ordering::Strict);
+            REQUIRE(static_cast<bool>(producer));
+            for(unsigned i=0; i < 100; ++i)
+                producer.push(metadata_of(i));
+            producer.flush();
+        }
+
+        auto selector = mofka::TargetSelector::FromMetadata(config);
+        selector.setTargets(keyed_targets);
+        auto consumer = keyed_topic.consumer("myconsumer");
+        REQUIRE(static_cast<bool>(consumer));
+        std::vector<char> seen(100, 0);
+        std::vector<mofka::EventID> next_id(keyed_targets.size(), 0);
+        std::vector<int64_t> last_num(keyed_targets.size(), -1);
+        for(unsigned n=0; n < 100; ++n) {
+            auto event = consumer.pull().wait();
+            auto i = event.metadata().json()["event_num"].GetUint64();
+            REQUIRE(i < seen.size());
+            REQUIRE(!seen[i]);
+            seen[i] = 1;
+            auto p = IndexOf(keyed_targets, event.partition());
+            REQUIRE(p < keyed_targets.size());
+            /* each partition received its events in the order they were pushed */
+            REQUIRE(event.id() == next_id[p]++);
+            REQUIRE(static_cast<int64_t>(i) > last_num[p]);
+            last_num[p] = static_cast<int64_t>(i);
+            /* the events with a key are in the partition of their key */
+            if(i % 10 >= 2)
+                REQUIRE(event.partition() == selector.selectTargetFor(metadata_of(i)));
+        }
+        /* the events were spread over several partitions */
+        REQUIRE(std::count_if(next_id.begin(), next_id.end(),
+                              [](mofka::EventID n) { return n != 0; }) > 1);
+    }
+
+    SECTION("Sticky default selector") {
+        auto selector = mofka::TargetSelector::FromMetadata(
+            mofka::Metadata{R"({"__type__":"default","mode":"sticky"})"});
+        REQUIRE(static_cast<bool>(selector));
+        selector.setTargets(targets);
+
+        std::vector<size_t> visited;
+        auto current = selector.selectTargetFor(keyless);
+        for(unsigned j = 0; j < targets.size(); ++j) {
+            visited.push_back(IndexOf(targets, current));
+            /* events stick to the current target */
+            for(unsigned i = 0; i < 10; ++i)
+                REQUIRE(selector.selectTargetFor(keyless) == current);
+            /* closing the batch of another target doesn't move the selector */
+            for(auto& target : targets) {
+                if(target != current) selector.onBatchClosed(target);
+            }
+            REQUIRE(selector.selectTargetFor(keyless) == current);
+            /* closing the batch of the current target does, only once */
+            selector.onBatchClosed(current);
+            auto next = selector.selectTargetFor(keyless);
+            REQUIRE(next != current);
+            selector.onBatchClosed(current);
+            REQUIRE(selector.selectTargetFor(keyless) == next);
+            current = next;
+        }
+        /* the selector went through all the targets before coming back */
+        REQUIRE(IndexOf(targets, current) == visited.front());
+        std::sort(visited.begin(), visited.end());
+        REQUIRE(std::unique(visited.begin(), visited.end()) == visited.end());
+    }
+
+    SECTION("Load-aware selector") {
+        auto selector = mofka::TargetSelector::FromMetadata(
+            mofka::Metadata{R"({"__type__":"load_aware"})"});
+        REQUIRE(static_cast<bool>(selector));
+        selector.setTargets(targets);
+        using namespace std::chrono_literals;
+
+        /* without feedback, events are spread by number of outstanding events */
+        std::vector<size_t> counts(targets.size(), 0);
+        for(unsigned i = 0; i < 4*targets.size(); ++i)
+            counts[IndexOf(targets, selector.selectTargetFor(keyless))] += 1;
+        for(auto n : counts) REQUIRE(n == 4);
+
+        /* the first target becomes 100 times slower than the others */
+        auto slow = targets[0];
+        for(auto& target : targets)
+            selector.onBatchCompleted(target, 4, target == slow ? 10000us : 100us);
+
+        /* traffic moves away from it while the others keep up */
+        std::fill(counts.begin(), counts.end(), 0);
+        for(unsigned i = 0; i < 300; ++i) {
+            auto target = selector.selectTargetFor(keyless);
+            counts[IndexOf(targets, target)] += 1;
+            selector.onBatchCompleted(target, 1, target == slow ? 10000us : 100us);
+        }
+        REQUIRE(counts[0] == 0);
+        for(size_t i = 1; i < targets.size(); ++i) REQUIRE(counts[i] > 0);
+
+        /* cancelled selections are not counted as outstanding: 210 events
+         * leave the others at 70 outstanding events (7000us of expected
+         * delay), twice as many would make the slow target competitive */
+        for(unsigned j = 0; j < 2; ++j) {
+            std::vector<mofka::PartitionTargetInfo> selected;
+            for(unsigned i = 0; i < 210; ++i)
+                selected.push_back(selector.selectTargetFor(keyless));
+            for(auto& target : selected) {
+                REQUIRE(target != slow);
+                selector.onSelectionCancelled(target);
+            }
+        }
+    }
+
+    SECTION("Load-aware selector preferring local targets") {
+        auto selector = mofka::TargetSelector::FromMetadata(
+            mofka::Metadata{R"({"__type__":"load_aware","prefer_local":true,"remote_penalty":4})"});
+        REQUIRE(static_cast<bool>(selector));
+        auto config = selector.metadata();
+        REQUIRE(config.json()["prefer_local"].GetBool());
+        REQUIRE(config.json()["remote_penalty"].GetDouble() == 4.0);
+        selector.setTargets(targets);
+
+        /* the targets of this test are all local (na+sm), so none
+         * of them is penalized and events are spread evenly */
+        std::vector<size_t> counts(targets.size(), 0);
+        for(unsigned i = 0; i < 4*targets.size(); ++i)
+            counts[IndexOf(targets, selector.selectTargetFor(keyless))] += 1;
+        for(auto n : counts) REQUIRE(n == 4);
+
+        /* invalid configurations are rejected */
+        REQUIRE_THROWS_AS(mofka::TargetSelector::FromMetadata(
+            mofka::Metadata{R"({"__type__":"load_aware","prefer_local":1})"}),
+            mofka::Exception);
+        REQUIRE_THROWS_AS(mofka::TargetSelector::FromMetadata(
+            mofka::Metadata{R"({"__type__":"load_aware","remote_penalty":0.5})"}),
+            mofka::Exception);
+    }
+
+    server.finalize();
+}
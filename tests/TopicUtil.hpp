@@ -0,0 +1,48 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_TEST_TOPIC_UTIL_HPP
+#define MOFKA_TEST_TOPIC_UTIL_HPP
+
+#include <catch2/catch_test_macros.hpp>
+#include <mofka/Client.hpp>
+#include <mofka/TopicHandle.hpp>
+#include <vector>
+
+/**
+ * @brief Connects a Client to the group and creates a topic named
+ * "mytopic" with the given validator, selector, serializer, and compressor.
+ */
+static inline mofka::TopicHandle CreateTopic(
+        const thallium::engine& engine, uint64_t gid,
+        mofka::Validator validator = mofka::Validator{},
+        mofka::TargetSelector selector = mofka::TargetSelector{},
+        mofka::Serializer serializer = mofka::Serializer{},
+        mofka::Compressor compressor = mofka::Compressor{}) {
+    auto client = mofka::Client{engine};
+    REQUIRE(static_cast<bool>(client));
+    auto sh = client.connect(mofka::SSGGroupID{gid});
+    REQUIRE(static_cast<bool>(sh));
+    auto topic = sh.createTopic(
+        "mytopic", mofka::TopicBackendConfig{},
+        std::move(validator), std::move(selector),
+        std::move(serializer), std::move(compressor));
+    REQUIRE(static_cast<bool>(topic));
+    return topic;
+}
+
+/**
+ * @brief Waits for the futures and checks that the events
+ * received consecutive EventIDs, in the order they were pushed.
+ */
+static inline void RequireConsecutiveIDs(
+        const std::vector<mofka::Future<mofka::EventID>>& futures) {
+    if(futures.empty()) return;
+    auto first_id = futures[0].wait();
+    for(unsigned i = 1; i < futures.size(); ++i)
+        REQUIRE(futures[i].wait() == first_id + i);
+}
+
+#endif